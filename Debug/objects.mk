@@ -4,5 +4,5 @@
 
 USER_OBJS := ../soundtouch/source/SoundTouch/.libs/libSoundTouch.a
 
-LIBS := -lasound -ljack -lsndfile -lsamplerate -lcurses
+LIBS := -lasound -ljack -lsndfile -lcurses -lpthread
 
@@ -0,0 +1,161 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// A ring buffer class for temporarily storaging sound samples, operates as a
+/// first-in-first-out pipe like 'FIFOSampleBuffer' but never moves the samples
+/// it holds.
+///
+/// The storage is mapped twice in a row in virtual memory, so that the samples
+/// from any position on read and write contiguously across the end of the
+/// ring. Pointers from 'ptrBegin' and 'ptrEnd' may thus be used directly for
+/// as many samples as the buffer holds, with no data moved when samples are
+/// received. The mapping needs the Linux 'mremap' call.
+///
+////////////////////////////////////////////////////////////////////////////////
+//
+// License :
+//
+//  SoundTouch audio processing library
+//  Copyright (c) Olli Parviainen
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef RingSampleBuffer_H
+#define RingSampleBuffer_H
+
+#include "FIFOSamplePipe.h"
+
+namespace soundtouch
+{
+
+/// Sample buffer working in FIFO (first-in-first-out) principle on a mirrored
+/// ring. Samples stay where they were put until received; the buffer is only
+/// copied when it grows.
+///
+/// Notice that in case of stereo audio, one sample is considered to consist of
+/// both channel data.
+class RingSampleBuffer : public FIFOSamplePipe
+{
+private:
+    /// Sample storage, followed right away by a second mapping of itself.
+    SAMPLETYPE *buffer;
+
+    /// Storage size in bytes, a multiple of the page size. The mapping takes
+    /// twice this.
+    uint sizeInBytes;
+
+    /// How many samples are currently in buffer.
+    uint samplesInBuffer;
+
+    /// Channels, 1=mono, 2=stereo.
+    uint channels;
+
+    /// Position of the first sample, in sample values from the start of the
+    /// storage. It always stays within the first mapping.
+    uint bufferPos;
+
+    /// Ensures that the buffer has capacity for at least this many samples.
+    void ensureCapacity(uint capacityRequirement);
+
+    /// Returns current capacity.
+    uint getCapacity() const;
+
+    /// Maps storage of the given size twice in a row.
+    static SAMPLETYPE *allocate(uint sizeInBytes);
+
+    /// Unmaps storage from 'allocate'.
+    static void release(SAMPLETYPE *buffer, uint sizeInBytes);
+
+public:
+
+    /// Constructor
+    RingSampleBuffer(int numChannels = 2     ///< Number of channels, 1=mono, 2=stereo.
+                                              ///< Default is stereo.
+                     );
+
+    /// destructor
+    ~RingSampleBuffer();
+
+    /// Returns a pointer to the beginning of the output samples, valid for all
+    /// the samples in the buffer. Please be careful for not to corrupt the
+    /// book-keeping!
+    ///
+    /// When using this function to output samples, also remember to 'remove' the
+    /// output samples from the buffer by calling the
+    /// 'receiveSamples(numSamples)' function
+    virtual SAMPLETYPE *ptrBegin();
+
+    /// Returns a pointer to the end of the used part of the sample buffer (i.e.
+    /// where the new samples are to be inserted). This function may be used for
+    /// inserting new samples into the sample buffer directly. Please be careful
+    /// not corrupt the book-keeping!
+    ///
+    /// When using this function as means for inserting new samples, also remember
+    /// to increase the sample count afterwards, by calling  the
+    /// 'putSamples(numSamples)' function.
+    SAMPLETYPE *ptrEnd(
+                uint slackCapacity   ///< How much free capacity (in samples) there _at least_
+                                     ///< should be so that the caller can succesfully insert the
+                                     ///< desired samples to the buffer. If necessary, the function
+                                     ///< grows the buffer size to comply with this requirement.
+                );
+
+    /// Adds 'numSamples' pcs of samples from the 'samples' memory position to
+    /// the sample buffer.
+    virtual void putSamples(const SAMPLETYPE *samples,  ///< Pointer to samples.
+                            uint numSamples                         ///< Number of samples to insert.
+                            );
+
+    /// Adjusts the book-keeping to increase number of samples in the buffer without
+    /// copying any actual samples. The samples must have been written through
+    /// 'ptrEnd' with at least this much slack.
+    virtual void putSamples(uint numSamples   ///< Number of samples been inserted.
+                            );
+
+    /// Output samples from beginning of the sample buffer. Copies requested samples to
+    /// output buffer and removes them from the sample buffer. If there are less than
+    /// 'numsample' samples in the buffer, returns all that available.
+    ///
+    /// \return Number of samples returned.
+    virtual uint receiveSamples(SAMPLETYPE *output, ///< Buffer where to copy output samples.
+                                uint maxSamples                 ///< How many samples to receive at max.
+                                );
+
+    /// Adjusts book-keeping so that given number of samples are removed from beginning of the
+    /// sample buffer without copying or moving them anywhere.
+    virtual uint receiveSamples(uint maxSamples   ///< Remove this many samples from the beginning of pipe.
+                                );
+
+    /// Returns number of samples currently available.
+    virtual uint numSamples() const;
+
+    /// Sets number of channels, 1 = mono, 2 = stereo.
+    void setChannels(int numChannels);
+
+    /// Returns nonzero if there aren't any samples available for outputting.
+    virtual int isEmpty() const;
+
+    /// Clears all the samples.
+    virtual void clear();
+
+    /// Grows the buffer to hold at least this many samples, so that putting
+    /// samples within that never allocates.
+    void reserve(uint numSamples);
+};
+
+}
+
+#endif
@@ -134,6 +134,12 @@ namespace soundtouch
             #endif
 
             #define ALLOW_SSE       1
+
+            #if (__x86_64__ && __GNUC__)
+                // Allow AVX2 and FMA optimizations, built for their target
+                // only and picked at run time
+                #define ALLOW_AVX2      1
+            #endif
         #endif
 
     #endif  // INTEGER_SAMPLES
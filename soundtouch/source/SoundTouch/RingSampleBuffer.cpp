@@ -0,0 +1,250 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// A ring buffer class for temporarily storaging sound samples, operates as a
+/// first-in-first-out pipe.
+///
+/// The storage is mapped twice back to back, so that whatever position the
+/// samples begin at, they read and write contiguously. Receiving samples only
+/// moves the position forward; the data itself stays in place.
+///
+////////////////////////////////////////////////////////////////////////////////
+//
+// License :
+//
+//  SoundTouch audio processing library
+//  Copyright (c) Olli Parviainen
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <assert.h>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "RingSampleBuffer.h"
+
+using namespace soundtouch;
+
+// Constructor
+RingSampleBuffer::RingSampleBuffer(int numChannels)
+{
+    assert(numChannels > 0);
+    sizeInBytes = 0; // reasonable initial value
+    buffer = NULL;
+    samplesInBuffer = 0;
+    bufferPos = 0;
+    channels = (uint)numChannels;
+    ensureCapacity(32);     // allocate initial capacity
+}
+
+
+// destructor
+RingSampleBuffer::~RingSampleBuffer()
+{
+    release(buffer, sizeInBytes);
+    buffer = NULL;
+}
+
+
+// Reserves twice the size of address space, maps shared memory on the first
+// half and has the kernel map the same pages again on the second half.
+SAMPLETYPE *RingSampleBuffer::allocate(uint size)
+{
+    char *base;
+
+    base = (char *)mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        throw std::runtime_error("Couldn't allocate memory!\n");
+    }
+    if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED
+        || mremap(base, 0, size, MREMAP_MAYMOVE | MREMAP_FIXED, base + size) == MAP_FAILED)
+    {
+        munmap(base, 2 * size);
+        throw std::runtime_error("Couldn't map the ring buffer!\n");
+    }
+    return (SAMPLETYPE *)base;
+}
+
+
+void RingSampleBuffer::release(SAMPLETYPE *ring, uint size)
+{
+    if (ring)
+    {
+        munmap(ring, 2 * size);
+    }
+}
+
+
+// Sets number of channels, 1 = mono, 2 = stereo
+void RingSampleBuffer::setChannels(int numChannels)
+{
+    uint usedBytes;
+
+    assert(numChannels > 0);
+    usedBytes = channels * samplesInBuffer;
+    channels = (uint)numChannels;
+    samplesInBuffer = usedBytes / channels;
+}
+
+
+// Adds 'numSamples' pcs of samples from the 'samples' memory position to
+// the sample buffer.
+void RingSampleBuffer::putSamples(const SAMPLETYPE *samples, uint nSamples)
+{
+    memcpy(ptrEnd(nSamples), samples, sizeof(SAMPLETYPE) * nSamples * channels);
+    samplesInBuffer += nSamples;
+}
+
+
+// Increases the number of samples in the buffer without copying any actual
+// samples, after they were written through 'ptrEnd'.
+void RingSampleBuffer::putSamples(uint nSamples)
+{
+    ensureCapacity(samplesInBuffer + nSamples);
+    samplesInBuffer += nSamples;
+}
+
+
+// Returns a pointer to the end of the used part of the sample buffer (i.e.
+// where the new samples are to be inserted), with room for at least
+// 'slackCapacity' samples. It may lie on the second mapping, which writes
+// through to the beginning of the ring.
+SAMPLETYPE *RingSampleBuffer::ptrEnd(uint slackCapacity)
+{
+    ensureCapacity(samplesInBuffer + slackCapacity);
+    return buffer + bufferPos + samplesInBuffer * channels;
+}
+
+
+// Returns a pointer to the beginning of the currently non-outputted samples.
+// All of them follow contiguously, the ones past the end of the ring through
+// the second mapping.
+SAMPLETYPE *RingSampleBuffer::ptrBegin()
+{
+    assert(buffer);
+    return buffer + bufferPos;
+}
+
+
+// Ensures that the buffer has enought capacity, i.e. space for _at least_
+// 'capacityRequirement' number of samples. The storage is grown in whole
+// pages, as the mirror mapping requires; the samples in it are copied to the
+// beginning of the new one. Otherwise nothing moves.
+void RingSampleBuffer::ensureCapacity(uint capacityRequirement)
+{
+    SAMPLETYPE *temp;
+    uint page;
+    uint size;
+
+    if (capacityRequirement > getCapacity())
+    {
+        page = (uint)sysconf(_SC_PAGESIZE);
+        size = (capacityRequirement * channels * sizeof(SAMPLETYPE) + page - 1) / page * page;
+        temp = allocate(size);
+        if (samplesInBuffer)
+        {
+            memcpy(temp, ptrBegin(), samplesInBuffer * channels * sizeof(SAMPLETYPE));
+        }
+        release(buffer, sizeInBytes);
+        buffer = temp;
+        sizeInBytes = size;
+        bufferPos = 0;
+    }
+}
+
+
+// Grows the buffer ahead of time, so that the puts that fit never allocate
+void RingSampleBuffer::reserve(uint numSamples)
+{
+    ensureCapacity(numSamples);
+}
+
+
+// Returns the current buffer capacity in terms of samples
+uint RingSampleBuffer::getCapacity() const
+{
+    return sizeInBytes / (channels * sizeof(SAMPLETYPE));
+}
+
+
+// Returns the number of samples currently in the buffer
+uint RingSampleBuffer::numSamples() const
+{
+    return samplesInBuffer;
+}
+
+
+// Output samples from beginning of the sample buffer. Copies demanded number
+// of samples to output and removes them from the sample buffer. If there
+// are less than 'numsample' samples in the buffer, returns all available.
+//
+// Returns number of samples copied.
+uint RingSampleBuffer::receiveSamples(SAMPLETYPE *output, uint maxSamples)
+{
+    uint num;
+
+    num = (maxSamples > samplesInBuffer) ? samplesInBuffer : maxSamples;
+
+    memcpy(output, ptrBegin(), channels * sizeof(SAMPLETYPE) * num);
+    return receiveSamples(num);
+}
+
+
+// Removes samples from the beginning of the sample buffer by moving the
+// position forward, wrapping it back into the first mapping.
+uint RingSampleBuffer::receiveSamples(uint maxSamples)
+{
+    uint ringSize;
+
+    if (maxSamples >= samplesInBuffer)
+    {
+        uint temp;
+
+        temp = samplesInBuffer;
+        samplesInBuffer = 0;
+        return temp;
+    }
+
+    samplesInBuffer -= maxSamples;
+    bufferPos += maxSamples * channels;
+    ringSize = sizeInBytes / sizeof(SAMPLETYPE);
+    if (bufferPos >= ringSize)
+    {
+        bufferPos -= ringSize;
+    }
+
+    return maxSamples;
+}
+
+
+// Returns nonzero if the sample buffer is empty
+int RingSampleBuffer::isEmpty() const
+{
+    return (samplesInBuffer == 0) ? 1 : 0;
+}
+
+
+// Clears the sample buffer
+void RingSampleBuffer::clear()
+{
+    samplesInBuffer = 0;
+    bufferPos = 0;
+}
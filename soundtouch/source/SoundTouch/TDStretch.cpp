@@ -93,6 +93,8 @@ TDStretch::TDStretch() : FIFOProcessor(&outputBuffer)
     pMidBuffer = NULL;
     pRefMidBufferUnaligned = NULL;
     overlapLength = 0;
+    overlapCapacity = 0;
+    outputLimit = 0;
 
     bAutoSeqSetting = TRUE;
     bAutoSeekSetting = TRUE;
@@ -647,7 +649,8 @@ void TDStretch::processSamples()
     // Process samples as long as there are enough samples in 'inputBuffer'
     // to form a processing frame.
 //    while ((int)inputBuffer.numSamples() >= sampleReq - (outDebt / 4)) 
-    while ((int)inputBuffer.numSamples() >= sampleReq) 
+    while ((int)inputBuffer.numSamples() >= sampleReq
+           && (outputLimit == 0 || outputBuffer.numSamples() < outputLimit))
     {
         // If tempo differs from the normal ('SCALE'), scan for the best overlapping
         // position
@@ -699,6 +702,51 @@ void TDStretch::processSamples()
 }
 
 
+void TDStretch::setOutputLimit(uint limit)
+{
+    outputLimit = limit;
+}
+
+
+// Sets the given parameters for a while and steps through the tempos in
+// between, to size the buffers for the largest batches, then goes back to
+// the parameters there were.
+void TDStretch::reserve(int aSampleRate, int aSequenceMS, int aSeekWindowMS, int aOverlapMS,
+                        float minTempo, float maxTempo, uint maxBlock)
+{
+    #define RESERVE_STEPS 256
+
+    int prevRate = sampleRate;
+    int prevSequence = bAutoSeqSetting ? USE_AUTO_SEQUENCE_LEN : sequenceMs;
+    int prevSeekWindow = bAutoSeekSetting ? USE_AUTO_SEEKWINDOW_LEN : seekWindowMs;
+    int prevOverlap = overlapMs;
+    float prevTempo = tempo;
+    int maxReq = 0;
+    int maxWindow = 0;
+    int i;
+
+    setParameters(aSampleRate, aSequenceMS, aSeekWindowMS, aOverlapMS);
+    for (i = 0; i <= RESERVE_STEPS; i ++)
+    {
+        setTempo(minTempo + (maxTempo - minTempo) * i / RESERVE_STEPS);
+        if (sampleReq > maxReq) maxReq = sampleReq;
+        if (seekWindowLength > maxWindow) maxWindow = seekWindowLength;
+    }
+
+    // Input is only added below 'sampleReq', one batch at a time.
+    inputBuffer.reserve((uint)maxReq + maxBlock);
+    // Output goes past the limit by one sequence at most, plus the overlap
+    // slack asked for while mixing.
+    if (outputLimit)
+    {
+        outputBuffer.reserve(outputLimit + maxWindow + overlapCapacity);
+    }
+
+    setParameters(prevRate, prevSequence, prevSeekWindow, prevOverlap);
+    setTempo(prevTempo);
+}
+
+
 // Adds 'numsamples' pcs of samples from the 'samples' memory position into
 // the input of the object.
 void TDStretch::putSamples(const SAMPLETYPE *samples, uint nSamples)
@@ -710,6 +758,20 @@ void TDStretch::putSamples(const SAMPLETYPE *samples, uint nSamples)
 }
 
 
+// Pads the input with silence up to 'sampleReq' samples, written in place,
+// and processes it. The input stays within what 'reserve' sized it for.
+uint TDStretch::drain()
+{
+    uint missing;
+
+    missing = ((int)inputBuffer.numSamples() < sampleReq) ? (uint)sampleReq - inputBuffer.numSamples() : 0;
+    memset(inputBuffer.ptrEnd(missing), 0, missing * channels * sizeof(SAMPLETYPE));
+    inputBuffer.putSamples(missing);
+    processSamples();
+    return missing;
+}
+
+
 
 /// Set new overlap length parameter & reallocate RefMidBuffer if necessary.
 void TDStretch::acceptNewOverlapLength(int newOverlapLength)
@@ -717,11 +779,14 @@ void TDStretch::acceptNewOverlapLength(int newOverlapLength)
     int prevOvl;
 
     assert(newOverlapLength >= 0);
-    prevOvl = overlapLength;
+    prevOvl = overlapCapacity;
     overlapLength = newOverlapLength;
 
+    // The buffers only ever grow, so that going back to a shorter overlap
+    // and forth again does not allocate.
     if (overlapLength > prevOvl)
     {
+        overlapCapacity = overlapLength;
         delete[] pMidBuffer;
         delete[] pRefMidBufferUnaligned;
 
@@ -763,8 +828,18 @@ TDStretch * TDStretch::newInstance()
 #endif // ALLOW_MMX
 
 
+#ifdef ALLOW_AVX2
+    if ((uExtensions & (SUPPORT_AVX2 | SUPPORT_FMA)) == (SUPPORT_AVX2 | SUPPORT_FMA))
+    {
+        // AVX2 and FMA support
+        return ::new TDStretchAVX2;
+    }
+    else
+#endif // ALLOW_AVX2
+
+
 #ifdef ALLOW_SSE
-    if (uExtensions & SUPPORT_SSE)
+    if (uExtensions & SUPPORT_SSE2)
     {
         // SSE support
         return ::new TDStretchSSE;
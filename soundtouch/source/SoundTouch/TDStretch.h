@@ -48,6 +48,7 @@
 #include "STTypes.h"
 #include "RateTransposer.h"
 #include "FIFOSamplePipe.h"
+#include "RingSampleBuffer.h"
 
 namespace soundtouch
 {
@@ -118,15 +119,17 @@ protected:
     SAMPLETYPE *pRefMidBuffer;
     SAMPLETYPE *pRefMidBufferUnaligned;
     int overlapLength;
+    int overlapCapacity;
     int seekLength;
     int seekWindowLength;
     int overlapDividerBits;
     int slopingDivider;
     float nominalSkip;
     float skipFract;
-    FIFOSampleBuffer outputBuffer;
-    FIFOSampleBuffer inputBuffer;
+    RingSampleBuffer outputBuffer;
+    RingSampleBuffer inputBuffer;
     BOOL bQuickSeek;
+    uint outputLimit;
 //    int outDebt;
 //    BOOL bMidBufferDirty;
 
@@ -226,6 +229,17 @@ public:
     /// value isn't returned.
     void getParameters(int *pSampleRate, int *pSequenceMs, int *pSeekWindowMs, int *pOverlapMs) const;
 
+    /// Stops processing once the output holds this many samples, leaving the
+    /// rest of the input for the next call to 'putSamples'. Zero for no limit.
+    void setOutputLimit(uint limit);
+
+    /// Allocates ahead everything processing with the given parameters will
+    /// need, at tempos from 'minTempo' to 'maxTempo', when fed at most
+    /// 'maxBlock' samples at a time under the output limit set. Parameters
+    /// within the ones reserved for never allocate afterwards.
+    void reserve(int sampleRate, int sequenceMS, int seekwindowMS, int overlapMS,
+                 float minTempo, float maxTempo, uint maxBlock);
+
     /// Adds 'numsamples' pcs of samples from the 'samples' memory position into
     /// the input of the object.
     virtual void putSamples(
@@ -233,6 +247,13 @@ public:
             uint numSamples                         ///< Number of samples in 'samples' so that one sample
                                                     ///< contains both channels if stereo
             );
+
+    /// Ends the input: pads it with just the silence the next processing
+    /// sequence lacks and processes it, so that the samples put so far come
+    /// out in one pass instead of after block upon block of silence.
+    ///
+    /// \return Number of silent samples added.
+    uint drain();
 };
 
 
@@ -263,13 +284,29 @@ public:
 
 #ifdef ALLOW_SSE
     /// Class that implements SSE optimized routines for floating point samples type.
+    /// The mono routines need SSE2.
     class TDStretchSSE : public TDStretch
     {
     protected:
         double calcCrossCorrStereo(const float *mixingPos, const float *compare) const;
+        double calcCrossCorrMono(const float *mixingPos, const float *compare) const;
+        virtual void overlapMono(float *output, const float *input) const;
     };
 
 #endif /// ALLOW_SSE
 
+
+#ifdef ALLOW_AVX2
+    /// Class that implements AVX2 and FMA optimized mono routines for floating
+    /// point samples type.
+    class TDStretchAVX2 : public TDStretchSSE
+    {
+    protected:
+        double calcCrossCorrMono(const float *mixingPos, const float *compare) const;
+        virtual void overlapMono(float *output, const float *input) const;
+    };
+
+#endif /// ALLOW_AVX2
+
 }
 #endif  /// TDStretch_H
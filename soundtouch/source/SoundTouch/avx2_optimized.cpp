@@ -0,0 +1,146 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// AVX2 and FMA optimized routines for x86-64 CPUs from Haswell and Excavator
+/// on. The routines are built for those instruction sets through function
+/// target attributes, so that the file needs no special compiler flags and the
+/// rest of the library keeps running on any x86-64 CPU; 'TDStretch::newInstance'
+/// only picks them when the CPU reports both extensions.
+///
+////////////////////////////////////////////////////////////////////////////////
+//
+// License :
+//
+//  SoundTouch audio processing library
+//  Copyright (c) Olli Parviainen
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "cpu_detect.h"
+#include "STTypes.h"
+
+using namespace soundtouch;
+
+#ifdef ALLOW_AVX2
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// implementation of AVX2 optimized functions of class 'TDStretchAVX2'
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "TDStretch.h"
+#include <immintrin.h>
+#include <math.h>
+
+#define FMA_TARGET  __attribute__((target("avx2,fma")))
+// leaves fused multiply-adds out, so that the compiler can't contract into them
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+// Adds the products of eight samples of 'pV1' and 'pV2' to 'vSum' and the
+// squares of the 'pV1' ones to 'vNorm', four in each half. The samples are
+// widened to double before they are multiplied, and multiplied and added in
+// one step, so the products are exact rather than rounded to float first.
+static inline FMA_TARGET void accumulateMono(const float *pV1, const float *pV2, __m128 vMask,
+                                             __m256d *vSum, __m256d *vNorm)
+{
+    __m256d vLow, vHigh;
+
+    vLow = _mm256_cvtps_pd(_mm_and_ps(_mm_loadu_ps(pV1), vMask));
+    vHigh = _mm256_cvtps_pd(_mm_loadu_ps(pV1 + 4));
+    vNorm[0] = _mm256_fmadd_pd(vLow, vLow, vNorm[0]);
+    vNorm[1] = _mm256_fmadd_pd(vHigh, vHigh, vNorm[1]);
+    vSum[0] = _mm256_fmadd_pd(vLow, _mm256_cvtps_pd(_mm_loadu_ps(pV2)), vSum[0]);
+    vSum[1] = _mm256_fmadd_pd(vHigh, _mm256_cvtps_pd(_mm_loadu_ps(pV2 + 4)), vSum[1]);
+}
+
+
+// Adds up the four doubles of a sum.
+static inline FMA_TARGET double sumOf(__m256d v)
+{
+    __m128d vHalf = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(vHalf, _mm_unpackhi_pd(vHalf, vHalf)));
+}
+
+
+// Calculates cross correlation of two mono buffers, summing up in double and
+// skipping the first sample like the plain C routine; correlations differ
+// from the plain C ones in the last bits of float precision at most.
+FMA_TARGET double TDStretchAVX2::calcCrossCorrMono(const float *pV1, const float *pV2) const
+{
+    int i;
+    __m128 vMask, vAll;
+    __m256d vSum[4], vNorm[4];
+
+    // ensure overlapLength is divisible by 8
+    assert((overlapLength % 8) == 0);
+
+    for (i = 0; i < 4; i ++)
+    {
+        vSum[i] = vNorm[i] = _mm256_setzero_pd();
+    }
+    // leaves out the first sample
+    vMask = _mm_castsi128_ps(_mm_set_epi32(-1, -1, -1, 0));
+    vAll = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+    // Sixteen samples a round into two sets of sums, so that the additions
+    // don't wait for each other, and the last eight if there are
+    for (i = 0; i + 16 <= overlapLength; i += 16)
+    {
+        accumulateMono(pV1 + i, pV2 + i, vMask, vSum, vNorm);
+        accumulateMono(pV1 + i + 8, pV2 + i + 8, vAll, vSum + 2, vNorm + 2);
+        vMask = vAll;
+    }
+    if (i < overlapLength)
+    {
+        accumulateMono(pV1 + i, pV2 + i, vMask, vSum, vNorm);
+    }
+
+    double corr = sumOf(_mm256_add_pd(_mm256_add_pd(vSum[0], vSum[1]), _mm256_add_pd(vSum[2], vSum[3])));
+    double norm = sumOf(_mm256_add_pd(_mm256_add_pd(vNorm[0], vNorm[1]), _mm256_add_pd(vNorm[2], vNorm[3])));
+
+    if (norm < 1e-9) norm = 1.0;    // to avoid div by zero
+    return corr / sqrt(norm);
+}
+
+
+// Overlaps samples in 'midBuffer' with the samples in 'pInput', eight at a
+// time. It keeps to the operations of the plain C routine, without fused
+// multiply-adds, so that the output is the same to the bit.
+AVX2_TARGET void TDStretchAVX2::overlapMono(float *pOutput, const float *pInput) const
+{
+    int i;
+    __m256 vI, vLength, vStep;
+
+    // ensure overlapLength is divisible by 8
+    assert((overlapLength % 8) == 0);
+
+    vI = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+    vLength = _mm256_set1_ps((float)overlapLength);
+    vStep = _mm256_set1_ps(8.0f);
+
+    for (i = 0; i < overlapLength; i += 8)
+    {
+        __m256 vIn, vMid;
+
+        vIn = _mm256_mul_ps(_mm256_loadu_ps(pInput + i), vI);
+        vMid = _mm256_mul_ps(_mm256_loadu_ps(pMidBuffer + i), _mm256_sub_ps(vLength, vI));
+        _mm256_storeu_ps(pOutput + i, _mm256_div_ps(_mm256_add_ps(vIn, vMid), vLength));
+        vI = _mm256_add_ps(vI, vStep);
+    }
+}
+
+#endif  // ALLOW_AVX2
@@ -47,6 +47,9 @@
 using namespace std;
 
 #include <stdio.h>
+#if (ALLOW_X86_OPTIMIZATIONS && __GNUC__)
+#include <cpuid.h>
+#endif
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -57,6 +60,19 @@ using namespace std;
 // Flag variable indicating whick ISA extensions are disabled (for debugging)
 static uint _dwDisabledISA = 0x00;      // 0xffffffff; //<- use this to disable all extensions
 
+#if (ALLOW_X86_OPTIMIZATIONS && __GNUC__)
+// Reads the extended control register telling which register states the OS
+// saves; 'xgetbv' is only there when the OSXSAVE cpuid bit is.
+static uint readXCR0()
+{
+    uint eax, edx;
+
+    asm volatile("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+    return eax;
+}
+#endif
+
+
 // Disables given set of instruction extensions. See SUPPORT_... defines.
 void disableExtensions(uint dwDisableMask)
 {
@@ -74,62 +90,40 @@ uint detectCPUextensions(void)
 
 #else
     uint res = 0;
+    uint eax, ebx, ecx, edx;
 
     if (_dwDisabledISA == 0xffffffff) return 0;
 
-    asm volatile(
-        "\n\txor     %%esi, %%esi"       // clear %%esi = result register
-        // check if 'cpuid' instructions is available by toggling eflags bit 21
-
-        "\n\tpushf"                      // save eflags to stack
-        "\n\tmovl    (%%esp), %%eax"     // load eax from stack (with eflags)
-        "\n\tmovl    %%eax, %%ecx"       // save the original eflags values to ecx
-        "\n\txor     $0x00200000, %%eax" // toggle bit 21
-        "\n\tmovl    %%eax, (%%esp)"     // store toggled eflags to stack
-        "\n\tpopf"                       // load eflags from stack
-        "\n\tpushf"                      // save updated eflags to stack
-        "\n\tmovl    (%%esp), %%eax"     // load eax from stack
-        "\n\tpopf"                       // pop stack to restore esp
-        "\n\txor     %%edx, %%edx"       // clear edx for defaulting no mmx
-        "\n\tcmp     %%ecx, %%eax"       // compare to original eflags values
-        "\n\tjz      end"                // jumps to 'end' if cpuid not present
-        // cpuid instruction available, test for presence of mmx instructions
-
-        "\n\tmovl    $1, %%eax"
-        "\n\tcpuid"
-        "\n\ttest    $0x00800000, %%edx"
-        "\n\tjz      end"                // branch if MMX not available
-
-        "\n\tor      $0x01, %%esi"       // otherwise add MMX support bit
-
-        "\n\ttest    $0x02000000, %%edx"
-        "\n\tjz      test3DNow"          // branch if SSE not available
-
-        "\n\tor      $0x08, %%esi"       // otherwise add SSE support bit
-
-    "\n\ttest3DNow:"
-        // test for precense of AMD extensions
-        "\n\tmov     $0x80000000, %%eax"
-        "\n\tcpuid"
-        "\n\tcmp     $0x80000000, %%eax"
-        "\n\tjbe     end"                 // branch if no AMD extensions detected
-
-        // test for precense of 3DNow! extension
-        "\n\tmov     $0x80000001, %%eax"
-        "\n\tcpuid"
-        "\n\ttest    $0x80000000, %%edx"
-        "\n\tjz      end"                  // branch if 3DNow! not detected
-
-        "\n\tor      $0x02, %%esi"         // otherwise add 3DNow support bit
-
-    "\n\tend:"
-
-        "\n\tmov     %%esi, %0"
-
-      : "=r" (res)
-      : /* no inputs */
-      : "%edx", "%eax", "%ecx", "%esi" );
-      
+    // '__get_cpuid' checks whether 'cpuid' and the asked leaf are available;
+    // unlike pushing eflags around by hand, it works on x86-64 as well.
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    {
+        if (edx & bit_MMX) res |= SUPPORT_MMX;
+        if (edx & bit_SSE) res |= SUPPORT_SSE;
+        if (edx & bit_SSE2) res |= SUPPORT_SSE2;
+
+        // AVX registers are only usable if the OS saves them on context
+        // switches, as told by the XCR0 register
+        if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX) && (readXCR0() & 0x06) == 0x06)
+        {
+            if (ecx & bit_FMA) res |= SUPPORT_FMA;
+            if (__get_cpuid_max(0, NULL) >= 7)
+            {
+                __cpuid_count(7, 0, eax, ebx, ecx, edx);
+                if (ebx & bit_AVX2) res |= SUPPORT_AVX2;
+                // AVX-512 also needs the OS to save the opmask and upper ZMM
+                // register states
+                if ((ebx & bit_AVX512F) && (readXCR0() & 0xe6) == 0xe6) res |= SUPPORT_AVX512;
+            }
+        }
+    }
+
+    // test for precense of AMD 3DNow! extension
+    if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) && (edx & bit_3DNOW))
+    {
+        res |= SUPPORT_3DNOW;
+    }
+
     return res & ~_dwDisabledISA;
 #endif
 }
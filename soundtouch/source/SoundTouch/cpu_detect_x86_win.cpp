@@ -105,6 +105,11 @@ uint detectCPUextensions(void)
 
         or      esi, SUPPORT_SSE    ; otherwise add SSE support bit
 
+        test    edx, 0x04000000
+        jz      test3DNow           ; branch if SSE2 not available
+
+        or      esi, SUPPORT_SSE2   ; otherwise add SSE2 support bit
+
     test3DNow:
         ; test for precense of AMD extensions
         mov     eax, 0x80000000
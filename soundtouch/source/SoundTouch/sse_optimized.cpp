@@ -249,6 +249,87 @@ double TDStretchSSE::calcCrossCorrStereo(const float *pV1, const float *pV2) con
 }
 
 
+#include <emmintrin.h>
+
+// Calculates cross correlation of two mono buffers, the same way as the plain C
+// routine: products are rounded to float and summed up in double, skipping the
+// first sample. The sums only go in another order, so that both routines pick
+// the same overlap positions. Needs SSE2; neither buffer needs to be aligned.
+double TDStretchSSE::calcCrossCorrMono(const float *pV1, const float *pV2) const
+{
+    int i;
+    __m128 vMask, vTemp, vProd;
+    __m128d vSum0, vSum1, vSum2, vSum3;
+    __m128d vNorm0, vNorm1, vNorm2, vNorm3;
+
+    // ensure overlapLength is divisible by 8
+    assert((overlapLength % 8) == 0);
+
+    vSum0 = vSum1 = vSum2 = vSum3 = _mm_setzero_pd();
+    vNorm0 = vNorm1 = vNorm2 = vNorm3 = _mm_setzero_pd();
+    // leaves out the first sample, then lets everything through
+    vMask = _mm_castsi128_ps(_mm_set_epi32(-1, -1, -1, 0));
+
+    // Four separate sums of each kind, so that the additions don't wait
+    // for each other
+    for (i = 0; i < overlapLength; i += 8)
+    {
+        vTemp = _mm_and_ps(_mm_loadu_ps(pV1 + i), vMask);
+        vProd = _mm_mul_ps(vTemp, _mm_loadu_ps(pV2 + i));
+        vSum0 = _mm_add_pd(vSum0, _mm_cvtps_pd(vProd));
+        vSum1 = _mm_add_pd(vSum1, _mm_cvtps_pd(_mm_movehl_ps(vProd, vProd)));
+        vProd = _mm_mul_ps(vTemp, vTemp);
+        vNorm0 = _mm_add_pd(vNorm0, _mm_cvtps_pd(vProd));
+        vNorm1 = _mm_add_pd(vNorm1, _mm_cvtps_pd(_mm_movehl_ps(vProd, vProd)));
+
+        vTemp = _mm_loadu_ps(pV1 + i + 4);
+        vProd = _mm_mul_ps(vTemp, _mm_loadu_ps(pV2 + i + 4));
+        vSum2 = _mm_add_pd(vSum2, _mm_cvtps_pd(vProd));
+        vSum3 = _mm_add_pd(vSum3, _mm_cvtps_pd(_mm_movehl_ps(vProd, vProd)));
+        vProd = _mm_mul_ps(vTemp, vTemp);
+        vNorm2 = _mm_add_pd(vNorm2, _mm_cvtps_pd(vProd));
+        vNorm3 = _mm_add_pd(vNorm3, _mm_cvtps_pd(_mm_movehl_ps(vProd, vProd)));
+
+        vMask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    }
+
+    vSum0 = _mm_add_pd(_mm_add_pd(vSum0, vSum1), _mm_add_pd(vSum2, vSum3));
+    vNorm0 = _mm_add_pd(_mm_add_pd(vNorm0, vNorm1), _mm_add_pd(vNorm2, vNorm3));
+
+    double corr = _mm_cvtsd_f64(_mm_add_sd(vSum0, _mm_unpackhi_pd(vSum0, vSum0)));
+    double norm = _mm_cvtsd_f64(_mm_add_sd(vNorm0, _mm_unpackhi_pd(vNorm0, vNorm0)));
+
+    if (norm < 1e-9) norm = 1.0;    // to avoid div by zero
+    return corr / sqrt(norm);
+}
+
+
+// Overlaps samples in 'midBuffer' with the samples in 'pInput', four at a time
+// with the very same operations as the plain C routine.
+void TDStretchSSE::overlapMono(float *pOutput, const float *pInput) const
+{
+    int i;
+    __m128 vI, vLength, vStep;
+
+    // ensure overlapLength is divisible by 8
+    assert((overlapLength % 8) == 0);
+
+    vI = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    vLength = _mm_set1_ps((float)overlapLength);
+    vStep = _mm_set1_ps(4.0f);
+
+    for (i = 0; i < overlapLength; i += 4)
+    {
+        __m128 vIn, vMid;
+
+        vIn = _mm_mul_ps(_mm_loadu_ps(pInput + i), vI);
+        vMid = _mm_mul_ps(_mm_loadu_ps(pMidBuffer + i), _mm_sub_ps(vLength, vI));
+        _mm_storeu_ps(pOutput + i, _mm_div_ps(_mm_add_ps(vIn, vMid), vLength));
+        vI = _mm_add_ps(vI, vStep);
+    }
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // implementation of SSE optimized functions of class 'FIRFilter'
@@ -20,10 +20,25 @@
 #define ALSA_H_
 
 #include <cassert>
+#include <poll.h>
+#include <pthread.h>
 #include <alsa/asoundlib.h>
+#include "jack.h"
+#include "threading.h"
 
 namespace alsa {
 
+static const size_t MIDI_QUEUE_SIZE = 1024;
+static const int    MIDI_POLL_TIMEOUT = 100; // milliseconds
+
+// Sequencer event copied out of ALSA with the frame time it arrived at.
+struct StampedEvent {
+	snd_seq_event_t event;
+	jack_nframes_t time;
+};
+
+typedef threading::Ring<StampedEvent, MIDI_QUEUE_SIZE> StampedEventQueue;
+
 class Sequencer {
 	snd_seq_t* handle;
 public:
@@ -46,17 +61,7 @@ public:
 	virtual ~MidiPort() {}
 };
 
-class MidiInputListener;
-
-typedef std::set<MidiInputListener*> MidiInputListenerSet;
-
-class IMidiInput : public MidiPort {
-public:
-	IMidiInput( Sequencer* sequencer ) : MidiPort( sequencer ) {}
-	~IMidiInput() {}
-	virtual void add_listener( MidiInputListener* listener ) {}
-	virtual void remove_listener( MidiInputListener* listener ) {}
-};
+class IMidiInput;
 
 class MidiInputListener {
 public:
@@ -71,9 +76,12 @@ public:
 	virtual void on_pitch_wheel( IMidiInput* input, const midi::PitchWheel* event ) {}
 };
 
-class MidiInput : public IMidiInput {
+typedef std::set<MidiInputListener*> MidiInputListenerSet;
+
+// Source of MIDI events for the audio thread. Every period begin() is
+// called once, then next() fires the events in frame order.
+class IMidiInput : public MidiPort {
 	MidiInputListenerSet listeners;
-	int port_id;
 protected:
 	void fire_note_off( const midi::NoteOff* event ) {
 		MidiInputListenerSet::const_iterator it;
@@ -117,53 +125,139 @@ protected:
 			(*it)->on_pitch_wheel( this, event );
 		}
 	}
+	void fire( midi::Event& event ) {
+		switch ( event.get_type() ) {
+		case midi::Event::NOTE_OFF:
+			fire_note_off( event.as_note_off() );
+			break;
+		case midi::Event::NOTE_ON:
+			fire_note_on( event.as_note_on() );
+			break;
+		case midi::Event::AFTER_TOUCH:
+			fire_after_touch( event.as_after_touch() );
+			break;
+		case midi::Event::CONTROLLER:
+			fire_controller( event.as_controller() );
+			break;
+		case midi::Event::PROGRAM_CHANGE:
+			fire_program_change( event.as_program_change() );
+			break;
+		case midi::Event::CHANNEL_PRESSURE:
+			fire_channel_pressure( event.as_channel_pressure() );
+			break;
+		case midi::Event::PITCH_WHEEL:
+			fire_pitch_wheel( event.as_pitch_wheel() );
+			break;
+		}
+	}
 public:
-	MidiInput( Sequencer* sequencer, const std::string& name ) :
+	IMidiInput( Sequencer* sequencer ) : MidiPort( sequencer ) {}
+	~IMidiInput() {}
+	void add_listener( MidiInputListener* listener ) {
+		listeners.insert( listener );
+	}
+	void remove_listener( MidiInputListener* listener ) {
+		listeners.erase( listener );
+	}
+	// Starts the period about to be rendered.
+	virtual void begin() = 0;
+	// Fires the events due at offset or before, and returns the offset of
+	// the next one in this period or the end of the period.
+	virtual jack_nframes_t next( const jack_nframes_t& offset ) = 0;
+};
+
+// Events are read by a thread of their own and stamped with the JACK
+// frame time as they arrive. The audio thread plays each one a period
+// later at the same offset, so timing does not depend on the period size.
+class MidiInput : public IMidiInput {
+	int port_id;
+	jack::Client* client;
+	StampedEventQueue queue;
+	pthread_t thread;
+	volatile bool quit;
+	jack_nframes_t start;
+	jack_nframes_t frames;
+	static void* callback( void* arg ) {
+		((MidiInput*)arg)->on_thread();
+		return 0;
+	}
+protected:
+	static bool is_known( const midi::Event& event ) {
+		switch ( event.get_type() ) {
+		case midi::Event::NOTE_OFF:
+		case midi::Event::NOTE_ON:
+		case midi::Event::AFTER_TOUCH:
+		case midi::Event::CONTROLLER:
+		case midi::Event::PROGRAM_CHANGE:
+		case midi::Event::CHANNEL_PRESSURE:
+		case midi::Event::PITCH_WHEEL:
+			return true;
+		}
+		return false;
+	}
+	void on_thread() {
+		snd_seq_t* handle = get_sequencer()->get_handle();
+		int count = snd_seq_poll_descriptors_count( handle, POLLIN );
+		struct pollfd* descriptors = new struct pollfd[ count ];
+		StampedEvent stamped;
+		midi::Event event;
+		snd_seq_poll_descriptors( handle, descriptors, count, POLLIN );
+		while ( !quit ) {
+			if ( poll( descriptors, count, MIDI_POLL_TIMEOUT ) <= 0 ) {
+				continue;
+			}
+			while ( snd_seq_event_input( handle, event.get_event_ex() ) >= 0 ) {
+				if ( is_known( event ) ) {
+					stamped.event = *event.get_event();
+					stamped.time = client->get_frame_time();
+					// A full queue drops the event rather than block.
+					queue.push( stamped );
+				}
+				snd_seq_free_event( event.get_event() );
+			}
+		}
+		delete [] descriptors;
+	}
+	jack_nframes_t get_offset( const StampedEvent& stamped ) const {
+		// Frames are compared as a difference so that wrapping is harmless.
+		int delta = (int)( stamped.time - start ) + (int)frames;
+		return delta > 0 ? delta : 0;
+	}
+public:
+	MidiInput( Sequencer* sequencer, const std::string& name, jack::Client* client ) :
 		IMidiInput( sequencer ),
 		port_id( snd_seq_create_simple_port(
 				get_sequencer()->get_handle(), name.c_str(),
 				SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE | SND_SEQ_PORT_CAP_READ,
-				SND_SEQ_PORT_TYPE_APPLICATION ) ) {
+				SND_SEQ_PORT_TYPE_APPLICATION ) ),
+		client( client ), quit( false ), start( 0 ), frames( 0 ) {
 		assert( port_id >= 0 );
+		int created = pthread_create( &thread, 0, callback, this );
+		assert( created == 0 );
 	}
     ~MidiInput() {
+    	quit = true;
+    	pthread_join( thread, 0 );
     	snd_seq_delete_simple_port( get_sequencer()->get_handle(), port_id );
     }
-	void add_listener( MidiInputListener* listener ) {
-		listeners.insert( listener );
+	void begin() {
+		start = client->get_last_frame_time();
+		frames = client->get_buffer_size();
 	}
-	void remove_listener( MidiInputListener* listener ) {
-		listeners.erase( listener );
-	}
-    void next() {
+    jack_nframes_t next( const jack_nframes_t& offset ) {
+    	const StampedEvent* stamped;
     	midi::Event event;
-    	while ( snd_seq_event_input_pending( get_sequencer()->get_handle(), 1 ) > 0 ) {
-    		snd_seq_event_input( get_sequencer()->get_handle(), event.get_event_ex() );
-			switch ( event.get_type() ) {
-			case midi::Event::NOTE_OFF:
-				fire_note_off( event.as_note_off() );
-				break;
-			case midi::Event::NOTE_ON:
-				fire_note_on( event.as_note_on() );
-				break;
-			case midi::Event::AFTER_TOUCH:
-				fire_after_touch( event.as_after_touch() );
-				break;
-			case midi::Event::CONTROLLER:
-				fire_controller( event.as_controller() );
-				break;
-			case midi::Event::PROGRAM_CHANGE:
-				fire_program_change( event.as_program_change() );
-				break;
-			case midi::Event::CHANNEL_PRESSURE:
-				fire_channel_pressure( event.as_channel_pressure() );
-				break;
-			case midi::Event::PITCH_WHEEL:
-				fire_pitch_wheel( event.as_pitch_wheel() );
-				break;
-			}
-			snd_seq_free_event( event.get_event() );
+    	jack_nframes_t due;
+    	while ( ( stamped = queue.front() ) != 0 ) {
+    		due = get_offset( *stamped );
+    		if ( due > offset ) {
+    			return due < frames ? due : frames;
+    		}
+    		*event.get_event_ex() = (snd_seq_event_t*)&stamped->event;
+    		fire( event );
+    		queue.pop();
     	}
+    	return frames;
     }
 };
 
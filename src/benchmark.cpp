@@ -0,0 +1,650 @@
+/**
+ * This file is part of repulse.
+ * (c) 2010 and onwards Juan Carlos Rodrigo Garcia.
+ *
+ * repulse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * repulse is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with repulse.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Times every DSP stage on its own, outside of Jack, and prints one CSV
+// line per stage, parameters, sample rate and block size.
+
+#include <ios>
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <unistd.h>
+#include <sys/time.h>
+#include "filtering.h"
+#include "envelope.h"
+#include "voicing.h"
+#include "offline.h"
+#include "simd.h"
+
+namespace benchmark {
+
+static const size_t         DEF_SAMPLES = 1 << 20;
+static const jack_nframes_t MIN_BUFFER_SIZE = 16;
+static const jack_nframes_t MAX_BUFFER_SIZE = 4096;
+static const jack_nframes_t SAMPLE_RATES[] = { 44100, 48000, 96000 };
+static const size_t         SAMPLE_RATE_COUNT = sizeof( SAMPLE_RATES ) / sizeof( SAMPLE_RATES[0] );
+static const util::floating_t WAVE_TIME = 1;
+static const util::floating_t DECAY_TIME = envelope::MAX_DECAY;
+static const util::floating_t DECAY_LENGTH = 4;
+static const size_t         DECAY_SLICES = 16;
+static const char*          DECAY_MODES[] = { "plain", "ftz", "tail", "ftz+tail" };
+static const size_t         DECAY_MODE_COUNT = sizeof( DECAY_MODES ) / sizeof( DECAY_MODES[0] );
+static const int            CHECK_MAX_OVERLAP_MS = 30;
+static const size_t         CHECK_ROUNDS = 16;
+static const int            CHECK_MAX_OFFSET = 15;
+static const double         CHECK_TOLERANCE = 1e-6;
+static const util::floating_t CHECK_SWEEP_FREQUENCIES[] = { 1400, 5200, 12000, 20000 };
+static const size_t         CHECK_SWEEP_FREQUENCY_COUNT = sizeof( CHECK_SWEEP_FREQUENCIES ) / sizeof( CHECK_SWEEP_FREQUENCIES[0] );
+static const util::floating_t CHECK_SWEEP_DRIVE = 10;
+static const util::floating_t CHECK_SWEEP_DECAY = 0.3;
+static const util::floating_t CHECK_SWEEP_TIME = 1;
+static const util::floating_t CHECK_SWEEP_MAX_GAIN = 8;
+
+static inline unsigned long long cycles() {
+#if defined( __i386__ ) || defined( __x86_64__ )
+	unsigned int lo, hi;
+	__asm__ __volatile__ ( "rdtsc" : "=a" ( lo ), "=d" ( hi ) );
+	return ( (unsigned long long)hi << 32 ) | lo;
+#else
+	return 0;
+#endif
+}
+
+static inline double now() {
+	struct timeval tv;
+	gettimeofday( &tv, 0 );
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Same noise for every run, so that the stages see the same signal.
+static void noise( jack::sample_t* samples, const size_t& count ) {
+	unsigned int seed = 1;
+	for ( size_t i = 0; i < count; ++i ) {
+		seed = seed * 1103515245 + 12345;
+		samples[i] = ( ( seed >> 9 ) & 0xFFFF ) / 32768.f - 1.f;
+	}
+}
+
+// One stage under test. run() processes the next block in place.
+class Stage {
+	std::string name;
+	std::string parameters;
+public:
+	Stage( const std::string& name, const std::string& parameters ) :
+		name( name ), parameters( parameters ) {}
+	virtual ~Stage() {}
+	const std::string& get_name() const { return name; }
+	const std::string& get_parameters() const { return parameters; }
+	// Voices a block of run() renders; costs are given per voice.
+	virtual size_t get_voices() const { return 1; }
+	virtual void run( jack::sample_t* samples ) = 0;
+};
+
+// Block copy every other stage pays for too, as a baseline.
+class Copy : public Stage {
+public:
+	Copy() : Stage( "copy", "" ) {}
+	void run( jack::sample_t* samples ) {}
+};
+
+class Gain : public Stage {
+	filtering::Gain gain;
+public:
+	Gain( jack::Client* client, const util::floating_t& volume, const std::string& parameters ) :
+		Stage( "gain", parameters ), gain( client ) {
+		gain.set_volume( volume );
+	}
+	void run( jack::sample_t* samples ) {
+		gain.set_silent( false );
+		gain.filter( samples );
+	}
+};
+
+class OverDrive : public Stage {
+	filtering::OverDrive over_drive;
+public:
+	OverDrive( jack::Client* client, const util::floating_t& drive, const filtering::OverDriveQuality& quality,
+			const std::string& parameters ) :
+		Stage( "over_drive", parameters ), over_drive( client ) {
+		over_drive.set_active( true );
+		over_drive.set_drive( drive );
+		over_drive.set_quality( quality );
+	}
+	void run( jack::sample_t* samples ) {
+		over_drive.set_silent( false );
+		over_drive.filter( samples );
+	}
+};
+
+class Frequency : public Stage {
+	filtering::Frequency frequency;
+public:
+	Frequency( jack::Client* client, const filtering::FrequencyFilterType& type,
+			const util::floating_t& cutoff, const util::floating_t& resonance, const std::string& parameters ) :
+		Stage( "frequency", parameters ), frequency( client ) {
+		frequency.set_active( true );
+		frequency.set_filter_type( type );
+		frequency.set_frequency( cutoff );
+		frequency.set_resonance( resonance );
+	}
+	void run( jack::sample_t* samples ) {
+		frequency.set_silent( false );
+		frequency.filter( samples );
+	}
+};
+
+// Sources read a second of noise from a wave, starting over at its end.
+class Source : public Stage {
+	filtering::Wave wave;
+	filtering::WaveReader reader;
+protected:
+	filtering::WaveReader& get_reader() { return reader; }
+	virtual filtering::Generator& get_generator() { return reader; }
+public:
+	Source( jack::Client* client, const std::string& name, const std::string& parameters ) :
+		Stage( name, parameters ), wave( client ), reader( client ) {
+		jack_nframes_t buffer_size = client->time_to_frames( WAVE_TIME );
+		jack_nframes_t sample_rate = client->get_sample_rate();
+		jack::sample_t* buffer = new jack::sample_t[ buffer_size ];
+		noise( buffer, buffer_size );
+		wave.swap( buffer, buffer_size, sample_rate );
+		reader.set_wave( &wave );
+	}
+	void start() {
+		get_generator().reset();
+	}
+	void run( jack::sample_t* samples ) {
+		get_generator().filter( samples );
+		if ( get_generator().is_silent() ) {
+			start();
+			get_generator().filter( samples );
+		}
+	}
+};
+
+class Wave : public Source {
+public:
+	Wave( jack::Client* client ) : Source( client, "wave", "" ) {
+		start();
+	}
+};
+
+class Tuner : public Source {
+	filtering::Tuner tuner;
+protected:
+	filtering::Generator& get_generator() { return tuner; }
+public:
+	Tuner( jack::Client* client, const util::floating_t& transpose, const filtering::TunerQuality& quality,
+			const std::string& parameters ) :
+		Source( client, "tuner", parameters ), tuner( client, &get_reader() ) {
+		tuner.set_transpose( transpose );
+		tuner.set_quality( quality );
+		start();
+	}
+};
+
+class TimeStretch : public Source {
+	filtering::TimeStretch time_stretch;
+protected:
+	filtering::Generator& get_generator() { return time_stretch; }
+public:
+	TimeStretch( jack::Client* client, const filtering::TimeStretchType& type,
+			const util::floating_t& stretch, const std::string& parameters ) :
+		Source( client, "time_stretch", parameters ), time_stretch( client, &get_reader() ) {
+		time_stretch.set_type( type );
+		time_stretch.set_stretch( stretch );
+		start();
+	}
+};
+
+class Envelope : public Stage {
+	envelope::Machine machine;
+public:
+	Envelope( jack::Client* client, const util::floating_t& decay, const std::string& parameters ) :
+		Stage( "envelope", parameters ), machine( client ) {
+		machine.set_decay_type( envelope::DECAY_TYPE_TRIGGER );
+		machine.set_decay_time( decay );
+		machine.note_on();
+	}
+	void run( jack::sample_t* samples ) {
+		if ( machine.is_finished() ) {
+			machine.note_on();
+		}
+		machine.set_silent( false );
+		machine.filter( samples );
+	}
+};
+
+// The chain of filtered voices, one by one or as a bank of SIMD lanes. With
+// a filter envelope every voice keeps sweeping. Lanes are a hundred hertz
+// apart from the frequency up.
+class Chains : public Stage {
+	filtering::OverDrive* over_drives[ voicing::BANK_LANES ];
+	filtering::Frequency* frequencies[ voicing::BANK_LANES ];
+	envelope::Machine* envelopes[ voicing::BANK_LANES ];
+	filtering::Gain* gains[ voicing::BANK_LANES ];
+	voicing::Chain* chains[ voicing::BANK_LANES ];
+	jack::sample_t* buffers[ voicing::BANK_LANES ];
+	jack::Client* client;
+	size_t lanes;
+public:
+	Chains( jack::Client* client, const size_t& lanes, const util::floating_t& envelope,
+			const std::string& parameters, const util::floating_t& frequency = 1000 ) :
+		Stage( "chain", parameters ), client( client ), lanes( lanes ) {
+		for ( size_t k = 0; k < lanes; ++k ) {
+			over_drives[k] = new filtering::OverDrive( client );
+			frequencies[k] = new filtering::Frequency( client );
+			envelopes[k] = new envelope::Machine( client );
+			gains[k] = new filtering::Gain( client );
+			frequencies[k]->set_active( true );
+			frequencies[k]->set_frequency( frequency + 100 * k );
+			frequencies[k]->set_envelope( envelope );
+			frequencies[k]->set_envelope_decay( filtering::FREQUENCY_MAX_ENVELOPE_DECAY );
+			envelopes[k]->note_on();
+			chains[k] = new voicing::Chain( client, over_drives[k], frequencies[k], envelopes[k], gains[k] );
+			buffers[k] = new jack::sample_t[ client->get_buffer_size() ];
+		}
+	}
+	~Chains() {
+		for ( size_t k = 0; k < lanes; ++k ) {
+			delete chains[k];
+			delete gains[k];
+			delete envelopes[k];
+			delete frequencies[k];
+			delete over_drives[k];
+			delete [] buffers[k];
+		}
+	}
+	size_t get_voices() const { return lanes; }
+	filtering::OverDrive* get_over_drive( const size_t& k ) const { return over_drives[k]; }
+	filtering::Frequency* get_frequency( const size_t& k ) const { return frequencies[k]; }
+	// What the last run() left in a lane.
+	const jack::sample_t* get_output( const size_t& k ) const { return buffers[k]; }
+	void run( jack::sample_t* samples ) {
+		voicing::Block blocks[ voicing::BANK_LANES ];
+		voicing::Block* pointers[ voicing::BANK_LANES ];
+		envelope::Plan plans[ voicing::BANK_LANES ];
+		size_t k;
+		for ( k = 0; k < lanes; ++k ) {
+			memcpy( buffers[k], samples, client->get_data_size() );
+			if ( !frequencies[k]->is_sweeping() ) {
+				frequencies[k]->trigger();
+			}
+			chains[k]->set_silent( false );
+			chains[k]->begin( plans[k], blocks[k], buffers[k] );
+			pointers[k] = &blocks[k];
+		}
+		voicing::bank( chains, pointers, plans, buffers, lanes, client->get_buffer_size() );
+		for ( k = 0; k < lanes; ++k ) {
+			chains[k]->end( blocks[k] );
+		}
+	}
+};
+
+typedef std::vector<Stage*> Stages;
+
+static std::string describe( const char* key, const util::floating_t& value ) {
+	std::ostringstream o;
+	o << key << "=" << value;
+	return o.str();
+}
+
+static void create( jack::Client* client, Stages& stages ) {
+	static const char* FILTER_NAMES[] = { "low_pass", "high_pass", "band_pass_1", "band_pass_2", "notch" };
+	static const char* QUALITY_NAMES[] = { "1x", "2x", "4x" };
+	static const char* TUNER_QUALITY_NAMES[] = { "linear", "hermite", "sinc" };
+	static const char* STRETCH_NAMES[] = { "auto", "speech", "type_1", "type_2" };
+	static const util::floating_t DRIVES[] = { 1, 5, 10 };
+	static const util::floating_t TRANSPOSES[] = { -12, 7, 12 };
+	static const util::floating_t STRETCHES[] = { 0.5, 1.5 };
+	static const util::floating_t DECAYS[] = { 0.05, 0.5 };
+	static const util::floating_t ENVELOPES[] = { 0, 2 };
+	size_t i;
+	stages.push_back( new Copy() );
+	stages.push_back( new Gain( client, 0.5, describe( "volume", 0.5 ) ) );
+	for ( i = 0; i < sizeof( DRIVES ) / sizeof( DRIVES[0] ); ++i ) {
+		for ( size_t j = filtering::OVER_DRIVE_QUALITY_1X; j <= filtering::OVER_DRIVE_QUALITY_LAST_TYPE; ++j ) {
+			stages.push_back( new OverDrive( client, DRIVES[i], (filtering::OverDriveQuality)j,
+					describe( "drive", DRIVES[i] ) + " quality=" + QUALITY_NAMES[j] ) );
+		}
+	}
+	for ( i = filtering::FREQUENCY_FILTER_TYPE_LOW_PASS; i <= filtering::FREQUENCY_FILTER_LAST_TYPE; ++i ) {
+		stages.push_back( new Frequency( client, (filtering::FrequencyFilterType)i, 1000, 0.7,
+				std::string( "type=" ) + FILTER_NAMES[i] + " " + describe( "frequency", 1000 ) ) );
+	}
+	stages.push_back( new Wave( client ) );
+	for ( i = 0; i < sizeof( TRANSPOSES ) / sizeof( TRANSPOSES[0] ); ++i ) {
+		for ( size_t j = filtering::TUNER_QUALITY_LINEAR; j <= filtering::TUNER_QUALITY_LAST_TYPE; ++j ) {
+			stages.push_back( new Tuner( client, TRANSPOSES[i], (filtering::TunerQuality)j,
+					describe( "transpose", TRANSPOSES[i] ) + " quality=" + TUNER_QUALITY_NAMES[j] ) );
+		}
+	}
+	for ( i = filtering::TIME_STRETCH_TYPE_AUTO; i <= filtering::TIME_STRETCH_LAST_TYPE; ++i ) {
+		for ( size_t j = 0; j < sizeof( STRETCHES ) / sizeof( STRETCHES[0] ); ++j ) {
+			stages.push_back( new TimeStretch( client, (filtering::TimeStretchType)i, STRETCHES[j],
+					std::string( "type=" ) + STRETCH_NAMES[i] + " " + describe( "stretch", STRETCHES[j] ) ) );
+		}
+	}
+	for ( i = 0; i < sizeof( DECAYS ) / sizeof( DECAYS[0] ); ++i ) {
+		stages.push_back( new Envelope( client, DECAYS[i], describe( "decay", DECAYS[i] ) ) );
+	}
+	for ( i = 0; i < sizeof( ENVELOPES ) / sizeof( ENVELOPES[0] ); ++i ) {
+		std::string parameters = describe( "envelope", ENVELOPES[i] );
+		stages.push_back( new Chains( client, 1, ENVELOPES[i], describe( "voices", 1 ) + " " + parameters ) );
+		stages.push_back( new Chains( client, voicing::BANK_LANES, ENVELOPES[i],
+				describe( "voices", voicing::BANK_LANES ) + " " + parameters ) );
+	}
+}
+
+static void measure( Stage* stage, jack::Client* client, const size_t& samples,
+		const jack::sample_t* input, jack::sample_t* block ) {
+	jack_nframes_t buffer_size = client->get_buffer_size();
+	size_t blocks = samples / buffer_size + 1;
+	size_t warm = blocks / 8 + 1;
+	size_t i;
+	for ( i = 0; i < warm; ++i ) {
+		memcpy( block, input, client->get_data_size() );
+		stage->run( block );
+	}
+	double start = now();
+	unsigned long long first = cycles();
+	for ( i = 0; i < blocks; ++i ) {
+		memcpy( block, input + ( i % 16 ) * buffer_size, client->get_data_size() );
+		stage->run( block );
+	}
+	unsigned long long last = cycles();
+	double elapsed = now() - start;
+	double count = (double)blocks * buffer_size * stage->get_voices();
+	std::cout << stage->get_name() << ","
+			<< stage->get_parameters() << ","
+			<< client->get_sample_rate() << ","
+			<< buffer_size << ","
+			<< elapsed * 1e9 / count << ","
+			<< ( last - first ) / count << std::endl;
+}
+
+// Noise through the longest decay and a resonant low pass, then silence
+// while the filter rings out, timed slice by slice. The mode tells whether
+// denormals are flushed (ftz) and whether the tails are cut (tail); with
+// either the cost per sample should stay flat along the whole decay.
+static void measure_decay( jack::Client* client, const size_t& mode, const size_t& samples,
+		const jack::sample_t* input, jack::sample_t* block ) {
+	jack_nframes_t buffer_size = client->get_buffer_size();
+	size_t per_slice = client->time_to_frames( DECAY_LENGTH ) / buffer_size / DECAY_SLICES;
+	size_t rounds = samples / ( per_slice * DECAY_SLICES * buffer_size ) + 1;
+	util::floating_t threshold = mode & 2 ? util::DEF_TAIL_THRESHOLD : 0;
+	double elapsed[ DECAY_SLICES ];
+	unsigned long long spent[ DECAY_SLICES ];
+	size_t i;
+	for ( i = 0; i < DECAY_SLICES; ++i ) {
+		elapsed[i] = 0;
+		spent[i] = 0;
+	}
+	util::set_denormals_zero( mode & 1 );
+	for ( size_t r = 0; r < rounds; ++r ) {
+		envelope::Machine machine( client );
+		filtering::Frequency frequency( client );
+		machine.set_decay_type( envelope::DECAY_TYPE_TRIGGER );
+		machine.set_decay_time( DECAY_TIME );
+		machine.set_tail_threshold( threshold );
+		frequency.set_active( true );
+		frequency.set_frequency( filtering::FREQUENCY_MIN_FREQUENCY );
+		frequency.set_resonance( filtering::FREQUENCY_MAX_RESONANCE );
+		frequency.set_tail_threshold( threshold );
+		machine.note_on();
+		for ( i = 0; i < DECAY_SLICES; ++i ) {
+			double start = now();
+			unsigned long long first = cycles();
+			for ( size_t j = 0; j < per_slice; ++j ) {
+				memcpy( block, input + ( j % 16 ) * buffer_size, client->get_data_size() );
+				machine.set_silent( false );
+				machine.filter( block );
+				frequency.set_silent( machine.is_silent() );
+				frequency.filter( block );
+			}
+			spent[i] += cycles() - first;
+			elapsed[i] += now() - start;
+		}
+	}
+	util::set_denormals_zero();
+	double count = (double)rounds * per_slice * buffer_size;
+	for ( i = 0; i < DECAY_SLICES; ++i ) {
+		std::cout << "decay,"
+				<< "mode=" << DECAY_MODES[ mode ] << " " << describe( "time", DECAY_LENGTH * i / DECAY_SLICES ) << ","
+				<< client->get_sample_rate() << ","
+				<< buffer_size << ","
+				<< elapsed[i] * 1e9 / count << ","
+				<< spent[i] / count << std::endl;
+	}
+}
+
+// A time stretch of the given kernels, with them within reach.
+template < class T >
+class Probe : public T {
+public:
+	double correlate( const float* mixing, const float* compare ) const {
+		return T::calcCrossCorrMono( mixing, compare );
+	}
+	void overlap( float* output, const float* input, const float* mid ) {
+		memcpy( this->pMidBuffer, mid, this->overlapLength * sizeof( float ) );
+		T::overlapMono( output, input );
+	}
+	const int& get_overlap_length() const { return this->overlapLength; }
+};
+
+static void scaled_noise( float* samples, const size_t& count, const float& scale ) {
+	for ( size_t i = 0; i < count; ++i ) {
+		samples[i] = scale * ( rand() / (float)RAND_MAX - 0.5f );
+	}
+}
+
+// The mono kernels of a time stretch against the plain ones, on noise of
+// every scale at unaligned positions, for the overlap lengths of every
+// sample rate. Correlations may differ within float precision of the
+// compared samples; overlaps must be the same to the bit.
+template < class T >
+static bool check_stretch( const char* name ) {
+	Probe< soundtouch::TDStretch > plain;
+	Probe< T > simd;
+	size_t length = SAMPLE_RATES[ SAMPLE_RATE_COUNT - 1 ] * CHECK_MAX_OVERLAP_MS / 1000 + CHECK_MAX_OFFSET + 1;
+	std::vector< float > mixing( length ), compare( length ), mid( length ), expected( length ), output( length );
+	size_t cases = 0;
+	size_t differ = 0;
+	double worst = 0;
+	srand( 1 );
+	for ( size_t r = 0; r < SAMPLE_RATE_COUNT; ++r ) {
+		for ( int ms = 1; ms <= CHECK_MAX_OVERLAP_MS; ++ms ) {
+			plain.setChannels( 1 );
+			simd.setChannels( 1 );
+			plain.setParameters( SAMPLE_RATES[r], 0, 0, ms );
+			simd.setParameters( SAMPLE_RATES[r], 0, 0, ms );
+			int overlap = plain.get_overlap_length();
+			for ( size_t i = 0; i < CHECK_ROUNDS; ++i ) {
+				int offset = rand() % ( CHECK_MAX_OFFSET + 1 );
+				// Silence for the first round, to take the zero norm path.
+				scaled_noise( &mixing[0], length, i ? pow( 10., (int)( i % 9 ) - 4 ) : 0 );
+				scaled_noise( &compare[0], overlap, pow( 10., (int)( rand() % 9 ) - 4 ) );
+				scaled_noise( &mid[0], overlap, 1 );
+				double bound = 0;
+				for ( int k = 1; k < overlap; ++k ) {
+					bound += (double)compare[k] * compare[k];
+				}
+				double error = fabs( simd.correlate( &mixing[ offset ], &compare[0] )
+						- plain.correlate( &mixing[ offset ], &compare[0] ) ) / ( sqrt( bound ) + 1e-30 );
+				worst = std::max( worst, error );
+				plain.overlap( &expected[0], &mixing[ offset ], &mid[0] );
+				simd.overlap( &output[ offset ], &mixing[ offset ], &mid[0] );
+				if ( memcmp( &expected[0], &output[ offset ], overlap * sizeof( float ) ) ) {
+					differ++;
+				}
+				cases++;
+			}
+		}
+	}
+	bool passed = worst <= CHECK_TOLERANCE && differ == 0;
+	std::cout << "time_stretch " << name << ": " << cases << " cases, correlation off by "
+			<< worst << " at most, " << differ << " overlaps differ: " << ( passed ? "ok" : "FAILED" ) << std::endl;
+	return passed;
+}
+
+// Loudest sample of the chain stage at full drive and resonance over a
+// second of noise, the envelope retriggered whenever its sweep is over.
+static util::floating_t sweep_peak( jack::Client* client, const filtering::FrequencyFilterType& type,
+		const util::floating_t& frequency, const util::floating_t& envelope, const jack::sample_t* input ) {
+	jack::sample_t block[ offline::DEF_BUFFER_SIZE ];
+	size_t blocks = client->time_to_frames( CHECK_SWEEP_TIME ) / client->get_buffer_size();
+	Chains chains( client, 1, envelope, "", frequency );
+	chains.get_over_drive( 0 )->set_active( true );
+	chains.get_over_drive( 0 )->set_drive( CHECK_SWEEP_DRIVE );
+	chains.get_over_drive( 0 )->set_quality( filtering::OVER_DRIVE_QUALITY_2X );
+	// Every type keeps its own frequency.
+	chains.get_frequency( 0 )->set_filter_type( type );
+	chains.get_frequency( 0 )->set_frequency( frequency );
+	chains.get_frequency( 0 )->set_resonance( filtering::FREQUENCY_MAX_RESONANCE );
+	chains.get_frequency( 0 )->set_envelope_decay( CHECK_SWEEP_DECAY );
+	util::floating_t peak = 0;
+	for ( size_t b = 0; b < blocks; ++b ) {
+		memcpy( block, input, client->get_data_size() );
+		chains.run( block );
+		for ( size_t i = 0; i < client->get_buffer_size(); ++i ) {
+			peak = std::max( peak, (util::floating_t)fabs( chains.get_output( 0 )[i] ) );
+		}
+	}
+	return peak;
+}
+
+// Every filter type from high frequencies with every envelope, against the
+// same sound without one at either end of the sweep. A sweep near the
+// Nyquist frequency must not make the filter blow up, so it may only be a
+// few times louder than the louder end.
+static bool check_sweep() {
+	jack::sample_t input[ offline::DEF_BUFFER_SIZE ];
+	size_t cases = 0;
+	size_t failed = 0;
+	util::floating_t worst = 0;
+	noise( input, offline::DEF_BUFFER_SIZE );
+	for ( size_t r = 0; r < SAMPLE_RATE_COUNT; ++r ) {
+		offline::Client client( "benchmark", SAMPLE_RATES[r], offline::DEF_BUFFER_SIZE );
+		for ( size_t t = filtering::FREQUENCY_FILTER_TYPE_LOW_PASS; t <= filtering::FREQUENCY_FILTER_LAST_TYPE; ++t ) {
+			for ( size_t f = 0; f < CHECK_SWEEP_FREQUENCY_COUNT; ++f ) {
+				util::floating_t still = sweep_peak( &client, (filtering::FrequencyFilterType)t,
+						CHECK_SWEEP_FREQUENCIES[f], 0, input );
+				for ( util::floating_t e = filtering::FREQUENCY_MIN_ENVELOPE; e <= filtering::FREQUENCY_MAX_ENVELOPE; ++e ) {
+					util::floating_t start = sweep_peak( &client, (filtering::FrequencyFilterType)t,
+							CHECK_SWEEP_FREQUENCIES[f] * pow( 2., e ), 0, input );
+					util::floating_t gain = sweep_peak( &client, (filtering::FrequencyFilterType)t,
+							CHECK_SWEEP_FREQUENCIES[f], e, input ) / std::max( still, start );
+					// Not a number fails too.
+					if ( !( gain <= CHECK_SWEEP_MAX_GAIN ) ) {
+						failed++;
+					}
+					worst = std::max( worst, gain );
+					cases++;
+				}
+			}
+		}
+	}
+	bool passed = failed == 0;
+	std::cout << "frequency sweep: " << cases << " cases, " << worst << " times louder at most, "
+			<< failed << " beyond " << CHECK_SWEEP_MAX_GAIN << ": " << ( passed ? "ok" : "FAILED" ) << std::endl;
+	return passed;
+}
+
+// The kernels of SoundTouch the processor runs, against the plain ones,
+// and the filter sweeps near the Nyquist frequency.
+static bool check() {
+	bool passed = true;
+	util::set_denormals_zero();
+	passed = check_sweep() && passed;
+#if defined( ALLOW_SSE ) && defined( __SSE2__ )
+	passed = check_stretch< soundtouch::TDStretchSSE >( "sse2" ) && passed;
+#endif
+#if defined( ALLOW_AVX2 )
+	if ( simd::Cpu::get_instance().get_best() >= simd::LEVEL_AVX2 ) {
+		passed = check_stretch< soundtouch::TDStretchAVX2 >( "avx2" ) && passed;
+	}
+#endif
+	return passed;
+}
+
+} // namespace benchmark
+
+int main( int argc, char* argv[] ) {
+	int c;
+	size_t samples = benchmark::DEF_SAMPLES;
+	std::string only;
+	bool checking = false;
+	size_t level = simd::Cpu::get_instance().get_best();
+	while ( ( c = getopt( argc, argv, "ci:n:s:" ) ) != -1 ) {
+		switch ( c ) {
+		case 'c':
+			checking = true;
+			break;
+		case 'i':
+			level = simd::Cpu::find( optarg );
+			break;
+		case 'n':
+			samples = atol( optarg );
+			break;
+		case 's':
+			only = optarg;
+			break;
+		default:
+			std::cout << "benchmark [-c] [-i isa] [-n samples] [-s stage]" << std::endl;
+			return 1;
+		}
+	}
+	if ( level > simd::LEVEL_LAST_TYPE || !simd::Cpu::get_instance().select( (simd::Level)level ) ) {
+		std::cout << "benchmark [-c] [-i scalar|sse2|avx2|avx512] [-n samples] [-s stage]" << std::endl;
+		return 1;
+	}
+	if ( checking ) {
+		return benchmark::check() ? 0 : 1;
+	}
+	jack::sample_t* input = new jack::sample_t[ 16 * benchmark::MAX_BUFFER_SIZE ];
+	jack::sample_t* block = new jack::sample_t[ benchmark::MAX_BUFFER_SIZE ];
+	benchmark::noise( input, 16 * benchmark::MAX_BUFFER_SIZE );
+	// As the engine does.
+	util::set_denormals_zero();
+	std::cout << "stage,parameters,sample_rate,buffer_size,ns_per_sample,cycles_per_sample" << std::endl;
+	for ( size_t r = 0; r < benchmark::SAMPLE_RATE_COUNT; ++r ) {
+		for ( jack_nframes_t buffer_size = benchmark::MIN_BUFFER_SIZE;
+				buffer_size <= benchmark::MAX_BUFFER_SIZE; buffer_size *= 2 ) {
+			offline::Client client( "benchmark", benchmark::SAMPLE_RATES[r], buffer_size );
+			benchmark::Stages stages;
+			benchmark::create( &client, stages );
+			for ( size_t i = 0; i < stages.size(); ++i ) {
+				if ( only.empty() || only == stages[i]->get_name() ) {
+					benchmark::measure( stages[i], &client, samples, input, block );
+				}
+				delete stages[i];
+			}
+		}
+		if ( only.empty() || only == "decay" ) {
+			offline::Client client( "benchmark", benchmark::SAMPLE_RATES[r], offline::DEF_BUFFER_SIZE );
+			for ( size_t m = 0; m < benchmark::DECAY_MODE_COUNT; ++m ) {
+				benchmark::measure_decay( &client, m, samples, input, block );
+			}
+		}
+	}
+	delete [] input;
+	delete [] block;
+	return 0;
+}
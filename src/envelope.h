@@ -42,6 +42,22 @@ static const util::floating_t MAX_DECAY  = 2; // TODO: The length is important.
 static const util::floating_t DEF_DECAY  = MAX_DECAY;
 static const bool             DEF_SOFT_START = false;
 
+enum Segment {
+	SEGMENT_MUTE = 0,
+	SEGMENT_RAMP,
+	SEGMENT_FLAT
+};
+
+static const Segment          SEGMENT_LAST = SEGMENT_FLAT;
+
+// How a state shapes the next block: the first frames samples follow head
+// and the rest of the block follows tail.
+struct Plan {
+	Segment head;
+	jack_nframes_t frames;
+	Segment tail;
+};
+
 class Machine;
 
 class State {
@@ -51,7 +67,8 @@ public:
 	virtual State* note_on( Machine* machine ) { return this; }
 	virtual State* note_off( Machine* machine ) { return this; }
 	virtual State* silence( Machine* machine ) { return this; }
-	virtual State* filter( Machine* machine, jack::sample_t* samples ) { return this; }
+	virtual void plan( const Machine* machine, Plan& plan ) const;
+	virtual State* elapse( Machine* machine ) { return this; }
 };
 
 class Machine : public filtering::Filter {
@@ -68,11 +85,12 @@ private:
 	util::floating_t slope;
 	util::floating_t curve;
 	util::floating_t amplitude;
+	util::floating_t tail_threshold;
 public:
 	Machine( jack::Client* client ) :
 		filtering::Filter( client ), off( false ), start_soft( DEF_SOFT_START ),
 		decay_type( DECAY_DEF_TYPE ), offset( 0 ),
-		slope( 0 ), curve( 0 ), amplitude( 0 ) {
+		slope( 0 ), curve( 0 ), amplitude( 0 ), tail_threshold( util::DEF_TAIL_THRESHOLD ) {
 		set_attack_time( DEF_ATTACK );
 		set_decay_time( DEF_DECAY );
 		start();
@@ -106,13 +124,69 @@ public:
 	void note_on() { state = state->note_on( this ); }
 	void note_off() { state = state->note_off( this ); }
 	void silence() { state = state->silence( this ); }
-	void filter( jack::sample_t* samples ) { state = state->filter( this, samples ); }
+	void plan( Plan& plan ) const { state->plan( this, plan ); }
+	void elapse() { state = state->elapse( this ); }
+	void shape( jack::sample_t* samples, const Segment& segment, const jack_nframes_t& frames ) {
+		switch ( segment ) {
+		case SEGMENT_MUTE:
+			memset( samples, 0, frames * sizeof( jack::sample_t ) );
+			break;
+		case SEGMENT_RAMP:
+			for ( jack_nframes_t i = 0; i < frames; ++i ) {
+				samples[i] *= amplitude;
+				amplitude += slope;
+				slope += curve;
+			}
+			break;
+		case SEGMENT_FLAT:
+			break;
+		}
+	}
+	void filter( jack::sample_t* samples ) {
+		bool finished = is_finished();
+		Plan plan;
+		state->plan( this, plan );
+		if ( is_silent() ) {
+			if ( SEGMENT_RAMP == plan.head ) {
+				advance( plan.frames );
+			}
+		} else {
+			shape( samples, plan.head, plan.frames );
+			shape( samples + plan.frames, plan.tail, get_client()->get_block_size() - plan.frames );
+		}
+		state = state->elapse( this );
+		if ( finished ) {
+			set_silent( true );
+		}
+	}
 	bool is_finished() const;
 	const util::floating_t& get_slope() const { return slope; }
 	void set_slope( const util::floating_t& slope ) { this->slope = slope; }
 	const util::floating_t& get_curve() const { return curve; }
 	const util::floating_t& get_amplitude() const { return amplitude; }
 	void set_amplitude( const util::floating_t& amplitude ) { this->amplitude = amplitude; }
+	// A decay ends early once its amplitude falls below the threshold.
+	// Zero never cuts.
+	void set_tail_threshold( const util::floating_t& tail_threshold ) { this->tail_threshold = tail_threshold; }
+	const util::floating_t& get_tail_threshold() const { return tail_threshold; }
+	bool is_tail() const { return tail_threshold > 0 && amplitude < tail_threshold; }
+	util::floating_t get_level() const {
+		// Amplitude the next sample is shaped with.
+		Plan plan;
+		state->plan( this, plan );
+		return SEGMENT_RAMP == plan.head ? amplitude : ( SEGMENT_FLAT == plan.head ? 1 : 0 );
+	}
+	jack_nframes_t remaining( const jack_nframes_t& samples ) const {
+		// Frames of the next block that still belong to a segment of samples length.
+		return std::min( get_client()->get_block_size(), samples > offset ? samples - offset : 0 );
+	}
+	void advance( const jack_nframes_t& frames ) {
+		// Closed form of frames steps of the amplitude and slope recurrences,
+		// used when there are no samples to shape.
+		util::floating_t n = frames;
+		amplitude += n * slope + curve * ( n * ( n - 1 ) / 2. );
+		slope += n * curve;
+	}
 	void calculate( const util::floating_t& duration_samples ) {
 	    util::floating_t rdur = 1.0 / ( duration_samples * 2. );
 	    util::floating_t rdur2 = rdur * rdur;
@@ -140,9 +214,9 @@ public:
 		return &instance;
 	}
 	State* note_on( Machine* machine );
-	State* filter( Machine* machine, jack::sample_t* samples ) {
-		memset( samples, 0, machine->get_client()->get_data_size() );
-		return this;
+	void plan( const Machine* machine, Plan& plan ) const {
+		plan.head = plan.tail = SEGMENT_MUTE;
+		plan.frames = machine->get_client()->get_block_size();
 	}
 };
 
@@ -161,21 +235,15 @@ public:
 	virtual State* silence( Machine* machine ) {
 		return StateOff::get_instance();
 	}
-	State* filter( Machine* machine, jack::sample_t* samples ) {
+	void plan( const Machine* machine, Plan& plan ) const {
+		plan.head = SEGMENT_RAMP;
+		plan.frames = machine->remaining( machine->get_decay_samples() );
+		plan.tail = SEGMENT_MUTE;
+	}
+	State* elapse( Machine* machine ) {
 		State* state = this;
-		jack_nframes_t offset = machine->get_offset();
-		jack_nframes_t buffer_size = machine->get_client()->get_buffer_size();
-		jack_nframes_t decay_samples = machine->get_decay_samples();
-		jack_nframes_t i;
-		for ( i = 0; i < buffer_size && offset < decay_samples; ++i, ++offset ) {
-			samples[i] *= machine->get_amplitude();
-			machine->set_amplitude( machine->get_amplitude() + machine->get_slope() );
-			machine->set_slope( machine->get_slope() + machine->get_curve() );
-		}
-		if ( offset >= decay_samples ) {
-			if ( i < buffer_size ) {
-				memset( samples + i, 0, ( buffer_size - i ) * sizeof( jack::sample_t ) );
-			}
+		jack_nframes_t offset = machine->get_offset() + machine->remaining( machine->get_decay_samples() );
+		if ( offset >= machine->get_decay_samples() || machine->is_tail() ) {
 			machine->set_offset( 0 );
 			state = StateOff::get_instance();
 		} else {
@@ -225,17 +293,15 @@ public:
 	virtual State* silence( Machine* machine ) {
 		return StateOff::get_instance();
 	}
-	State* filter( Machine* machine, jack::sample_t* samples ) {
+	void plan( const Machine* machine, Plan& plan ) const {
+		plan.head = SEGMENT_RAMP;
+		plan.frames = machine->remaining( machine->get_attack_samples() );
+		plan.tail = SEGMENT_FLAT;
+	}
+	State* elapse( Machine* machine ) {
 		State* state = this;
-		jack_nframes_t offset = machine->get_offset();
-		jack_nframes_t buffer_size = machine->get_client()->get_buffer_size();
-		jack_nframes_t attack_samples = machine->get_attack_samples();
-		for ( jack_nframes_t i = 0; i < buffer_size && offset < attack_samples; ++i, ++offset ) {
-			samples[i] *= machine->get_amplitude();
-			machine->set_amplitude( machine->get_amplitude() + machine->get_slope() );
-			machine->set_slope( machine->get_slope() + machine->get_curve() );
-		}
-		if ( offset >= attack_samples ) {
+		jack_nframes_t offset = machine->get_offset() + machine->remaining( machine->get_attack_samples() );
+		if ( offset >= machine->get_attack_samples() ) {
 			machine->set_offset( 0 );
 			if ( DECAY_TYPE_TRIGGER == machine->get_decay_type() ) {
 				machine->calculate_decay();
@@ -266,6 +332,11 @@ inline State* StateOff::note_on( Machine* machine ) {
 	return state;
 }
 
+inline void State::plan( const Machine* machine, Plan& plan ) const {
+	plan.head = plan.tail = SEGMENT_FLAT;
+	plan.frames = machine->get_client()->get_block_size();
+}
+
 inline void Machine::start() { state = StateOff::get_instance(); }
 
 bool Machine::is_finished() const { return state == StateOff::get_instance(); }
@@ -20,41 +20,300 @@
 #define FILTERING_H_
 
 #include <cassert>
-#include <samplerate.h>
+#include <algorithm>
 #include <sndfile.hh>
 #include <FIFOSampleBuffer.h>
 #include <TDStretch.h>
 #include "jack.h"
 #include "util.h"
+#include "simd.h"
 
 namespace filtering {
 
+// The silent flag travels along a chain of filters: the owner flags the
+// incoming block before calling filter() and the filter leaves it telling
+// whether the outgoing block is all zeros, so the next stage can skip it.
 class Filter {
 	jack::Client* client;
 	bool active;
+	bool silent;
 protected:
 	jack::Client* get_client() const { return client; }
 public:
 	Filter( jack::Client* client ) :
-		client( client ), active( false ) {}
+		client( client ), active( false ), silent( false ) {}
 	virtual ~Filter() {}
 	void set_active( const bool& active ) { this->active = active; }
 	const bool& is_active() const { return active; }
+	void set_silent( const bool& silent ) { this->silent = silent; }
+	const bool& is_silent() const { return silent; }
 	virtual void filter( jack::sample_t* samples ) {}
 };
 
+// Taps of each branch of the polyphase half-band filters, a 31 tap Kaiser
+// windowed sinc: flat to 0.35 and 70 dB down from 0.65 of the Nyquist
+// frequency of the higher rate.
+static const size_t HALF_BAND_TAPS = 16;
+static const double HALF_BAND_BETA = 7;
+static const size_t HALF_BAND_MAX_FRAMES = 128;
+
+static inline double bessel( const double& x ) {
+	double sum = 1;
+	double term = 1;
+	for ( size_t k = 1; k < 32; ++k ) {
+		term *= ( x / ( 2. * k ) ) * ( x / ( 2. * k ) );
+		sum += term;
+	}
+	return sum;
+}
+
+// Kaiser window at r, from -1 to 1 across the window.
+static inline double kaiser( const double& r, const double& beta ) {
+	return bessel( beta * sqrt( std::max( 1. - r * r, 0. ) ) ) / bessel( beta );
+}
+
+// The odd taps of the half-band filter; the center tap is one half and the
+// even ones are zero, so each branch is a short FIR or a plain delay.
+typedef void (*ConvolveKernel)( const util::floating_t* taps, const jack::sample_t* x,
+		jack::sample_t* out, const size_t& frames );
+
+class HalfBandTable {
+protected:
+	HalfBandTable() {
+		double taps[ HALF_BAND_TAPS ];
+		double total = 0;
+		for ( size_t i = 0; i < HALF_BAND_TAPS; ++i ) {
+			// Offset from the center tap at the higher rate, always odd.
+			double n = 2. * i - ( HALF_BAND_TAPS - 1 );
+			double window = kaiser( n / ( HALF_BAND_TAPS - 1. ), HALF_BAND_BETA );
+			taps[i] = sin( util::PI * n / 2. ) / ( util::PI * n ) * window;
+			total += taps[i];
+		}
+		for ( size_t i = 0; i < HALF_BAND_TAPS; ++i ) {
+			// Unity gain at dc on both branches.
+			interpolation[i] = taps[i] / total;
+			decimation[i] = taps[i] / ( 2. * total );
+		}
+	}
+public:
+	util::floating_t interpolation[ HALF_BAND_TAPS ];
+	util::floating_t decimation[ HALF_BAND_TAPS ];
+	static const HalfBandTable& get_instance() {
+		static HalfBandTable instance;
+		return instance;
+	}
+	// out[m] is the sum of taps[i] * x[m + i]. The taps are symmetric, so
+	// every pair of inputs shares a product, and the vector kernels do four
+	// or eight outputs at once without horizontal sums.
+	static void convolve( const util::floating_t* taps, const jack::sample_t* x,
+			jack::sample_t* out, const size_t& frames ) {
+		static const simd::Kernel< ConvolveKernel > kernel( convolve_scalar, SIMD_SSE2_VARIANT( convolve_sse2 ),
+				SIMD_X86_VARIANT( convolve_avx2 ) );
+		kernel.get()( taps, x, out, frames );
+	}
+private:
+	static void convolve_frames( const util::floating_t* taps, const jack::sample_t* x,
+			jack::sample_t* out, size_t m, const size_t& frames ) {
+		for ( ; m < frames; ++m ) {
+			util::floating_t sum = 0;
+			for ( size_t i = 0; i < HALF_BAND_TAPS / 2; ++i ) {
+				sum += taps[i] * ( x[ m + i ] + x[ m + HALF_BAND_TAPS - 1 - i ] );
+			}
+			out[m] = sum;
+		}
+	}
+	static void convolve_scalar( const util::floating_t* taps, const jack::sample_t* x,
+			jack::sample_t* out, const size_t& frames ) {
+		convolve_frames( taps, x, out, 0, frames );
+	}
+#if defined( __SSE2__ )
+	static void convolve_sse2( const util::floating_t* taps, const jack::sample_t* x,
+			jack::sample_t* out, const size_t& frames ) {
+		__m128 t[ HALF_BAND_TAPS / 2 ];
+		size_t m = 0;
+		for ( size_t i = 0; i < HALF_BAND_TAPS / 2; ++i ) {
+			t[i] = _mm_set1_ps( taps[i] );
+		}
+		for ( ; m + 4 <= frames; m += 4 ) {
+			__m128 sum = _mm_setzero_ps();
+			for ( size_t i = 0; i < HALF_BAND_TAPS / 2; ++i ) {
+				__m128 pair = _mm_add_ps( _mm_loadu_ps( x + m + i ), _mm_loadu_ps( x + m + HALF_BAND_TAPS - 1 - i ) );
+				sum = _mm_add_ps( sum, _mm_mul_ps( t[i], pair ) );
+			}
+			_mm_storeu_ps( out + m, sum );
+		}
+		convolve_frames( taps, x, out, m, frames );
+	}
+#endif
+#if defined( SIMD_X86 )
+	static SIMD_AVX2_TARGET void convolve_avx2( const util::floating_t* taps, const jack::sample_t* x,
+			jack::sample_t* out, const size_t& frames ) {
+		__m256 t[ HALF_BAND_TAPS / 2 ];
+		size_t m = 0;
+		for ( size_t i = 0; i < HALF_BAND_TAPS / 2; ++i ) {
+			t[i] = _mm256_set1_ps( taps[i] );
+		}
+		for ( ; m + 8 <= frames; m += 8 ) {
+			__m256 sum = _mm256_setzero_ps();
+			for ( size_t i = 0; i < HALF_BAND_TAPS / 2; ++i ) {
+				__m256 pair = _mm256_add_ps( _mm256_loadu_ps( x + m + i ),
+						_mm256_loadu_ps( x + m + HALF_BAND_TAPS - 1 - i ) );
+				sum = _mm256_fmadd_ps( t[i], pair, sum );
+			}
+			_mm256_storeu_ps( out + m, sum );
+		}
+		convolve_frames( taps, x, out, m, frames );
+	}
+#endif
+};
+
+// One octave of oversampling: doubles the rate of a block and halves it
+// back, keeping the history of both filters between blocks.
+class HalfBand {
+	jack::sample_t up[ HALF_BAND_TAPS - 1 + HALF_BAND_MAX_FRAMES ];
+	jack::sample_t odd[ HALF_BAND_TAPS - 1 + HALF_BAND_MAX_FRAMES ];
+	jack::sample_t even[ HALF_BAND_TAPS / 2 + HALF_BAND_MAX_FRAMES ];
+public:
+	HalfBand() {
+		clear();
+	}
+	~HalfBand() {}
+	void clear() {
+		std::fill( up, up + HALF_BAND_TAPS - 1, 0 );
+		std::fill( odd, odd + HALF_BAND_TAPS - 1, 0 );
+		std::fill( even, even + HALF_BAND_TAPS / 2, 0 );
+	}
+	// Twice the frames into out.
+	void upsample( const jack::sample_t* in, jack::sample_t* out, const size_t& frames ) {
+		jack::sample_t between[ HALF_BAND_MAX_FRAMES ];
+		std::copy( in, in + frames, up + HALF_BAND_TAPS - 1 );
+		HalfBandTable::convolve( HalfBandTable::get_instance().interpolation, up, between, frames );
+		for ( size_t m = 0; m < frames; ++m ) {
+			out[ 2 * m ] = between[m];
+			out[ 2 * m + 1 ] = up[ m + HALF_BAND_TAPS / 2 ];
+		}
+		std::copy( up + frames, up + frames + HALF_BAND_TAPS - 1, up );
+	}
+	// Half the frames into out.
+	void downsample( const jack::sample_t* in, jack::sample_t* out, const size_t& frames ) {
+		for ( size_t m = 0; m < frames; ++m ) {
+			odd[ HALF_BAND_TAPS - 1 + m ] = in[ 2 * m ];
+			even[ HALF_BAND_TAPS / 2 + m ] = in[ 2 * m + 1 ];
+		}
+		HalfBandTable::convolve( HalfBandTable::get_instance().decimation, odd, out, frames );
+		for ( size_t m = 0; m < frames; ++m ) {
+			out[m] += 0.5f * even[m];
+		}
+		std::copy( odd + frames, odd + frames + HALF_BAND_TAPS - 1, odd );
+		std::copy( even + frames, even + frames + HALF_BAND_TAPS / 2, even );
+	}
+};
+
 static const util::floating_t OVER_DRIVE_MIN_DRIVE  = 1;
 static const util::floating_t OVER_DRIVE_MAX_DRIVE  = 10;
 static const util::floating_t OVER_DRIVE_DEF_DRIVE = OVER_DRIVE_MIN_DRIVE;
 static const util::floating_t OVER_DRIVE_DEF_DC = -0.001;
 static const util::floating_t OVER_DRIVE_DEF_ACTIVE = false;
 
+// Rate the clipper runs at, so that the harmonics it adds above the Nyquist
+// frequency are filtered out instead of folding back.
+enum OverDriveQuality {
+	OVER_DRIVE_QUALITY_1X = 0,
+	OVER_DRIVE_QUALITY_2X,
+	OVER_DRIVE_QUALITY_4X
+};
+
+static const OverDriveQuality OVER_DRIVE_QUALITY_DEF_TYPE = OVER_DRIVE_QUALITY_1X;
+static const OverDriveQuality OVER_DRIVE_QUALITY_LAST_TYPE = OVER_DRIVE_QUALITY_4X;
+
+// Frames oversampled at once, at the base rate.
+static const jack_nframes_t OVER_DRIVE_CHUNK_FRAMES = HALF_BAND_MAX_FRAMES / 2;
+
+typedef void (*ShapeKernel)( jack::sample_t* samples, const util::floating_t& drive,
+		const util::floating_t& dc, const size_t& frames );
+
 class OverDrive : public Filter {
 	util::floating_t drive;
 	util::floating_t dc;
+	OverDriveQuality quality;
+	HalfBand octaves[ OVER_DRIVE_QUALITY_LAST_TYPE ];
+protected:
+	static void shape_frames( jack::sample_t* samples, const util::floating_t& drive,
+			const util::floating_t& dc, size_t i, const size_t& frames ) {
+		for ( ; i < frames; ++i ) {
+			samples[i] = clip( samples[i] * drive + dc );
+		}
+	}
+	static void shape_scalar( jack::sample_t* samples, const util::floating_t& drive,
+			const util::floating_t& dc, const size_t& frames ) {
+		shape_frames( samples, drive, dc, 0, frames );
+	}
+#if defined( __SSE2__ )
+	static void shape_sse2( jack::sample_t* samples, const util::floating_t& drive,
+			const util::floating_t& dc, const size_t& frames ) {
+		const __m128 gain = _mm_set1_ps( drive );
+		const __m128 offset = _mm_set1_ps( dc );
+		const __m128 low = _mm_set1_ps( -1 );
+		const __m128 high = _mm_set1_ps( 1 );
+		const __m128 third = _mm_set1_ps( 3 );
+		size_t i = 0;
+		for ( ; i + 4 <= frames; i += 4 ) {
+			__m128 x = _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( samples + i ), gain ), offset );
+			x = _mm_min_ps( _mm_max_ps( x, low ), high );
+			x = _mm_sub_ps( x, _mm_div_ps( _mm_mul_ps( _mm_mul_ps( x, x ), x ), third ) );
+			_mm_storeu_ps( samples + i, x );
+		}
+		shape_frames( samples, drive, dc, i, frames );
+	}
+#endif
+#if defined( SIMD_X86 )
+	static SIMD_AVX2_TARGET void shape_avx2( jack::sample_t* samples, const util::floating_t& drive,
+			const util::floating_t& dc, const size_t& frames ) {
+		const __m256 gain = _mm256_set1_ps( drive );
+		const __m256 offset = _mm256_set1_ps( dc );
+		const __m256 low = _mm256_set1_ps( -1 );
+		const __m256 high = _mm256_set1_ps( 1 );
+		const __m256 third = _mm256_set1_ps( 3 );
+		size_t i = 0;
+		for ( ; i + 8 <= frames; i += 8 ) {
+			__m256 x = _mm256_fmadd_ps( _mm256_loadu_ps( samples + i ), gain, offset );
+			x = _mm256_min_ps( _mm256_max_ps( x, low ), high );
+			x = _mm256_sub_ps( x, _mm256_div_ps( _mm256_mul_ps( _mm256_mul_ps( x, x ), x ), third ) );
+			_mm256_storeu_ps( samples + i, x );
+		}
+		shape_frames( samples, drive, dc, i, frames );
+	}
+	static SIMD_AVX512_TARGET void shape_avx512( jack::sample_t* samples, const util::floating_t& drive,
+			const util::floating_t& dc, const size_t& frames ) {
+		const __m512 gain = _mm512_set1_ps( drive );
+		const __m512 offset = _mm512_set1_ps( dc );
+		const __m512 low = _mm512_set1_ps( -1 );
+		const __m512 high = _mm512_set1_ps( 1 );
+		const __m512 third = _mm512_set1_ps( 3 );
+		// Every lane through the masked forms, which unlike the plain ones
+		// carry no undefined pass-through for gcc to warn about.
+		const __mmask16 lanes = 0xffff;
+		size_t i = 0;
+		for ( ; i + 16 <= frames; i += 16 ) {
+			__m512 x = _mm512_fmadd_ps( _mm512_loadu_ps( samples + i ), gain, offset );
+			x = _mm512_maskz_min_ps( lanes, _mm512_maskz_max_ps( lanes, x, low ), high );
+			x = _mm512_sub_ps( x, _mm512_div_ps( _mm512_mul_ps( _mm512_mul_ps( x, x ), x ), third ) );
+			_mm512_storeu_ps( samples + i, x );
+		}
+		shape_frames( samples, drive, dc, i, frames );
+	}
+#endif
+protected:
+	// The clipper over a whole block, without branches.
+	void shape( jack::sample_t* samples, const size_t& frames ) const {
+		static const simd::Kernel< ShapeKernel > kernel( shape_scalar, SIMD_SSE2_VARIANT( shape_sse2 ),
+				SIMD_X86_VARIANT( shape_avx2 ), SIMD_X86_VARIANT( shape_avx512 ) );
+		kernel.get()( samples, get_drive(), get_dc(), frames );
+	}
 public:
 	OverDrive( jack::Client* client ) :
-		Filter( client ), drive( OVER_DRIVE_DEF_DRIVE ), dc( OVER_DRIVE_DEF_DC ) {
+		Filter( client ), drive( OVER_DRIVE_DEF_DRIVE ), dc( OVER_DRIVE_DEF_DC ),
+		quality( OVER_DRIVE_QUALITY_DEF_TYPE ) {
 		set_active( OVER_DRIVE_DEF_ACTIVE );
 	}
 	~OverDrive() {}
@@ -64,22 +323,54 @@ public:
 	const util::floating_t& get_drive() const { return drive; }
 	void set_dc( const util::floating_t& dc ) { this->dc = dc; }
 	const util::floating_t& get_dc() const { return dc; }
+	void set_quality( const OverDriveQuality& quality ) {
+		if ( quality != this->quality ) {
+			this->quality = quality;
+			for ( size_t i = 0; i < OVER_DRIVE_QUALITY_LAST_TYPE; ++i ) {
+				octaves[i].clear();
+			}
+		}
+	}
+	const OverDriveQuality& get_quality() const { return quality; }
+	bool is_oversampling() const { return OVER_DRIVE_QUALITY_1X != quality; }
+	static util::floating_t clip( util::floating_t sample ) {
+		sample = std::min( std::max( sample, (util::floating_t)-1. ), (util::floating_t)1. );
+		return sample - ( ( sample * sample * sample ) / 3. );
+	}
 	void filter( jack::sample_t* samples ) {
 		if ( is_active() ) {
-			util::floating_t sample;
-			jack_nframes_t buffer_size = get_client()->get_buffer_size();
-			for ( jack_nframes_t i = 0; i < buffer_size; ++i ) {
-				sample = samples[i];
-				sample *= get_drive();
-				sample += get_dc();
-				if ( sample <= -1. ) {
-					sample = -2. / 3.;
-				} else if ( sample >= 1. ) {
-					sample = 2. / 3.;
-				} else {
-					sample = sample - ( ( sample * sample * sample ) / 3. );
+			jack_nframes_t buffer_size = get_client()->get_block_size();
+			if ( is_oversampling() ) {
+				// The filters ring, so silence goes through them as well.
+				if ( is_silent() ) {
+					std::fill( samples, samples + buffer_size, 0 );
+					set_silent( false );
+				}
+				jack::sample_t low[ HALF_BAND_MAX_FRAMES ];
+				jack::sample_t high[ 2 * HALF_BAND_MAX_FRAMES ];
+				for ( jack_nframes_t i = 0; i < buffer_size; i += OVER_DRIVE_CHUNK_FRAMES ) {
+					size_t frames = std::min( OVER_DRIVE_CHUNK_FRAMES, buffer_size - i );
+					if ( OVER_DRIVE_QUALITY_2X == quality ) {
+						octaves[0].upsample( samples + i, low, frames );
+						shape( low, 2 * frames );
+						octaves[0].downsample( low, samples + i, frames );
+					} else {
+						octaves[0].upsample( samples + i, low, frames );
+						octaves[1].upsample( low, high, 2 * frames );
+						shape( high, 4 * frames );
+						octaves[1].downsample( high, low, 2 * frames );
+						octaves[0].downsample( low, samples + i, frames );
+					}
+				}
+			} else if ( is_silent() ) {
+				// Silence only carries the dc offset through the clipper.
+				jack::sample_t sample = clip( get_dc() );
+				if ( sample != 0 ) {
+					std::fill( samples, samples + buffer_size, sample );
+					set_silent( false );
 				}
-				samples[i] = sample;
+			} else {
+				shape( samples, buffer_size );
 			}
 		}
 	}
@@ -98,14 +389,71 @@ static const  FrequencyFilterType FREQUENCY_FILTER_LAST_TYPE = FREQUENCY_FILTER_
 
 static const  util::floating_t    FREQUENCY_MIN_FREQUENCY = 30.;
 static inline util::floating_t    FREQUENCY_MAX_FREQUENCY( const jack::Client* client ) { return client->get_sample_rate() / 2.; }
+// Highest cutoff an envelope sweeps to. Near the Nyquist frequency both
+// poles sit on the unit circle and the interpolated coefficients blow up.
+static inline util::floating_t    FREQUENCY_MAX_SWEEP( const jack::Client* client ) { return client->get_sample_rate() * 0.45; }
 static const  util::floating_t    FREQUENCY_DEF_FREQUENCY = FREQUENCY_MIN_FREQUENCY;
 static const  util::floating_t    FREQUENCY_MIN_RESONANCE = 0.5;
 static const  util::floating_t    FREQUENCY_MAX_RESONANCE = 1;
 static const  util::floating_t    FREQUENCY_DEF_RESONANCE = FREQUENCY_MAX_RESONANCE;
 static const  bool                FREQUENCY_DEF_ACTIVE = false;
-static const  unsigned char       FREQUENCY_MEMORY_SIZE = 3;
+// A note starts the cutoff the envelope octaves away from the frequency
+// and brings it back in the envelope decay seconds.
+static const  util::floating_t    FREQUENCY_MIN_ENVELOPE = -4;
+static const  util::floating_t    FREQUENCY_MAX_ENVELOPE = 4;
+static const  util::floating_t    FREQUENCY_DEF_ENVELOPE = 0;
+static const  util::floating_t    FREQUENCY_MIN_ENVELOPE_DECAY = 0;
+static const  util::floating_t    FREQUENCY_MAX_ENVELOPE_DECAY = 2;
+static const  util::floating_t    FREQUENCY_DEF_ENVELOPE_DECAY = 0.2;
+// Level of the envelope taken as back to the frequency.
+static const  util::floating_t    FREQUENCY_ENVELOPE_FLOOR = 1e-3;
+// Frames between two designs of a sweeping filter; the coefficients are
+// interpolated linearly in between.
+static const  jack_nframes_t      FREQUENCY_CONTROL_FRAMES = 16;
+
+static const size_t FREQUENCY_TABLE_SIZE = 1 << 14;
+
+// cos(w0) and sin(w0) for w0 from 0 to pi, the Nyquist frequency at any
+// sample rate, so that retuning a filter does no trigonometry. Linear
+// interpolation between entries is well below float precision.
+class FrequencyTable {
+	double cosines[ FREQUENCY_TABLE_SIZE + 2 ];
+	double sines[ FREQUENCY_TABLE_SIZE + 2 ];
+protected:
+	FrequencyTable() {
+		for ( size_t i = 0; i <= FREQUENCY_TABLE_SIZE; ++i ) {
+			double w0 = util::PI * ( i / (double)FREQUENCY_TABLE_SIZE );
+			cosines[i] = cos( w0 );
+			sines[i] = sin( w0 );
+		}
+		cosines[ FREQUENCY_TABLE_SIZE + 1 ] = cosines[ FREQUENCY_TABLE_SIZE ];
+		sines[ FREQUENCY_TABLE_SIZE + 1 ] = sines[ FREQUENCY_TABLE_SIZE ];
+	}
+public:
+	static const FrequencyTable& get_instance() {
+		static FrequencyTable instance;
+		return instance;
+	}
+	void lookup( const util::floating_t& frequency, const jack_nframes_t& sample_rate,
+			util::floating_t& cosine, util::floating_t& sine ) const {
+		double position = util::adjust_value( 2. * frequency / sample_rate, 0., 1. ) * FREQUENCY_TABLE_SIZE;
+		size_t i = (size_t)position;
+		double t = position - i;
+		cosine = cosines[i] + t * ( cosines[ i + 1 ] - cosines[i] );
+		sine = sines[i] + t * ( sines[ i + 1 ] - sines[i] );
+	}
+};
+
+// Biquad coefficients normalized by a0.
+struct FrequencyCoefficients {
+	util::floating_t b0_a0;
+	util::floating_t b1_a0;
+	util::floating_t b2_a0;
+	util::floating_t a1_a0;
+	util::floating_t a2_a0;
+};
 
-class FrequencyStrategy {
+class FrequencyStrategy : public FrequencyCoefficients {
 	util::floating_t frequency; // TODO: review this type
 	util::floating_t resonance;
 	bool dirty;
@@ -114,15 +462,10 @@ protected:
 		frequency( FREQUENCY_DEF_FREQUENCY ),
 		resonance( FREQUENCY_DEF_RESONANCE ),
 		dirty( false ) {}
+	// The coefficients of the filter type from the values every type shares.
+	virtual void shape( const util::floating_t& cos_w0, const util::floating_t& alpha,
+			const util::floating_t& a0, FrequencyCoefficients& c ) const = 0;
 public:
-	util::floating_t w0;
-	util::floating_t a0;
-	util::floating_t alpha;
-	util::floating_t b0_a0;
-	util::floating_t b1_a0;
-	util::floating_t b2_a0;
-	util::floating_t a1_a0;
-	util::floating_t a2_a0;
 	virtual ~FrequencyStrategy() {}
 	void set_frequency( const util::floating_t& frequency ) {
 		if ( this->frequency != frequency ) {
@@ -145,14 +488,22 @@ public:
 	const bool& is_dirty() {
 		return dirty;
 	}
-	virtual void compute( const jack_nframes_t& sample_rate ) {
-		dirty = false;
+	// Coefficients at any frequency, with this resonance.
+	void design( const util::floating_t& frequency, const jack_nframes_t& sample_rate,
+			FrequencyCoefficients& c ) const {
+		util::floating_t cos_w0;
+		util::floating_t sin_w0;
 		// w0 = 2*pi*f0/Fs
-		w0 = 2. * util::PI * ( get_frequency() / (util::floating_t)sample_rate );
+		FrequencyTable::get_instance().lookup( frequency, sample_rate, cos_w0, sin_w0 );
 		// alpha = sin(w0)/(2*Q)
-		alpha = sin(w0) / ( 2. * get_resonance() );
+		util::floating_t alpha = sin_w0 / ( 2. * get_resonance() );
 		// a0 =   1 + alpha
-		a0 = 1. + alpha;
+		util::floating_t a0 = 1. + alpha;
+		shape( cos_w0, alpha, a0, c );
+	}
+	void compute( const jack_nframes_t& sample_rate ) {
+		dirty = false;
+		design( get_frequency(), sample_rate, *this );
 	}
 };
 
@@ -160,19 +511,20 @@ class LowPass : public FrequencyStrategy {
 public:
 	LowPass() : FrequencyStrategy() {}
 	~LowPass() {}
-	virtual void compute( const jack_nframes_t& sample_rate ) {
-		FrequencyStrategy::compute( sample_rate );
+protected:
+	virtual void shape( const util::floating_t& cos_w0, const util::floating_t& alpha,
+			const util::floating_t& a0, FrequencyCoefficients& c ) const {
 		// LPF: H(s) = 1 / (s^2 + s/Q + 1)
 		// a1 =  -2*cos(w0)
-		a1_a0 = ( -2. * cos(w0) ) / a0;
+		c.a1_a0 = ( -2. * cos_w0 ) / a0;
 		// a2 =   1 - alpha
-		a2_a0 = ( 1. - alpha ) / a0;
+		c.a2_a0 = ( 1. - alpha ) / a0;
 		// b0 =  (1 - cos(w0))/2
-		b0_a0 = ( ( 1. - cos(w0) ) / 2. ) / a0;
+		c.b0_a0 = ( ( 1. - cos_w0 ) / 2. ) / a0;
 		// b1 =   1 - cos(w0)
-		b1_a0 = ( 1. - cos(w0) ) / a0;
+		c.b1_a0 = ( 1. - cos_w0 ) / a0;
 		// b2 =  (1 - cos(w0))/2
-		b2_a0 = b0_a0;
+		c.b2_a0 = c.b0_a0;
 	}
 };
 
@@ -180,19 +532,20 @@ class HighPass : public FrequencyStrategy {
 public:
 	HighPass() : FrequencyStrategy() {}
 	~HighPass() {}
-	virtual void compute( const jack_nframes_t& sample_rate ) {
-		FrequencyStrategy::compute( sample_rate );
+protected:
+	virtual void shape( const util::floating_t& cos_w0, const util::floating_t& alpha,
+			const util::floating_t& a0, FrequencyCoefficients& c ) const {
 		// HPF: H(s) = s^2 / (s^2 + s/Q + 1)
 		// a1 =  -2*cos(w0)
-		a1_a0 = ( -2. * cos(w0) ) / a0;
+		c.a1_a0 = ( -2. * cos_w0 ) / a0;
 		// a2 =   1 - alpha
-		a2_a0 = ( 1. - alpha ) / a0;
+		c.a2_a0 = ( 1. - alpha ) / a0;
 		// b0 =  (1 + cos(w0))/2
-		b0_a0 = ( ( 1. + cos(w0) ) / 2. ) / a0;
+		c.b0_a0 = ( ( 1. + cos_w0 ) / 2. ) / a0;
 		// b1 = -(1 + cos(w0))
-		b1_a0 = ( -( 1. + cos(w0) ) ) / a0;
+		c.b1_a0 = ( -( 1. + cos_w0 ) ) / a0;
 		// b2 =  (1 + cos(w0))/2
-		b2_a0 = ( ( 1. + cos(w0) ) / 2. ) / a0;
+		c.b2_a0 = ( ( 1. + cos_w0 ) / 2. ) / a0;
 	}
 
 };
@@ -201,20 +554,21 @@ class BandPass1 : public FrequencyStrategy {
 public:
 	BandPass1() : FrequencyStrategy() {}
 	~BandPass1() {}
-	virtual void compute( const jack_nframes_t& sample_rate ) {
-		FrequencyStrategy::compute( sample_rate );
+protected:
+	virtual void shape( const util::floating_t& cos_w0, const util::floating_t& alpha,
+			const util::floating_t& a0, FrequencyCoefficients& c ) const {
 		// BPF: H(s) = s / (s^2 + s/Q + 1)
 		//      (constant skirt gain, peak gain = Q)
 		// a1 =  -2*cos(w0)
-		a1_a0 = ( -2. * cos(w0) ) / a0;
+		c.a1_a0 = ( -2. * cos_w0 ) / a0;
 		// a2 =   1 - alpha
-		a2_a0 = ( 1. - alpha ) / a0;
+		c.a2_a0 = ( 1. - alpha ) / a0;
 		// b0 =   sin(w0)/2  =   Q*alpha
-		b0_a0 = ( get_resonance() * alpha ) / a0;
+		c.b0_a0 = ( get_resonance() * alpha ) / a0;
 		// b1 =   0
-		b1_a0 = 0.;
+		c.b1_a0 = 0.;
 		// b2 =  -sin(w0)/2  =  -Q*alpha
-		b2_a0 = ( -get_resonance() * alpha ) / a0;
+		c.b2_a0 = ( -get_resonance() * alpha ) / a0;
 	}
 };
 
@@ -222,20 +576,21 @@ class BandPass2 : public FrequencyStrategy {
 public:
 	BandPass2() : FrequencyStrategy() {}
 	~BandPass2() {}
-	virtual void compute( const jack_nframes_t& sample_rate ) {
-		FrequencyStrategy::compute( sample_rate );
+protected:
+	virtual void shape( const util::floating_t& cos_w0, const util::floating_t& alpha,
+			const util::floating_t& a0, FrequencyCoefficients& c ) const {
 		// BPF: H(s) = (s/Q) / (s^2 + s/Q + 1)
 		//      (constant 0 dB peak gain)
 		// a1 =  -2*cos(w0)
-		a1_a0 = ( -2. * cos(w0) ) / a0;
+		c.a1_a0 = ( -2. * cos_w0 ) / a0;
 		// a2 =   1 - alpha
-		a2_a0 = ( 1. - alpha ) / a0;
+		c.a2_a0 = ( 1. - alpha ) / a0;
 		// b0 =   alpha
-		b0_a0 = alpha / a0;
+		c.b0_a0 = alpha / a0;
 		// b1 =   0
-		b1_a0 = 0.;
+		c.b1_a0 = 0.;
 		// b2 =  -alpha
-		b2_a0 = -alpha / a0;
+		c.b2_a0 = -alpha / a0;
 	}
 
 };
@@ -244,35 +599,70 @@ class Notch : public FrequencyStrategy {
 public:
 	Notch() : FrequencyStrategy() {}
 	~Notch() {}
-	virtual void compute( const jack_nframes_t& sample_rate ) {
-		FrequencyStrategy::compute( sample_rate );
+protected:
+	virtual void shape( const util::floating_t& cos_w0, const util::floating_t& alpha,
+			const util::floating_t& a0, FrequencyCoefficients& c ) const {
 		// notch: H(s) = (s^2 + 1) / (s^2 + s/Q + 1)
 		// a1 =  -2*cos(w0)
-		a1_a0 = ( -2. * cos(w0) ) / a0;
+		c.a1_a0 = ( -2. * cos_w0 ) / a0;
 		// a2 =   1 - alpha
-		a2_a0 = ( 1. - alpha ) / a0;
+		c.a2_a0 = ( 1. - alpha ) / a0;
 		// b0 =   1
-		b0_a0 = 1.;
+		c.b0_a0 = 1.;
 		// b1 =  -2*cos(w0)
-		b1_a0 = ( -2. * cos(w0) ) / a0;
+		c.b1_a0 = ( -2. * cos_w0 ) / a0;
 		// b2 =   1
-		b2_a0 = 1.;
+		c.b2_a0 = 1.;
 	}
 };
 
+// Biquad state in transposed direct form II. An inactive filter keeps its
+// last two inputs instead and is following until it runs again.
+struct FrequencyMemory {
+	util::floating_t s1;
+	util::floating_t s2;
+	util::floating_t x1;
+	util::floating_t x2;
+	bool following;
+};
+
+// A filter envelope on its way back to the frequency: the coefficients
+// now, what they move by every frame and where they arrive at the end of
+// the control period.
+struct FrequencySweep {
+	FrequencyCoefficients current;
+	FrequencyCoefficients step;
+	FrequencyCoefficients target;
+	util::floating_t level;
+	util::floating_t factor;
+	jack_nframes_t frames;
+	bool active;
+};
+
 class Frequency : public Filter {
 private:
 	FrequencyStrategy* strategies[ FREQUENCY_FILTER_LAST_TYPE + 1 ];
 	FrequencyFilterType filter_type;
 	FrequencyStrategy* strategy;
-	jack_nframes_t memory_offset;
-	// ... ... ...
-	// 012 012 012
-	// PLc cPL LcP
-	// ^    ^    ^
-	util::floating_t y[ FREQUENCY_MEMORY_SIZE ];
-	util::floating_t x[ FREQUENCY_MEMORY_SIZE ];
+	FrequencyMemory memory;
+	FrequencySweep sweep;
+	util::floating_t envelope;
+	util::floating_t envelope_decay;
+	util::floating_t tail_threshold;
 protected:
+	// Coefficients at the frequency moved by the envelope at its level.
+	void design( FrequencyCoefficients& c ) const {
+		util::floating_t frequency = get_frequency() * exp2f( envelope * sweep.level );
+		strategy->design( util::adjust_value( frequency, FREQUENCY_MIN_FREQUENCY, FREQUENCY_MAX_SWEEP( get_client() ) ),
+				get_client()->get_sample_rate(), c );
+	}
+	static void advance( FrequencyCoefficients& c, const FrequencyCoefficients& step, const util::floating_t& frames ) {
+		c.b0_a0 += step.b0_a0 * frames;
+		c.b1_a0 += step.b1_a0 * frames;
+		c.b2_a0 += step.b2_a0 * frames;
+		c.a1_a0 += step.a1_a0 * frames;
+		c.a2_a0 += step.a2_a0 * frames;
+	}
 	void compute() {
 		if ( strategy->is_dirty() ) {
 			strategy->compute( get_client()->get_sample_rate() );
@@ -285,7 +675,13 @@ protected:
 	}
 public:
 	Frequency( jack::Client* client ) :
-		Filter( client ), filter_type( FREQUENCY_FILTER_TYPE_LOW_PASS ), memory_offset( 0 ) {
+		Filter( client ), filter_type( FREQUENCY_FILTER_TYPE_LOW_PASS ),
+		envelope( FREQUENCY_DEF_ENVELOPE ), envelope_decay( FREQUENCY_DEF_ENVELOPE_DECAY ),
+		tail_threshold( util::DEF_TAIL_THRESHOLD ) {
+		sweep.level = 0;
+		sweep.factor = 0;
+		sweep.frames = 0;
+		sweep.active = false;
 		set_active( FREQUENCY_DEF_ACTIVE );
 		strategies[ FREQUENCY_FILTER_TYPE_LOW_PASS ] = new LowPass;
 		strategies[ FREQUENCY_FILTER_TYPE_HIGH_PASS ] = new HighPass;
@@ -293,8 +689,7 @@ public:
 		strategies[ FREQUENCY_FILTER_TYPE_BAND_PASS_2 ] = new BandPass2;
 		strategies[ FREQUENCY_FILTER_TYPE_NOTCH ] = new Notch;
 		strategy = strategies[ filter_type ];
-		memset( x, 0, FREQUENCY_MEMORY_SIZE * sizeof( util::floating_t ) );
-		memset( y, 0, FREQUENCY_MEMORY_SIZE * sizeof( util::floating_t ) );
+		clear();
 		compute_all();
 	}
 	~Frequency() {
@@ -311,6 +706,9 @@ public:
     }
     const FrequencyFilterType& get_filter_type() const {
     	return filter_type;
+    }
+    const FrequencyStrategy& get_strategy() const {
+    	return *strategy;
     }
 	void set_frequency( const util::floating_t& frequency ) {
 		strategy->set_frequency( util::adjust_value(
@@ -328,30 +726,158 @@ public:
 	const util::floating_t& get_resonance() const {
 		return strategy->get_resonance();
 	}
+	void set_envelope( const util::floating_t& envelope ) {
+		this->envelope = util::adjust_value( envelope, FREQUENCY_MIN_ENVELOPE, FREQUENCY_MAX_ENVELOPE );
+	}
+	const util::floating_t& get_envelope() const {
+		return envelope;
+	}
+	void set_envelope_decay( const util::floating_t& envelope_decay ) {
+		this->envelope_decay = util::adjust_value( envelope_decay,
+				FREQUENCY_MIN_ENVELOPE_DECAY, FREQUENCY_MAX_ENVELOPE_DECAY );
+	}
+	const util::floating_t& get_envelope_decay() const {
+		return envelope_decay;
+	}
+	// Starts the envelope of a note, if the filter has one.
+	void trigger() {
+		sweep.active = false;
+		if ( is_active() && envelope != 0 && envelope_decay > 0 ) {
+			sweep.level = 1;
+			sweep.factor = pow( FREQUENCY_ENVELOPE_FLOOR,
+					FREQUENCY_CONTROL_FRAMES / ( envelope_decay * get_client()->get_sample_rate() ) );
+			design( sweep.current );
+			sweep.target = sweep.current;
+			sweep.frames = 0;
+			sweep.active = true;
+		}
+	}
+	const bool& is_sweeping() const {
+		return sweep.active;
+	}
+	FrequencySweep& get_sweep() {
+		return sweep;
+	}
+	// The coefficients the next frame is filtered with.
+	const FrequencyCoefficients& get_coefficients() const {
+		if ( sweep.active ) {
+			return sweep.current;
+		}
+		return *strategy;
+	}
+	// Ends a control period where it was aimed at and designs the next
+	// one, a single table lookup per period. The sweep stops once it is
+	// back to the frequency.
+	void next() {
+		sweep.current = sweep.target;
+		if ( 0 == sweep.level ) {
+			sweep.active = false;
+			return;
+		}
+		sweep.level *= sweep.factor;
+		if ( sweep.level < FREQUENCY_ENVELOPE_FLOOR ) {
+			sweep.level = 0;
+			sweep.target = *strategy;
+		} else {
+			design( sweep.target );
+		}
+		const util::floating_t frames = FREQUENCY_CONTROL_FRAMES;
+		sweep.step.b0_a0 = ( sweep.target.b0_a0 - sweep.current.b0_a0 ) / frames;
+		sweep.step.b1_a0 = ( sweep.target.b1_a0 - sweep.current.b1_a0 ) / frames;
+		sweep.step.b2_a0 = ( sweep.target.b2_a0 - sweep.current.b2_a0 ) / frames;
+		sweep.step.a1_a0 = ( sweep.target.a1_a0 - sweep.current.a1_a0 ) / frames;
+		sweep.step.a2_a0 = ( sweep.target.a2_a0 - sweep.current.a2_a0 ) / frames;
+		sweep.frames = FREQUENCY_CONTROL_FRAMES;
+	}
+	// Lets frames go by without filtering them, as when the input is silent.
+	void pass( jack_nframes_t frames ) {
+		while ( sweep.active && frames > 0 ) {
+			if ( 0 == sweep.frames ) {
+				next();
+			} else {
+				jack_nframes_t n = std::min( frames, sweep.frames );
+				advance( sweep.current, sweep.step, n );
+				sweep.frames -= n;
+				frames -= n;
+			}
+		}
+	}
+	FrequencyMemory& get_memory() {
+		return memory;
+	}
+	void clear() {
+		memory.s1 = memory.s2 = memory.x1 = memory.x2 = 0;
+		memory.following = false;
+	}
+	bool is_resting() const {
+		return memory.following ? memory.x1 == 0 && memory.x2 == 0 : memory.s1 == 0 && memory.s2 == 0;
+	}
+	// Turns the inputs a filter followed into the state it would have had
+	// if its output had been its input, with the coefficients it starts
+	// with, so that activating it does not click.
+	static void settle( FrequencyMemory& memory, const FrequencyCoefficients& c ) {
+		if ( memory.following ) {
+			memory.s1 = ( c.b1_a0 - c.a1_a0 ) * memory.x1 + ( c.b2_a0 - c.a2_a0 ) * memory.x2;
+			memory.s2 = ( c.b2_a0 - c.a2_a0 ) * memory.x1;
+			memory.following = false;
+		}
+	}
+	// A ringing filter whose history falls below the threshold is put to
+	// rest, instead of decaying through denormals. Zero never cuts.
+	void set_tail_threshold( const util::floating_t& tail_threshold ) {
+		this->tail_threshold = tail_threshold;
+	}
+	const util::floating_t& get_tail_threshold() const {
+		return tail_threshold;
+	}
+	bool is_tail() const {
+		return fabs( memory.s1 ) < tail_threshold && fabs( memory.s2 ) < tail_threshold;
+	}
 	void filter( jack::sample_t* samples ) {
-		jack_nframes_t buffer_size = get_client()->get_buffer_size();
-		unsigned char s_0, s_1, s_2;
-		if ( is_active() ) {
-			for ( jack_nframes_t i = 0; i < buffer_size; ++i, ++memory_offset ) {
-				// y[n] = (b0/a0)*x[n] + (b1/a0)*x[n-1] + (b2/a0)*x[n-2]
-				//                     - (a1/a0)*y[n-1] - (a2/a0)*y[n-2]
-				s_0 = ( memory_offset + 2 ) % FREQUENCY_MEMORY_SIZE;
-				s_1 = ( memory_offset + 1 ) % FREQUENCY_MEMORY_SIZE;
-				s_2 = ( memory_offset     ) % FREQUENCY_MEMORY_SIZE;
-				x[s_0] = samples[i];
-				samples[i] = y[s_0] = strategy->b0_a0 * x[s_0] + strategy->b1_a0 * x[s_1] + strategy->b2_a0 * x[s_2]
-														   - strategy->a1_a0 * y[s_1] - strategy->a2_a0 * y[s_2];
+		jack_nframes_t buffer_size = get_client()->get_block_size();
+		if ( is_silent() && is_resting() ) {
+			// Silence into an empty filter stays silent.
+			memory.x1 = 0;
+			pass( buffer_size );
+		} else if ( is_active() ) {
+			set_silent( false );
+			settle( memory, get_coefficients() );
+			util::floating_t x0 = memory.x1;
+			jack_nframes_t i = 0;
+			while ( i < buffer_size ) {
+				jack_nframes_t end = buffer_size;
+				if ( sweep.active ) {
+					if ( 0 == sweep.frames ) {
+						next();
+						continue;
+					}
+					end = std::min( buffer_size, i + sweep.frames );
+					sweep.frames -= end - i;
+				}
+				const bool sweeping = sweep.active;
+				FrequencyCoefficients& c = sweeping ? sweep.current : *strategy;
+				for ( ; i < end; ++i ) {
+					// y[n]  = (b0/a0)*x[n] + s1[n-1]
+					// s1[n] = (b1/a0)*x[n] - (a1/a0)*y[n] + s2[n-1]
+					// s2[n] = (b2/a0)*x[n] - (a2/a0)*y[n]
+					x0 = samples[i];
+					util::floating_t y0 = c.b0_a0 * x0 + memory.s1;
+					memory.s1 = c.b1_a0 * x0 - c.a1_a0 * y0 + memory.s2;
+					memory.s2 = c.b2_a0 * x0 - c.a2_a0 * y0;
+					samples[i] = y0;
+					if ( sweeping ) {
+						advance( c, sweep.step, 1 );
+					}
+				}
+			}
+			memory.x1 = x0;
+			if ( is_tail() ) {
+				clear();
 			}
 		} else {
-			buffer_size--;
-			memory_offset += buffer_size;
-			s_0 = ( memory_offset + 2 ) % FREQUENCY_MEMORY_SIZE;
-			s_1 = ( memory_offset + 1 ) % FREQUENCY_MEMORY_SIZE;
-			s_2 = ( memory_offset     ) % FREQUENCY_MEMORY_SIZE;
-			x[s_0] = y[s_0] = samples[ buffer_size-- ];
-			x[s_1] = y[s_1] = samples[ buffer_size-- ];
-			x[s_2] = y[s_2] = samples[ buffer_size-- ];
-			memory_offset++;
+			memory.x2 = buffer_size > 1 ? samples[ buffer_size - 2 ] : memory.x1;
+			memory.x1 = samples[ buffer_size - 1 ];
+			memory.following = true;
 		}
 	}
 };
@@ -360,8 +886,49 @@ static const util::floating_t GAIN_MIN_VOLUME = 0;
 static const util::floating_t GAIN_MAX_VOLUME = 4;
 static const util::floating_t GAIN_DEF_VOLUME = 1;
 
+typedef void (*ScaleKernel)( jack::sample_t* samples, const util::floating_t& volume, const size_t& frames );
+
 class Gain : public Filter {
 	util::floating_t volume;
+	static void scale_frames( jack::sample_t* samples, const util::floating_t& volume,
+			size_t i, const size_t& frames ) {
+		for ( ; i < frames; ++i ) {
+			samples[i] *= volume;
+		}
+	}
+	static void scale_scalar( jack::sample_t* samples, const util::floating_t& volume, const size_t& frames ) {
+		scale_frames( samples, volume, 0, frames );
+	}
+#if defined( __SSE2__ )
+	static void scale_sse2( jack::sample_t* samples, const util::floating_t& volume, const size_t& frames ) {
+		const __m128 gain = _mm_set1_ps( volume );
+		size_t i = 0;
+		for ( ; i + 4 <= frames; i += 4 ) {
+			_mm_storeu_ps( samples + i, _mm_mul_ps( _mm_loadu_ps( samples + i ), gain ) );
+		}
+		scale_frames( samples, volume, i, frames );
+	}
+#endif
+#if defined( SIMD_X86 )
+	static SIMD_AVX2_TARGET void scale_avx2( jack::sample_t* samples, const util::floating_t& volume,
+			const size_t& frames ) {
+		const __m256 gain = _mm256_set1_ps( volume );
+		size_t i = 0;
+		for ( ; i + 8 <= frames; i += 8 ) {
+			_mm256_storeu_ps( samples + i, _mm256_mul_ps( _mm256_loadu_ps( samples + i ), gain ) );
+		}
+		scale_frames( samples, volume, i, frames );
+	}
+	static SIMD_AVX512_TARGET void scale_avx512( jack::sample_t* samples, const util::floating_t& volume,
+			const size_t& frames ) {
+		const __m512 gain = _mm512_set1_ps( volume );
+		size_t i = 0;
+		for ( ; i + 16 <= frames; i += 16 ) {
+			_mm512_storeu_ps( samples + i, _mm512_mul_ps( _mm512_loadu_ps( samples + i ), gain ) );
+		}
+		scale_frames( samples, volume, i, frames );
+	}
+#endif
 public:
 	Gain( jack::Client* client ) : Filter( client ), volume( GAIN_DEF_VOLUME ) {}
 	~Gain() {}
@@ -372,9 +939,10 @@ public:
 		return volume;
 	}
 	void filter( jack::sample_t* samples ) {
-		jack_nframes_t buffer_size = get_client()->get_buffer_size();
-		for ( jack_nframes_t i = 0; i < buffer_size; ++i ) {
-			samples[i] *= volume;
+		static const simd::Kernel< ScaleKernel > kernel( scale_scalar, SIMD_SSE2_VARIANT( scale_sse2 ),
+				SIMD_X86_VARIANT( scale_avx2 ), SIMD_X86_VARIANT( scale_avx512 ) );
+		if ( !is_silent() ) {
+			kernel.get()( samples, volume, get_client()->get_block_size() );
 		}
 	}
 };
@@ -387,55 +955,372 @@ public:
 		jack::sample_t* origin;
 		jack_nframes_t received = receive( &origin );
 		memcpy( samples, origin, received * sizeof( jack::sample_t ) );
-		if ( received < get_client()->get_buffer_size() ) {
+		if ( received < get_client()->get_block_size() ) {
 			memset( samples + received, 0,
-					( get_client()->get_buffer_size() - received ) * sizeof( jack::sample_t ) );
+					( get_client()->get_block_size() - received ) * sizeof( jack::sample_t ) );
 		}
+		set_silent( received == 0 );
 	}
 };
 
+class TimeStretchPreset {
+	int sequence;
+	int window;
+	int overlap;
+public:
+	TimeStretchPreset( const int& sequence, const int& window, const int& overlap ) :
+		sequence( sequence ), window( window ), overlap( overlap ) {}
+	virtual ~TimeStretchPreset() {}
+	const int& get_sequence() const { return sequence; }
+	const int& get_window() const { return window; }
+	const int& get_overlap() const { return overlap; }
+};
+
+static TimeStretchPreset TIME_STRETCH_PRESETS[] = {
+		TimeStretchPreset(
+				USE_AUTO_SEQUENCE_LEN,
+				USE_AUTO_SEEKWINDOW_LEN,
+				DEFAULT_OVERLAP_MS ),   // Auto
+		TimeStretchPreset( 40, 15, 8 ), // Speech
+		TimeStretchPreset( 28, 14, 7 ), // ModeA
+		TimeStretchPreset( 24, 12, 6 )  // ModeB
+};
+
+enum TimeStretchType {
+	TIME_STRETCH_TYPE_AUTO = 0,
+	TIME_STRETCH_TYPE_SPEECH,
+	TIME_STRETCH_TYPE_1,
+	TIME_STRETCH_TYPE_2
+};
+
+static const TimeStretchType  TIME_STRETCH_DEF_TYPE    = TIME_STRETCH_TYPE_AUTO;
+static const TimeStretchType  TIME_STRETCH_LAST_TYPE   = TIME_STRETCH_TYPE_2;
+
+static const util::floating_t TIME_STRETCH_MIN_STRETCH = 0;
+static const util::floating_t TIME_STRETCH_MAX_STRETCH = 4;
+static const util::floating_t TIME_STRETCH_DEF_STRETCH = 1;
+static const util::floating_t TIME_STRETCH_NO_STRETCH  = TIME_STRETCH_DEF_STRETCH;
+// Slowest tempo the stretch runs at; at zero it would never move on.
+static const util::floating_t TIME_STRETCH_MIN_TEMPO   = 0.0625;
+// Highest rate the stretch windows are sized for; faster waves get the
+// windows of this rate, a little shorter in time.
+static const jack_nframes_t   TIME_STRETCH_MAX_RATE    = 96000;
+// Longest render kept of a stretched wave; slower stretches play live.
+static const jack_nframes_t   TIME_STRETCH_MAX_RENDER  = 1 << 22;
+
 static const int              WAVE_MAX_CHANNELS = 1;
 static const util::floating_t WAVE_MIN_START_TIME = 0;
 static const util::floating_t WAVE_MAX_START_TIME = 0.1;
 static const util::floating_t WAVE_DEF_START_TIME = WAVE_MIN_START_TIME;
 
-class Wave : public Generator {
+// Copies of a wave pre-rendered at whole semitones, from four octaves down
+// to four up, within a memory budget shared by every pad.
+static const int              WAVE_MIN_PITCH = -48;
+static const int              WAVE_MAX_PITCH = 48;
+static const size_t           WAVE_PITCHES = WAVE_MAX_PITCH - WAVE_MIN_PITCH + 1;
+static const size_t           WAVE_DEF_PITCH_BUDGET = 128 << 20;
+// Renders of a wave at the stretches played lately, kept by each pad,
+// within a memory budget shared by every pad.
+static const size_t           WAVE_STRETCHES = 4;
+static const size_t           WAVE_DEF_STRETCH_BUDGET = 64 << 20;
+
+// The copies go through a Kaiser windowed sinc 16 zero crossings wide on
+// each side, stretched below the Nyquist frequency of a raised pitch.
+static const size_t           PITCH_ZERO_CROSSINGS = 16;
+static const size_t           PITCH_RESOLUTION = 512;
+static const double           PITCH_BETA = 9;
+
+class PitchKernel {
+protected:
+	PitchKernel() {
+		for ( size_t i = 0; i <= PITCH_ZERO_CROSSINGS * PITCH_RESOLUTION; ++i ) {
+			double u = i / (double)PITCH_RESOLUTION;
+			double x = util::PI * u;
+			taps[i] = ( i == 0 ? 1 : sin( x ) / x ) * kaiser( u / PITCH_ZERO_CROSSINGS, PITCH_BETA );
+		}
+		taps[ PITCH_ZERO_CROSSINGS * PITCH_RESOLUTION + 1 ] = 0;
+	}
+public:
+	double taps[ PITCH_ZERO_CROSSINGS * PITCH_RESOLUTION + 2 ];
+	static const PitchKernel& get_instance() {
+		static PitchKernel instance;
+		return instance;
+	}
+	// The kernel at u zero crossings from its center.
+	double at( const double& u ) const {
+		double position = fabs( u ) * PITCH_RESOLUTION;
+		size_t i = position;
+		if ( i >= PITCH_ZERO_CROSSINGS * PITCH_RESOLUTION ) {
+			return 0;
+		}
+		return taps[i] + ( position - i ) * ( taps[ i + 1 ] - taps[i] );
+	}
+};
+
+// The copies of one wave. Rendered away from the audio thread and then
+// handed to it whole; the generation tells which wave they were made of.
+class PitchTable {
+	size_t generation;
+	jack::sample_t* buffers[ WAVE_PITCHES ];
+	jack_nframes_t sizes[ WAVE_PITCHES ];
+	double steps[ WAVE_PITCHES ];
+public:
+	PitchTable( const size_t& generation ) : generation( generation ) {
+		for ( size_t i = 0; i < WAVE_PITCHES; ++i ) {
+			buffers[i] = 0;
+			sizes[i] = 0;
+			steps[i] = 1;
+		}
+	}
+	virtual ~PitchTable() {
+		for ( size_t i = 0; i < WAVE_PITCHES; ++i ) {
+			delete [] buffers[i];
+		}
+	}
+	// Source frames per frame of the copy at the given pitch.
+	static double to_step( const int& pitch, const jack_nframes_t& source_rate, const jack_nframes_t& sample_rate ) {
+		return pow( 2., pitch / 12. ) * source_rate / sample_rate;
+	}
+	static jack_nframes_t to_frames( const jack_nframes_t& source_size, const double& step ) {
+		return source_size ? ( source_size - 1 ) / step + 1 : 0;
+	}
+	const size_t& get_generation() const {
+		return generation;
+	}
+	bool has( const int& pitch ) const {
+		return pitch >= WAVE_MIN_PITCH && pitch <= WAVE_MAX_PITCH && buffers[ pitch - WAVE_MIN_PITCH ];
+	}
+	jack::sample_t* get_buffer( const int& pitch ) const {
+		return buffers[ pitch - WAVE_MIN_PITCH ];
+	}
+	const jack_nframes_t& get_buffer_size( const int& pitch ) const {
+		return sizes[ pitch - WAVE_MIN_PITCH ];
+	}
+	const double& get_step( const int& pitch ) const {
+		return steps[ pitch - WAVE_MIN_PITCH ];
+	}
+	void render( const int& pitch, const jack::sample_t* source, const jack_nframes_t& source_size,
+			const double& step ) {
+		const PitchKernel& kernel = PitchKernel::get_instance();
+		size_t i = pitch - WAVE_MIN_PITCH;
+		// Raising the pitch lowers the cutoff, or the top would alias.
+		double cutoff = std::min( 1., 1. / step );
+		double reach = PITCH_ZERO_CROSSINGS / cutoff;
+		delete [] buffers[i];
+		sizes[i] = to_frames( source_size, step );
+		buffers[i] = new jack::sample_t[ sizes[i] ];
+		steps[i] = step;
+		for ( jack_nframes_t m = 0; m < sizes[i]; ++m ) {
+			double x = m * step;
+			long first = std::max( (long)ceil( x - reach ), 0L );
+			long last = std::min( (long)floor( x + reach ), (long)source_size - 1 );
+			double sum = 0;
+			for ( long k = first; k <= last; ++k ) {
+				sum += source[k] * kernel.at( ( k - x ) * cutoff );
+			}
+			buffers[i][m] = sum * cutoff;
+		}
+	}
+};
+
+// One wave run through the time stretch once, from the start frame on,
+// for every note that plays it with the same stretch and type. Rendered
+// away from the audio thread, the same as the live stretch would.
+class StretchRender {
+	size_t generation;
+	jack_nframes_t start_frame;
+	util::floating_t stretch;
+	TimeStretchType type;
+	jack::sample_t* buffer;
+	jack_nframes_t buffer_size;
+public:
+	StretchRender( const size_t& generation, const jack_nframes_t& start_frame,
+			const util::floating_t& stretch, const TimeStretchType& type ) :
+		generation( generation ), start_frame( start_frame ), stretch( stretch ), type( type ),
+		buffer( 0 ), buffer_size( 0 ) {}
+	virtual ~StretchRender() {
+		delete [] buffer;
+	}
+	static bool fits( const jack_nframes_t& source_size, const util::floating_t& stretch ) {
+		return stretch > 0 && source_size / std::max( stretch, TIME_STRETCH_MIN_TEMPO ) < TIME_STRETCH_MAX_RENDER;
+	}
+	// Memory a render that fits() takes, about, before it is made.
+	static size_t to_bytes( const jack_nframes_t& source_size, const util::floating_t& stretch ) {
+		return (size_t)( source_size / std::max( stretch, TIME_STRETCH_MIN_TEMPO ) ) * sizeof( jack::sample_t );
+	}
+	size_t get_bytes() const {
+		return buffer_size * sizeof( jack::sample_t );
+	}
+	bool matches( const size_t& generation, const jack_nframes_t& start_frame,
+			const util::floating_t& stretch, const TimeStretchType& type ) const {
+		return generation == this->generation && start_frame == this->start_frame
+				&& type == this->type && util::almost_equal( stretch, this->stretch );
+	}
+	bool matches( const StretchRender& other ) const {
+		return matches( other.generation, other.start_frame, other.stretch, other.type );
+	}
+	const size_t& get_generation() const {
+		return generation;
+	}
+	jack::sample_t* get_buffer() const {
+		return buffer;
+	}
+	const jack_nframes_t& get_buffer_size() const {
+		return buffer_size;
+	}
+	// Feeds the whole wave and drains it, as the live stretch does.
+	void render( const jack::sample_t* source, const jack_nframes_t& source_size,
+			const jack_nframes_t& source_rate ) {
+		soundtouch::TDStretch* time_stretch = soundtouch::TDStretch::newInstance();
+		TimeStretchPreset& preset = TIME_STRETCH_PRESETS[ type ];
+		time_stretch->setChannels( WAVE_MAX_CHANNELS );
+		time_stretch->enableQuickSeek( true );
+		time_stretch->setTempo( std::max( stretch, TIME_STRETCH_MIN_TEMPO ) );
+		time_stretch->setParameters( std::min( source_rate, TIME_STRETCH_MAX_RATE ),
+				preset.get_sequence(), preset.get_window(), preset.get_overlap() );
+		if ( start_frame < source_size ) {
+			time_stretch->putSamples( source + start_frame, source_size - start_frame );
+		}
+		time_stretch->drain();
+		delete [] buffer;
+		buffer_size = time_stretch->numSamples();
+		buffer = new jack::sample_t[ buffer_size ];
+		time_stretch->receiveSamples( buffer, buffer_size );
+		delete time_stretch;
+	}
+};
+
+// Sample data of a pad, shared by every voice that plays it.
+class Wave {
+	jack::Client* client;
     jack::sample_t* buffer;
     jack_nframes_t buffer_size;
     util::floating_t start_time;
     jack_nframes_t start_frame;
     std::string file_name;
-    jack_nframes_t count;
-    jack_nframes_t offset;
     jack_nframes_t sample_rate;
+    PitchTable* pitches;
+    size_t generation;
+    StretchRender* stretches[ WAVE_STRETCHES ];
+    size_t stretches_used[ WAVE_STRETCHES ];
+    size_t clock;
 protected:
-    void clear() { delete buffer; }
+    void clear() {
+    	delete [] buffer;
+    	delete pitches;
+    	for ( size_t i = 0; i < WAVE_STRETCHES; ++i ) {
+    		delete stretches[i];
+    	}
+    }
 public:
     Wave( jack::Client* client ) :
-    	Generator( client ),
+    	client( client ),
     	buffer( 0 ), buffer_size( 0 ),
     	start_time( WAVE_DEF_START_TIME ), start_frame( 0 ),
-    	count( 0 ), offset( 0 ), sample_rate( 0 ) {
+    	sample_rate( 0 ), pitches( 0 ), generation( 0 ), clock( 0 ) {
+    	for ( size_t i = 0; i < WAVE_STRETCHES; ++i ) {
+    		stretches[i] = 0;
+    		stretches_used[i] = 0;
+    	}
     }
     virtual ~Wave() {
     	clear();
     }
-    void load() {
+    // Reads the file into a new buffer, away from the audio thread.
+    bool read( jack::sample_t*& buffer, jack_nframes_t& buffer_size, jack_nframes_t& sample_rate ) const {
         SndfileHandle handle( file_name );
         if ( SF_ERR_NO_ERROR == handle.error() && WAVE_MAX_CHANNELS == handle.channels() ) {
-            clear();
             sample_rate = handle.samplerate();
 			buffer = new jack::sample_t[ handle.frames() ];
 			handle.read( buffer, handle.frames() );
 			buffer_size = handle.frames();
+			return true;
         }
+        return false;
+    }
+    // Installs a buffer given by read() and hands back the previous one.
+    void swap( jack::sample_t*& buffer, jack_nframes_t& buffer_size, jack_nframes_t& sample_rate ) {
+    	std::swap( this->buffer, buffer );
+    	std::swap( this->buffer_size, buffer_size );
+    	std::swap( this->sample_rate, sample_rate );
+    	set_start_time( start_time );
+    	generation++;
+    }
+    // Installs the copies of a wave, same as swap(). Copies of a wave that
+    // is not the current one anymore are handed back without being used.
+    void swap_pitches( PitchTable*& pitches ) {
+    	if ( !pitches || pitches->get_generation() == generation ) {
+    		std::swap( this->pitches, pitches );
+    	}
+    }
+    const PitchTable* get_pitches() const {
+    	return pitches;
+    }
+    // Installs a render in an empty slot or in place of the one played
+    // least lately, unless busy says a voice still reads it. Whatever is
+    // left in stretched goes back, same as swap().
+    void swap_stretched( StretchRender*& stretched, const bool* busy ) {
+    	if ( !stretched || stretched->get_generation() != generation ) {
+    		return;
+    	}
+    	size_t slot = WAVE_STRETCHES;
+    	for ( size_t i = 0; i < WAVE_STRETCHES; ++i ) {
+    		if ( stretches[i] && stretches[i]->matches( *stretched ) ) {
+    			return;
+    		}
+    	}
+    	for ( size_t i = 0; i < WAVE_STRETCHES; ++i ) {
+    		if ( !stretches[i] ) {
+    			slot = i;
+    			break;
+    		}
+    		if ( !busy[i] && ( slot == WAVE_STRETCHES || stretches_used[i] < stretches_used[ slot ] ) ) {
+    			slot = i;
+    		}
+    	}
+    	if ( slot < WAVE_STRETCHES ) {
+    		std::swap( stretches[ slot ], stretched );
+    		stretches_used[ slot ] = ++clock;
+    	}
+    }
+    // Takes out one render of a previous wave, if any is left.
+    StretchRender* drop_stretched() {
+    	StretchRender* stretched = 0;
+    	for ( size_t i = 0; i < WAVE_STRETCHES && !stretched; ++i ) {
+    		if ( stretches[i] && stretches[i]->get_generation() != generation ) {
+    			std::swap( stretches[i], stretched );
+    		}
+    	}
+    	return stretched;
+    }
+    // Slot of the render of the current wave at the given stretch, or
+    // WAVE_STRETCHES when there is none.
+    size_t find_stretched( const util::floating_t& stretch, const TimeStretchType& type ) const {
+    	for ( size_t i = 0; i < WAVE_STRETCHES; ++i ) {
+    		if ( stretches[i] && stretches[i]->matches( generation, start_frame, stretch, type ) ) {
+    			return i;
+    		}
+    	}
+    	return WAVE_STRETCHES;
+    }
+    const StretchRender* get_stretched( const size_t& slot ) const {
+    	return stretches[ slot ];
+    }
+    // Marks a render as played now, to keep it longest.
+    void touch_stretched( const size_t& slot ) {
+    	stretches_used[ slot ] = ++clock;
+    }
+    // Waves installed so far; the user interface counts them as well, to
+    // tell which one the copies it asks for belong to.
+    const size_t& get_generation() const {
+    	return generation;
     }
     void set_start_time( const util::floating_t& start_time ) {
     	util::floating_t ti = util::adjust_value( start_time, WAVE_MIN_START_TIME, WAVE_MAX_START_TIME );
-    	util::floating_t fs = get_client()->time_to_frames( ti );
+    	util::floating_t fs = client->time_to_frames( ti );
     	if ( fs > buffer_size ) {
     		fs = buffer_size;
-    		this->start_time = get_client()->frames_to_time( fs );
+    		this->start_time = client->frames_to_time( fs );
     	} else {
     		this->start_time = ti;
     	}
@@ -444,73 +1329,118 @@ public:
     const util::floating_t& get_start_time() const {
     	return start_time;
     }
+    const jack_nframes_t& get_start_frame() const {
+    	return start_frame;
+    }
     void set_file_name( const std::string& file_name ) {
     	this->file_name = file_name;
     }
     const std::string& get_file_name() const {
     	return file_name;
+    }
+    jack::sample_t* get_buffer() const {
+    	return buffer;
+    }
+    const jack_nframes_t& get_buffer_size() const {
+    	return buffer_size;
+    }
+    jack_nframes_t get_sample_rate() const {
+		return sample_rate == 0 ? client->get_sample_rate() : sample_rate;
+	}
+};
+
+// Play position of one voice over a pad wave, or over one of its copies
+// or renders.
+class WaveReader : public Generator {
+	Wave* wave;
+    jack_nframes_t count;
+    jack_nframes_t offset;
+    int pitch;
+    bool copied;
+    const StretchRender* stretched;
+protected:
+    jack::sample_t* get_data() const {
+    	if ( stretched ) {
+    		return stretched->get_buffer();
+    	}
+    	return copied ? wave->get_pitches()->get_buffer( pitch ) : wave->get_buffer();
+    }
+    jack_nframes_t get_data_size() const {
+    	if ( stretched ) {
+    		return stretched->get_buffer_size();
+    	}
+    	return copied ? wave->get_pitches()->get_buffer_size( pitch ) : wave->get_buffer_size();
+    }
+public:
+    WaveReader( jack::Client* client ) :
+    	Generator( client ), wave( 0 ), count( 0 ), offset( 0 ), pitch( 0 ), copied( false ), stretched( 0 ) {
+    }
+    virtual ~WaveReader() {}
+    void set_wave( Wave* wave ) {
+    	this->wave = wave;
+    }
+    Wave* get_wave() const {
+    	return wave;
+    }
+    // Plays the render made at the given stretch when the wave has one,
+    // else the copy made at the given transpose, when it has that; what
+    // is left is up to the time stretch and the tuner. Takes effect on
+    // reset().
+    void select( const util::floating_t& transpose, const util::floating_t& stretch, const TimeStretchType& type ) {
+    	size_t slot = wave ? wave->find_stretched( stretch, type ) : WAVE_STRETCHES;
+    	if ( slot < WAVE_STRETCHES ) {
+    		wave->touch_stretched( slot );
+    		stretched = wave->get_stretched( slot );
+    		copied = false;
+    		pitch = 0;
+    		return;
+    	}
+    	int rounded = floor( transpose + 0.5 );
+    	stretched = 0;
+    	copied = wave && wave->get_pitches() && wave->get_pitches()->has( rounded )
+    			&& util::almost_equal( transpose, (util::floating_t)rounded, (util::floating_t)1e-4 );
+    	pitch = copied ? rounded : 0;
+    }
+    // Semitones the frames read are already transposed by.
+    const int& get_pitch() const {
+    	return pitch;
+    }
+    const bool& is_copied() const {
+    	return copied;
+    }
+    // The render read, if any; its frames are already stretched.
+    const StretchRender* get_stretched() const {
+    	return stretched;
     }
 	bool is_finished() {
-		return offset >= buffer_size;
+		return offset >= get_data_size();
 	}
     jack_nframes_t get_sample_rate() {
-		return sample_rate == 0 ? get_client()->get_sample_rate() : sample_rate;
+    	if ( copied ) {
+    		return get_client()->get_sample_rate();
+    	}
+		return wave ? wave->get_sample_rate() : get_client()->get_sample_rate();
 	}
 	void reset() {
 		count = 0;
-		offset = start_frame;
+		offset = stretched ? 0 : wave->get_start_frame();
+		if ( copied ) {
+			offset /= wave->get_pitches()->get_step( pitch );
+		}
 	}
 	jack_nframes_t receive( jack::sample_t** samples ) {
+		jack_nframes_t size = get_data_size();
 		offset += count;
 		count = 0;
-		if ( offset < buffer_size ) {
-			*samples = buffer + offset;
-			count = offset + get_client()->get_buffer_size() > buffer_size
-					? buffer_size - offset : get_client()->get_buffer_size();
+		if ( offset < size ) {
+			*samples = get_data() + offset;
+			count = offset + get_client()->get_block_size() > size
+					? size - offset : get_client()->get_block_size();
 		}
 		return count;
 	}
 };
 
-class TimeStretchPreset {
-	int sequence;
-	int window;
-	int overlap;
-public:
-	TimeStretchPreset( const int& sequence, const int& window, const int& overlap ) :
-		sequence( sequence ), window( window ), overlap( overlap ) {}
-	virtual ~TimeStretchPreset() {}
-	const int& get_sequence() const { return sequence; }
-	const int& get_window() const { return window; }
-	const int& get_overlap() const { return overlap; }
-};
-
-static TimeStretchPreset TIME_STRETCH_PRESETS[] = {
-		TimeStretchPreset(
-				USE_AUTO_SEQUENCE_LEN,
-				USE_AUTO_SEEKWINDOW_LEN,
-				DEFAULT_OVERLAP_MS ),   // Auto
-		TimeStretchPreset( 40, 15, 8 ), // Speech
-		TimeStretchPreset( 28, 14, 7 ), // ModeA
-		TimeStretchPreset( 24, 12, 6 )  // ModeB
-};
-
-enum TimeStretchType {
-	TIME_STRETCH_TYPE_AUTO = 0,
-	TIME_STRETCH_TYPE_SPEECH,
-	TIME_STRETCH_TYPE_1,
-	TIME_STRETCH_TYPE_2
-};
-
-static const TimeStretchType  TIME_STRETCH_DEF_TYPE    = TIME_STRETCH_TYPE_AUTO;
-static const TimeStretchType  TIME_STRETCH_LAST_TYPE   = TIME_STRETCH_TYPE_2;
-
-static const util::floating_t TIME_STRETCH_MIN_STRETCH = 0;
-static const util::floating_t TIME_STRETCH_MAX_STRETCH = 4;
-static const util::floating_t TIME_STRETCH_DEF_STRETCH = 1;
-static const util::floating_t TIME_STRETCH_NO_STRETCH  = TIME_STRETCH_DEF_STRETCH;
-static const jack_nframes_t   TIME_STRETCH_MAX_FLUSH   = 8192;
-
 class TimeStretch : public Generator {
 private:
 	soundtouch::TDStretch* time_stretch;
@@ -519,24 +1449,32 @@ private:
 	jack_nframes_t count;
 	TimeStretchType type;
 	jack::sample_t* silence;
-	jack_nframes_t flush_blocks;
-	bool flushed;
+	bool drained;
+	bool rendered;
 public:
 	TimeStretch( jack::Client* client, jack::BufferedSource* source ) :
 		Generator( client ),
 		time_stretch( soundtouch::TDStretch::newInstance() ), source( source ),
 		stretch( 1 ), count( 0 ), type( TIME_STRETCH_DEF_TYPE ),
-		silence( 0 ), flush_blocks( TIME_STRETCH_MAX_FLUSH / client->get_buffer_size() ),
-		flushed( true ) {
+		silence( 0 ), drained( true ), rendered( false ) {
 		time_stretch->setChannels( WAVE_MAX_CHANNELS );
 		time_stretch->enableQuickSeek( true );
 		time_stretch->setTempo( stretch );
+		// Each call hands out a block at most, so the buffers can be sized
+		// once for every preset and tempo: notes never allocate.
+		time_stretch->setOutputLimit( client->get_buffer_size() );
+		for ( int i = 0; i <= TIME_STRETCH_LAST_TYPE; ++i ) {
+			TimeStretchPreset& preset = TIME_STRETCH_PRESETS[i];
+			time_stretch->reserve( TIME_STRETCH_MAX_RATE,
+					preset.get_sequence(), preset.get_window(), preset.get_overlap(),
+					TIME_STRETCH_MIN_TEMPO, TIME_STRETCH_MAX_STRETCH, client->get_buffer_size() );
+		}
 		silence = new jack::sample_t[ client->get_buffer_size() ];
 		memset( silence, 0, client->get_data_size() );
 	}
 	virtual ~TimeStretch() {
 		delete time_stretch;
-		delete silence;
+		delete [] silence;
 	}
 	static TimeStretchType controller_to_stretch_type( unsigned char value ) {
 		return (TimeStretchType)( value / ( 128. / (util::floating_t)( TIME_STRETCH_LAST_TYPE + 1 ) ) );
@@ -549,36 +1487,45 @@ public:
 	}
 	void set_stretch( const util::floating_t& stretch ) {
     	this->stretch = util::adjust_value( stretch, TIME_STRETCH_MIN_STRETCH, TIME_STRETCH_MAX_STRETCH );
-    	time_stretch->setTempo( this->stretch );
+    	time_stretch->setTempo( std::max( this->stretch, TIME_STRETCH_MIN_TEMPO ) );
 	}
 	const util::floating_t& get_stretch() const {
 		return stretch;
 	}
+	// The source reads a render, stretched already: frames pass through.
+	void set_rendered( const bool& rendered ) {
+		this->rendered = rendered;
+	}
+	const bool& is_rendered() const {
+		return rendered;
+	}
 	bool is_finished() {
-		return time_stretch->numSamples() <= 0;
+		return rendered ? source->is_finished() : time_stretch->numSamples() <= 0;
 	}
 	jack_nframes_t get_sample_rate() {
 		return source->get_sample_rate();
 	}
 	void reset() {
-		flushed = false;
+		drained = false;
 		count = 0;
 		time_stretch->clear();
 		source->reset();
 		TimeStretchPreset& preset = TIME_STRETCH_PRESETS[ get_type() ];
-		time_stretch->setParameters( source->get_sample_rate(),
+		time_stretch->setParameters( std::min( source->get_sample_rate(), TIME_STRETCH_MAX_RATE ),
 				preset.get_sequence(), preset.get_window(), preset.get_overlap() );
 	}
 	jack_nframes_t receive( jack::sample_t** samples ) {
 		jack_nframes_t ret = 0;
-		if ( util::almost_equal( stretch, TIME_STRETCH_NO_STRETCH ) ) {
+		if ( rendered || util::almost_equal( stretch, TIME_STRETCH_NO_STRETCH ) ) {
 			count = 0;
 			time_stretch->clear();
 			ret = source->receive( samples );
 		} else {
 			jack::sample_t* origin;
-			jack_nframes_t buffer_size = get_client()->get_buffer_size();
+			jack_nframes_t buffer_size = get_client()->get_block_size();
 			time_stretch->receiveSamples( count );
+			// Works off the input left over at the limit before taking more.
+			time_stretch->putSamples( silence, 0 );
 			while ( time_stretch->numSamples() < buffer_size ) {
 				ret = source->receive( &origin );
 				if ( ret ) {
@@ -587,14 +1534,11 @@ public:
 					break;
 				}
 			}
-			if ( !( ret || flushed ) && ( time_stretch->numSamples() < buffer_size ) ) {
-				// flush object
-				jack_nframes_t last_count = time_stretch->numSamples();
-				for ( jack_nframes_t i = 0; i < flush_blocks
-					&& last_count == time_stretch->numSamples(); ++i ) {
-					time_stretch->putSamples( silence, buffer_size );
-				}
-				flushed = true;
+			if ( !( ret || drained ) && ( time_stretch->numSamples() < buffer_size ) ) {
+				// The end of the wave costs one pass, like any other period
+				// the stretch runs out in.
+				time_stretch->drain();
+				drained = true;
 			}
 			*samples = time_stretch->getOutput()->ptrBegin();
 			ret = count = time_stretch->numSamples() > buffer_size
@@ -609,51 +1553,387 @@ static const util::floating_t TUNER_MAX_TRANSPOSE = 48;
 static const util::floating_t TUNER_DEF_TRANSPOSE = 0;
 static const util::floating_t TUNER_NO_TRANSPOSE = 1;
 
+// How the tuner reads in between the frames of its source.
+enum TunerQuality {
+	TUNER_QUALITY_LINEAR = 0,
+	TUNER_QUALITY_HERMITE,
+	TUNER_QUALITY_SINC
+};
+
+static const TunerQuality TUNER_QUALITY_DEF_TYPE = TUNER_QUALITY_HERMITE;
+static const TunerQuality TUNER_QUALITY_LAST_TYPE = TUNER_QUALITY_SINC;
+
+// Source frames every output reads: three before its position and four
+// after, the widest kernel, so that all of them keep the same window.
+static const size_t TUNER_TAPS = 8;
+static const size_t TUNER_BEFORE = TUNER_TAPS / 2 - 1;
+static const size_t TUNER_AFTER = TUNER_TAPS - TUNER_BEFORE - 1;
+
+// The sinc kernel is a Kaiser windowed sinc tabulated at 64 fractional
+// positions and interpolated in between. It goes through the source frames
+// themselves, so whole steps are exact.
+static const size_t TUNER_PHASE_BITS = 6;
+static const size_t TUNER_PHASES = 1 << TUNER_PHASE_BITS;
+static const double TUNER_SINC_BETA = 7;
+
+class TunerTable {
+protected:
+	TunerTable() {
+		for ( size_t p = 0; p <= TUNER_PHASES; ++p ) {
+			double total = 0;
+			double taps[ TUNER_TAPS ];
+			for ( size_t k = 0; k < TUNER_TAPS; ++k ) {
+				// Distance from the output to the source frame of the tap.
+				double d = k - (double)TUNER_BEFORE - p / (double)TUNER_PHASES;
+				double x = util::PI * d;
+				taps[k] = ( d == 0 ? 1 : sin( x ) / x ) * kaiser( d / ( TUNER_AFTER + 1. ), TUNER_SINC_BETA );
+				total += taps[k];
+			}
+			for ( size_t k = 0; k < TUNER_TAPS; ++k ) {
+				sinc[p][k] = taps[k] / total;
+			}
+		}
+	}
+public:
+	util::floating_t sinc[ TUNER_PHASES + 1 ][ TUNER_TAPS ];
+	static const TunerTable& get_instance() {
+		static TunerTable instance;
+		return instance;
+	}
+};
+
+// Resamples its source to transpose it. The source blocks are gathered in
+// a short window and read at a fixed point position, which moves by the
+// ratio between both rates on every output.
+typedef void (*ResampleKernel)( const jack::sample_t* x, const jack_nframes_t* indexes, const uint32_t* fractions,
+		jack::sample_t* out, const jack_nframes_t& frames );
+
 class Tuner : public Generator {
 	jack::BufferedSource* source;
 	util::floating_t transpose;
 	util::floating_t ratio;
 	util::floating_t final_ratio;
-	SRC_STATE* state;
+	TunerQuality quality;
 	jack::sample_t* buffer;
+	jack::sample_t* window;
+	jack_nframes_t filled;
+	jack_nframes_t index;
+	uint32_t fraction;
+	jack_nframes_t step_index;
+	uint32_t step_fraction;
+	jack_nframes_t* indexes;
+	uint32_t* fractions;
+	bool drained;
 	bool finished;
-	static long callback( void* cb_data, jack::sample_t** data ) {
-		return ((Tuner*)cb_data)->on_data( data );
+	static util::floating_t to_floating( const uint32_t& fraction ) {
+		return ( fraction >> 8 ) * ( 1.f / ( 1 << 24 ) );
 	}
-protected:
-	long on_data( jack::sample_t** data ) {
-		return source->receive( data );
+	static void linear_frames( const jack::sample_t* x, const jack_nframes_t* indexes, const uint32_t* fractions,
+			jack::sample_t* out, jack_nframes_t n, const jack_nframes_t& frames ) {
+		for ( ; n < frames; ++n ) {
+			const jack::sample_t* s = x + indexes[n];
+			out[n] = s[0] + to_floating( fractions[n] ) * ( s[1] - s[0] );
+		}
+	}
+	// Four point, third order Hermite.
+	static void hermite_frames( const jack::sample_t* x, const jack_nframes_t* indexes, const uint32_t* fractions,
+			jack::sample_t* out, jack_nframes_t n, const jack_nframes_t& frames ) {
+		for ( ; n < frames; ++n ) {
+			const jack::sample_t* s = x + indexes[n];
+			util::floating_t f = to_floating( fractions[n] );
+			util::floating_t c1 = 0.5f * ( s[1] - s[-1] );
+			util::floating_t c2 = s[-1] - 2.5f * s[0] + 2.f * s[1] - 0.5f * s[2];
+			util::floating_t c3 = 0.5f * ( s[2] - s[-1] ) + 1.5f * ( s[0] - s[1] );
+			out[n] = ( ( c3 * f + c2 ) * f + c1 ) * f + s[0];
+		}
+	}
+	static void sinc_frames( const jack::sample_t* x, const jack_nframes_t* indexes, const uint32_t* fractions,
+			jack::sample_t* out, jack_nframes_t n, const jack_nframes_t& frames ) {
+		const TunerTable& table = TunerTable::get_instance();
+		for ( ; n < frames; ++n ) {
+			const jack::sample_t* s = x + indexes[n] - TUNER_BEFORE;
+			const util::floating_t* a = table.sinc[ fractions[n] >> ( 32 - TUNER_PHASE_BITS ) ];
+			const util::floating_t* b = a + TUNER_TAPS;
+			util::floating_t g = to_floating( fractions[n] << TUNER_PHASE_BITS );
+			util::floating_t sum = 0;
+			for ( size_t k = 0; k < TUNER_TAPS; ++k ) {
+				sum += ( a[k] + g * ( b[k] - a[k] ) ) * s[k];
+			}
+			out[n] = sum;
+		}
+	}
+	static void linear_scalar( const jack::sample_t* x, const jack_nframes_t* indexes, const uint32_t* fractions,
+			jack::sample_t* out, const jack_nframes_t& frames ) {
+		linear_frames( x, indexes, fractions, out, 0, frames );
+	}
+	static void hermite_scalar( const jack::sample_t* x, const jack_nframes_t* indexes, const uint32_t* fractions,
+			jack::sample_t* out, const jack_nframes_t& frames ) {
+		hermite_frames( x, indexes, fractions, out, 0, frames );
+	}
+	static void sinc_scalar( const jack::sample_t* x, const jack_nframes_t* indexes, const uint32_t* fractions,
+			jack::sample_t* out, const jack_nframes_t& frames ) {
+		sinc_frames( x, indexes, fractions, out, 0, frames );
+	}
+#if defined( __SSE2__ )
+	static void linear_sse2( const jack::sample_t* x, const jack_nframes_t* indexes, const uint32_t* fractions,
+			jack::sample_t* out, const jack_nframes_t& frames ) {
+		jack_nframes_t n = 0;
+		for ( ; n + 4 <= frames; n += 4 ) {
+			__m128 r0 = _mm_loadu_ps( x + indexes[ n ] );
+			__m128 r1 = _mm_loadu_ps( x + indexes[ n + 1 ] );
+			__m128 r2 = _mm_loadu_ps( x + indexes[ n + 2 ] );
+			__m128 r3 = _mm_loadu_ps( x + indexes[ n + 3 ] );
+			_MM_TRANSPOSE4_PS( r0, r1, r2, r3 );
+			__m128 f = _mm_set_ps( to_floating( fractions[ n + 3 ] ), to_floating( fractions[ n + 2 ] ),
+					to_floating( fractions[ n + 1 ] ), to_floating( fractions[ n ] ) );
+			_mm_storeu_ps( out + n, _mm_add_ps( r0, _mm_mul_ps( f, _mm_sub_ps( r1, r0 ) ) ) );
+		}
+		linear_frames( x, indexes, fractions, out, n, frames );
+	}
+	static void hermite_sse2( const jack::sample_t* x, const jack_nframes_t* indexes, const uint32_t* fractions,
+			jack::sample_t* out, const jack_nframes_t& frames ) {
+		const __m128 half = _mm_set1_ps( 0.5 );
+		const __m128 one_half = _mm_set1_ps( 1.5 );
+		const __m128 two = _mm_set1_ps( 2 );
+		const __m128 two_half = _mm_set1_ps( 2.5 );
+		jack_nframes_t n = 0;
+		for ( ; n + 4 <= frames; n += 4 ) {
+			// One row per output, transposed into one column per tap.
+			__m128 xm1 = _mm_loadu_ps( x + indexes[ n ] - 1 );
+			__m128 x0 = _mm_loadu_ps( x + indexes[ n + 1 ] - 1 );
+			__m128 x1 = _mm_loadu_ps( x + indexes[ n + 2 ] - 1 );
+			__m128 x2 = _mm_loadu_ps( x + indexes[ n + 3 ] - 1 );
+			_MM_TRANSPOSE4_PS( xm1, x0, x1, x2 );
+			__m128 f = _mm_set_ps( to_floating( fractions[ n + 3 ] ), to_floating( fractions[ n + 2 ] ),
+					to_floating( fractions[ n + 1 ] ), to_floating( fractions[ n ] ) );
+			__m128 c1 = _mm_mul_ps( half, _mm_sub_ps( x1, xm1 ) );
+			__m128 c2 = _mm_sub_ps( _mm_add_ps( xm1, _mm_mul_ps( two, x1 ) ),
+					_mm_add_ps( _mm_mul_ps( two_half, x0 ), _mm_mul_ps( half, x2 ) ) );
+			__m128 c3 = _mm_add_ps( _mm_mul_ps( half, _mm_sub_ps( x2, xm1 ) ),
+					_mm_mul_ps( one_half, _mm_sub_ps( x0, x1 ) ) );
+			__m128 y = _mm_add_ps( _mm_mul_ps( c3, f ), c2 );
+			y = _mm_add_ps( _mm_mul_ps( y, f ), c1 );
+			_mm_storeu_ps( out + n, _mm_add_ps( _mm_mul_ps( y, f ), x0 ) );
+		}
+		hermite_frames( x, indexes, fractions, out, n, frames );
+	}
+	static void sinc_sse2( const jack::sample_t* x, const jack_nframes_t* indexes, const uint32_t* fractions,
+			jack::sample_t* out, const jack_nframes_t& frames ) {
+		const TunerTable& table = TunerTable::get_instance();
+		jack_nframes_t n = 0;
+		for ( ; n + 4 <= frames; n += 4 ) {
+			__m128 sums[4];
+			for ( size_t k = 0; k < 4; ++k ) {
+				const jack::sample_t* s = x + indexes[ n + k ] - TUNER_BEFORE;
+				const util::floating_t* a = table.sinc[ fractions[ n + k ] >> ( 32 - TUNER_PHASE_BITS ) ];
+				const util::floating_t* b = a + TUNER_TAPS;
+				__m128 g = _mm_set1_ps( to_floating( fractions[ n + k ] << TUNER_PHASE_BITS ) );
+				__m128 low = _mm_loadu_ps( a );
+				__m128 high = _mm_loadu_ps( a + 4 );
+				low = _mm_add_ps( low, _mm_mul_ps( g, _mm_sub_ps( _mm_loadu_ps( b ), low ) ) );
+				high = _mm_add_ps( high, _mm_mul_ps( g, _mm_sub_ps( _mm_loadu_ps( b + 4 ), high ) ) );
+				sums[k] = _mm_add_ps( _mm_mul_ps( low, _mm_loadu_ps( s ) ), _mm_mul_ps( high, _mm_loadu_ps( s + 4 ) ) );
+			}
+			// The four partial sums of each output end up in one column.
+			_MM_TRANSPOSE4_PS( sums[0], sums[1], sums[2], sums[3] );
+			_mm_storeu_ps( out + n, _mm_add_ps( _mm_add_ps( sums[0], sums[1] ), _mm_add_ps( sums[2], sums[3] ) ) );
+		}
+		sinc_frames( x, indexes, fractions, out, n, frames );
+	}
+#endif
+#if defined( SIMD_X86 )
+	// Four samples from each of eight positions, transposed into one column
+	// per tap: outputs 0 to 3 in the low half and 4 to 7 in the high one.
+	static SIMD_AVX2_TARGET void columns_avx2( const jack::sample_t* x, const jack_nframes_t* indexes,
+			__m256* columns ) {
+		__m256 rows[4];
+		for ( size_t k = 0; k < 4; ++k ) {
+			rows[k] = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_loadu_ps( x + indexes[k] ) ),
+					_mm_loadu_ps( x + indexes[ k + 4 ] ), 1 );
+		}
+		__m256 t0 = _mm256_unpacklo_ps( rows[0], rows[1] );
+		__m256 t1 = _mm256_unpackhi_ps( rows[0], rows[1] );
+		__m256 t2 = _mm256_unpacklo_ps( rows[2], rows[3] );
+		__m256 t3 = _mm256_unpackhi_ps( rows[2], rows[3] );
+		columns[0] = _mm256_shuffle_ps( t0, t2, 0x44 );
+		columns[1] = _mm256_shuffle_ps( t0, t2, 0xEE );
+		columns[2] = _mm256_shuffle_ps( t1, t3, 0x44 );
+		columns[3] = _mm256_shuffle_ps( t1, t3, 0xEE );
+	}
+	// to_floating() of eight fractions.
+	static SIMD_AVX2_TARGET __m256 to_floating_avx2( const uint32_t* fractions ) {
+		__m256i f = _mm256_srli_epi32( _mm256_loadu_si256( (const __m256i*)fractions ), 8 );
+		return _mm256_mul_ps( _mm256_cvtepi32_ps( f ), _mm256_set1_ps( 1.f / ( 1 << 24 ) ) );
+	}
+	static SIMD_AVX2_TARGET void linear_avx2( const jack::sample_t* x, const jack_nframes_t* indexes,
+			const uint32_t* fractions, jack::sample_t* out, const jack_nframes_t& frames ) {
+		jack_nframes_t n = 0;
+		for ( ; n + 8 <= frames; n += 8 ) {
+			__m256 c[4];
+			columns_avx2( x, indexes + n, c );
+			__m256 f = to_floating_avx2( fractions + n );
+			_mm256_storeu_ps( out + n, _mm256_fmadd_ps( f, _mm256_sub_ps( c[1], c[0] ), c[0] ) );
+		}
+		linear_frames( x, indexes, fractions, out, n, frames );
+	}
+	static SIMD_AVX2_TARGET void hermite_avx2( const jack::sample_t* x, const jack_nframes_t* indexes,
+			const uint32_t* fractions, jack::sample_t* out, const jack_nframes_t& frames ) {
+		const __m256 half = _mm256_set1_ps( 0.5 );
+		const __m256 one_half = _mm256_set1_ps( 1.5 );
+		const __m256 two = _mm256_set1_ps( 2 );
+		const __m256 two_half = _mm256_set1_ps( 2.5 );
+		jack_nframes_t n = 0;
+		for ( ; n + 8 <= frames; n += 8 ) {
+			__m256 c[4];
+			columns_avx2( x - 1, indexes + n, c );
+			__m256 f = to_floating_avx2( fractions + n );
+			__m256 c1 = _mm256_mul_ps( half, _mm256_sub_ps( c[2], c[0] ) );
+			__m256 c2 = _mm256_sub_ps( _mm256_fmadd_ps( two, c[2], c[0] ),
+					_mm256_fmadd_ps( two_half, c[1], _mm256_mul_ps( half, c[3] ) ) );
+			__m256 c3 = _mm256_fmadd_ps( half, _mm256_sub_ps( c[3], c[0] ),
+					_mm256_mul_ps( one_half, _mm256_sub_ps( c[1], c[2] ) ) );
+			__m256 y = _mm256_fmadd_ps( c3, f, c2 );
+			y = _mm256_fmadd_ps( y, f, c1 );
+			_mm256_storeu_ps( out + n, _mm256_fmadd_ps( y, f, c[1] ) );
+		}
+		hermite_frames( x, indexes, fractions, out, n, frames );
+	}
+	// The eight taps of an output fill a register, the products of eight
+	// outputs are added up pairwise into one.
+	static SIMD_AVX2_TARGET void sinc_avx2( const jack::sample_t* x, const jack_nframes_t* indexes,
+			const uint32_t* fractions, jack::sample_t* out, const jack_nframes_t& frames ) {
+		const TunerTable& table = TunerTable::get_instance();
+		jack_nframes_t n = 0;
+		for ( ; n + 8 <= frames; n += 8 ) {
+			__m256 products[8];
+			for ( size_t k = 0; k < 8; ++k ) {
+				const jack::sample_t* s = x + indexes[ n + k ] - TUNER_BEFORE;
+				const util::floating_t* a = table.sinc[ fractions[ n + k ] >> ( 32 - TUNER_PHASE_BITS ) ];
+				__m256 g = _mm256_set1_ps( to_floating( fractions[ n + k ] << TUNER_PHASE_BITS ) );
+				__m256 low = _mm256_loadu_ps( a );
+				__m256 taps = _mm256_fmadd_ps( g, _mm256_sub_ps( _mm256_loadu_ps( a + TUNER_TAPS ), low ), low );
+				products[k] = _mm256_mul_ps( taps, _mm256_loadu_ps( s ) );
+			}
+			__m256 h01 = _mm256_hadd_ps( products[0], products[1] );
+			__m256 h23 = _mm256_hadd_ps( products[2], products[3] );
+			__m256 h45 = _mm256_hadd_ps( products[4], products[5] );
+			__m256 h67 = _mm256_hadd_ps( products[6], products[7] );
+			__m256 h0123 = _mm256_hadd_ps( h01, h23 );
+			__m256 h4567 = _mm256_hadd_ps( h45, h67 );
+			_mm256_storeu_ps( out + n, _mm256_add_ps( _mm256_permute2f128_ps( h0123, h4567, 0x20 ),
+					_mm256_permute2f128_ps( h0123, h4567, 0x31 ) ) );
+		}
+		sinc_frames( x, indexes, fractions, out, n, frames );
+	}
+#endif
+	static void linear( const jack::sample_t* x, const jack_nframes_t* indexes, const uint32_t* fractions,
+			jack::sample_t* out, const jack_nframes_t& frames ) {
+		static const simd::Kernel< ResampleKernel > kernel( linear_scalar, SIMD_SSE2_VARIANT( linear_sse2 ),
+				SIMD_X86_VARIANT( linear_avx2 ) );
+		kernel.get()( x, indexes, fractions, out, frames );
+	}
+	static void hermite( const jack::sample_t* x, const jack_nframes_t* indexes, const uint32_t* fractions,
+			jack::sample_t* out, const jack_nframes_t& frames ) {
+		static const simd::Kernel< ResampleKernel > kernel( hermite_scalar, SIMD_SSE2_VARIANT( hermite_sse2 ),
+				SIMD_X86_VARIANT( hermite_avx2 ) );
+		kernel.get()( x, indexes, fractions, out, frames );
+	}
+	static void sinc( const jack::sample_t* x, const jack_nframes_t* indexes, const uint32_t* fractions,
+			jack::sample_t* out, const jack_nframes_t& frames ) {
+		static const simd::Kernel< ResampleKernel > kernel( sinc_scalar, SIMD_SSE2_VARIANT( sinc_sse2 ),
+				SIMD_X86_VARIANT( sinc_avx2 ) );
+		kernel.get()( x, indexes, fractions, out, frames );
+	}
+	void retune() {
+		final_ratio = ratio
+				* ( get_client()->get_sample_rate() / (util::floating_t)source->get_sample_rate() );
+		double step = 1. / final_ratio;
+		step_index = (jack_nframes_t)step;
+		step_fraction = (uint32_t)( ( step - step_index ) * 4294967296. );
+	}
+	// Starts over with silence before the first frame.
+	void rewind() {
+		std::fill( window, window + TUNER_BEFORE, 0 );
+		filled = index = TUNER_BEFORE;
+		fraction = 0;
+		drained = false;
+	}
+	// Drops the frames no output reads anymore and appends the next
+	// source block, or the silence after the last one.
+	void fill() {
+		jack_nframes_t first = std::min( index - (jack_nframes_t)TUNER_BEFORE, filled );
+		std::copy( window + first, window + filled, window );
+		filled -= first;
+		index -= first;
+		jack::sample_t* origin;
+		jack_nframes_t received = source->receive( &origin );
+		if ( received ) {
+			std::copy( origin, origin + received, window + filled );
+			filled += received;
+		} else {
+			std::fill( window + filled, window + filled + TUNER_AFTER, 0 );
+			filled += TUNER_AFTER;
+			drained = true;
+		}
+	}
+	jack_nframes_t render( jack::sample_t* samples ) {
+		jack_nframes_t frames = get_client()->get_block_size();
+		jack_nframes_t done = 0;
+		while ( done < frames ) {
+			jack_nframes_t ready = 0;
+			while ( done + ready < frames && index + TUNER_AFTER < filled ) {
+				indexes[ ready ] = index;
+				fractions[ ready ] = fraction;
+				uint32_t last = fraction;
+				fraction += step_fraction;
+				index += step_index + ( fraction < last );
+				++ready;
+			}
+			if ( ready ) {
+				switch ( quality ) {
+				case TUNER_QUALITY_LINEAR:
+					linear( window, indexes, fractions, samples + done, ready );
+					break;
+				case TUNER_QUALITY_HERMITE:
+					hermite( window, indexes, fractions, samples + done, ready );
+					break;
+				case TUNER_QUALITY_SINC:
+					sinc( window, indexes, fractions, samples + done, ready );
+					break;
+				}
+				done += ready;
+			} else if ( drained ) {
+				break;
+			} else {
+				fill();
+			}
+		}
+		return done;
 	}
 public:
 	Tuner( jack::Client* client, jack::BufferedSource* source ) :
 		Generator( client ),
 		source( source ), transpose( TUNER_DEF_TRANSPOSE ),
 		ratio( TUNER_NO_TRANSPOSE ), final_ratio( TUNER_NO_TRANSPOSE ),
-		state( 0 ), finished( true ) {
-		int error;
-		state = src_callback_new( callback, SRC_ZERO_ORDER_HOLD, WAVE_MAX_CHANNELS, &error, this );
+		quality( TUNER_QUALITY_DEF_TYPE ),
+		step_index( 1 ), step_fraction( 0 ), finished( true ) {
 		buffer = new jack::sample_t[ client->get_buffer_size() ];
-		memset( buffer, 0, client->get_buffer_size() );
-		assert( state >= 0 );
-		/*
-          SRC_SINC_BEST_QUALITY       = 0,
-          SRC_SINC_MEDIUM_QUALITY     = 1,
-          SRC_SINC_FASTEST            = 2,
-          SRC_ZERO_ORDER_HOLD         = 3,
-          SRC_LINEAR                  = 4
-		 */
+		memset( buffer, 0, client->get_data_size() );
+		window = new jack::sample_t[ TUNER_TAPS + client->get_buffer_size() ];
+		indexes = new jack_nframes_t[ client->get_buffer_size() ];
+		fractions = new uint32_t[ client->get_buffer_size() ];
+		rewind();
 	}
 	~Tuner() {
-		src_delete( state );
-		delete buffer;
+		delete[] fractions;
+		delete[] indexes;
+		delete[] window;
+		delete[] buffer;
 	}
     void set_transpose( const util::floating_t& transpose ) {
     	this->transpose = util::adjust_value( transpose, TUNER_MIN_TRANSPOSE, TUNER_MAX_TRANSPOSE );
     	ratio = pow( 2., -this->transpose / 12. );
-    	final_ratio = ratio
-    			* ( get_client()->get_sample_rate() / (util::floating_t)source->get_sample_rate() );
-    	assert( src_is_valid_ratio( final_ratio ) );
-		src_set_ratio( state, final_ratio );
+    	retune();
     }
     const util::floating_t& get_transpose() const {
     	return transpose;
@@ -661,6 +1941,12 @@ public:
 	const util::floating_t& get_ratio() {
 		return ratio;
 	}
+	void set_quality( const TunerQuality& quality ) {
+		this->quality = quality;
+	}
+	const TunerQuality& get_quality() const {
+		return quality;
+	}
 	jack_nframes_t get_sample_rate() {
 		return get_client()->get_sample_rate();
 	}
@@ -669,17 +1955,17 @@ public:
 	}
 	void reset() {
 		finished = false;
-		final_ratio = ratio
-				* ( get_client()->get_sample_rate() / (util::floating_t)source->get_sample_rate() );
-		src_reset( state );
+		retune();
+		rewind();
 		source->reset();
 	}
 	jack_nframes_t receive( jack::sample_t** samples ) {
 		jack_nframes_t ret;
 		if ( util::almost_equal( final_ratio, TUNER_NO_TRANSPOSE ) ) {
 			ret = source->receive( samples );
+			rewind();
 		} else {
-			ret = src_callback_read( state, final_ratio, get_client()->get_buffer_size(), buffer );
+			ret = render( buffer );
 			*samples = buffer;
 		}
 		if ( ret <= 0 ) {
@@ -687,6 +1973,19 @@ public:
 		}
 		return ret;
 	}
+	// Renders straight into the block, without going through the buffer.
+	void filter( jack::sample_t* samples ) {
+		if ( util::almost_equal( final_ratio, TUNER_NO_TRANSPOSE ) ) {
+			Generator::filter( samples );
+			return;
+		}
+		jack_nframes_t received = render( samples );
+		std::fill( samples + received, samples + get_client()->get_block_size(), 0 );
+		if ( received <= 0 ) {
+			finished = true;
+		}
+		set_silent( received == 0 );
+	}
 };
 
 static const util::floating_t PANNER_MIN_PANNING = -1;
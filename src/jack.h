@@ -39,33 +39,22 @@ public:
     virtual void on_sample_rate( Client* client ) {}
     virtual void on_buffer_size( Client* client ) {}
     virtual void on_shutdown( Client* client ) {}
+    virtual void on_xrun( Client* client ) {}
 };
 
 typedef std::set<Listener*> ListenerSet;
 
+// Audio backend the engine runs on. It owns the ports and calls the
+// listeners once per period; how the periods are driven is up to the
+// implementation.
 class Client {
-    jack_client_t* jack_client;
     jack_nframes_t sample_rate;
     jack_nframes_t buffer_size;
     size_t data_size;
+    jack_nframes_t block_size;
+    size_t block_data_size;
     ListenerSet jack_listeners;
     std::string name;
-private:
-    static int callback_process( jack_nframes_t frames, void *arg ) {
-        ((Client*)arg)->on_process();
-        return 0;
-    }
-    static int callback_sample_rate( jack_nframes_t sample_rate, void *arg ) {
-        ((Client*)arg)->on_sample_rate( sample_rate );
-        return 0;
-    }
-    static int callback_buffer_size( jack_nframes_t buffer_size, void *arg ) {
-        ((Client*)arg)->on_buffer_size( buffer_size );
-        return 0;
-    }
-    static void callback_shutdown( void *arg ) {
-        ((Client*)arg)->on_shutdown();
-    }
 protected:
     void on_process() {
         fire_process();
@@ -81,6 +70,9 @@ protected:
     void on_shutdown() {
         fire_shutdown();
     }
+    void on_xrun() {
+        fire_xrun();
+    }
     void fire_process() {
     	ListenerSet::const_iterator it;
         for ( it = jack_listeners.begin(); it != jack_listeners.end(); ++it ) {
@@ -105,25 +97,30 @@ protected:
             (*it)->on_shutdown( this );
         }
     }
+    void fire_xrun() {
+    	ListenerSet::const_iterator it;
+        for ( it = jack_listeners.begin(); it != jack_listeners.end(); ++it ) {
+            (*it)->on_xrun( this );
+        }
+    }
 public:
     Client( const std::string& name ) :
-    	jack_client( jack_client_open( name.c_str(), JackNoStartServer, 0, 0 ) ), name( name ) {
-        assert( jack_client != 0 );
-        jack_set_process_callback( get_jack_client(), callback_process, this );
-        jack_set_sample_rate_callback( get_jack_client(), callback_sample_rate, this );
-        jack_on_shutdown( get_jack_client(), callback_shutdown, this );
-        set_sample_rate( jack_get_sample_rate( get_jack_client() ) );
-        set_buffer_size( jack_get_buffer_size( get_jack_client() ) );
-    }
-    virtual ~Client() {
-        jack_client_close( jack_client );
-    }
-    void activate() {
-    	jack_activate( jack_client );
-    }
-    void deactivate() {
-        jack_deactivate( jack_client );
-    }
+    	sample_rate( 0 ), buffer_size( 0 ), data_size( 0 ),
+    	block_size( 0 ), block_data_size( 0 ), name( name ) {}
+    virtual ~Client() {}
+    virtual void activate() = 0;
+    virtual void deactivate() = 0;
+    virtual jack_port_t* register_port( const std::string& name, const char* type, const unsigned long& flags ) = 0;
+    virtual void unregister_port( jack_port_t* port ) = 0;
+    virtual void* get_port_buffer( jack_port_t* port ) = 0;
+    // Connects an output to the index-th physical input, if there is one.
+    virtual void connect_physical( jack_port_t* port, const size_t& index ) {}
+    // Frame counter of the backend, and its value when the current
+    // period started.
+    virtual jack_nframes_t get_frame_time() const = 0;
+    virtual jack_nframes_t get_last_frame_time() const = 0;
+    virtual bool is_realtime() const { return false; }
+    virtual int get_realtime_priority() const { return -1; }
     const std::string& get_name() const {
     	return name;
     }
@@ -133,7 +130,6 @@ public:
     util::floating_t frames_to_time( const jack_nframes_t& frames ) {
     	return frames / (util::floating_t)get_sample_rate();
     }
-    jack_client_t* get_jack_client() const { return jack_client; }
     void add_jack_listener( Listener* jack_listener ) { jack_listeners.insert( jack_listener ); }
     void remove_jack_listener( Listener* jack_listener ) { jack_listeners.erase( jack_listener ); }
     void set_sample_rate( const jack_nframes_t& sample_rate ) { this->sample_rate = sample_rate; }
@@ -141,9 +137,98 @@ public:
     void set_buffer_size( const jack_nframes_t& buffer_size ) {
     	this->buffer_size = buffer_size;
     	data_size = buffer_size * sizeof( sample_t );
+    	set_block_size( buffer_size );
     }
     const jack_nframes_t& get_buffer_size() const { return buffer_size; }
     const size_t& get_data_size() const { return data_size; }
+    // Frames rendered at once. A period is split in several blocks when
+    // events fall inside it.
+    void set_block_size( const jack_nframes_t& block_size ) {
+    	this->block_size = block_size;
+    	block_data_size = block_size * sizeof( sample_t );
+    }
+    const jack_nframes_t& get_block_size() const { return block_size; }
+    const size_t& get_block_data_size() const { return block_data_size; }
+};
+
+// Client of a running JACK server, which calls it from its own thread.
+class JackClient : public Client {
+    jack_client_t* jack_client;
+private:
+    static int callback_process( jack_nframes_t frames, void *arg ) {
+        ((JackClient*)arg)->on_process();
+        return 0;
+    }
+    static int callback_sample_rate( jack_nframes_t sample_rate, void *arg ) {
+        ((JackClient*)arg)->on_sample_rate( sample_rate );
+        return 0;
+    }
+    static int callback_buffer_size( jack_nframes_t buffer_size, void *arg ) {
+        ((JackClient*)arg)->on_buffer_size( buffer_size );
+        return 0;
+    }
+    static void callback_shutdown( void *arg ) {
+        ((JackClient*)arg)->on_shutdown();
+    }
+    static int callback_xrun( void *arg ) {
+        ((JackClient*)arg)->on_xrun();
+        return 0;
+    }
+public:
+    JackClient( const std::string& name ) :
+    	Client( name ), jack_client( jack_client_open( name.c_str(), JackNoStartServer, 0, 0 ) ) {
+        assert( jack_client != 0 );
+        jack_set_process_callback( get_jack_client(), callback_process, this );
+        jack_set_sample_rate_callback( get_jack_client(), callback_sample_rate, this );
+        jack_on_shutdown( get_jack_client(), callback_shutdown, this );
+        jack_set_xrun_callback( get_jack_client(), callback_xrun, this );
+        set_sample_rate( jack_get_sample_rate( get_jack_client() ) );
+        set_buffer_size( jack_get_buffer_size( get_jack_client() ) );
+    }
+    ~JackClient() {
+        jack_client_close( jack_client );
+    }
+    void activate() {
+    	jack_activate( jack_client );
+    }
+    void deactivate() {
+        jack_deactivate( jack_client );
+    }
+    jack_port_t* register_port( const std::string& name, const char* type, const unsigned long& flags ) {
+    	return jack_port_register( jack_client, name.c_str(), type, flags, 0 );
+    }
+    void unregister_port( jack_port_t* port ) {
+    	jack_port_unregister( jack_client, port );
+    }
+    void* get_port_buffer( jack_port_t* port ) {
+    	return jack_port_get_buffer( port, get_buffer_size() );
+    }
+    void connect_physical( jack_port_t* port, const size_t& index ) {
+    	const char** ports;
+    	if ( ( ports = jack_get_ports( jack_client, 0, 0, JackPortIsPhysical | JackPortIsInput ) ) != 0 ) {
+    		size_t i = 0;
+    		while ( ports[i] != 0 && i < index ) {
+    			i++;
+    		}
+    		if ( ports[i] != 0 ) {
+    			jack_connect( jack_client, jack_port_name( port ), ports[i] );
+    		}
+    		jack_free( ports );
+    	}
+    }
+    jack_nframes_t get_frame_time() const {
+    	return jack_frame_time( jack_client );
+    }
+    jack_nframes_t get_last_frame_time() const {
+    	return jack_last_frame_time( jack_client );
+    }
+    bool is_realtime() const {
+    	return jack_is_realtime( jack_client );
+    }
+    int get_realtime_priority() const {
+    	return jack_client_real_time_priority( jack_client );
+    }
+    jack_client_t* get_jack_client() const { return jack_client; }
 };
 
 class Port {
@@ -154,7 +239,7 @@ protected:
     void set_jack_port( jack_port_t* jack_port ) { this->jack_port = jack_port; }
 public:
 	Port( Client* client ) : client( client ), jack_port( 0 ) {}
-	virtual ~Port() { jack_port_unregister( client->get_jack_client(), jack_port ); }
+	virtual ~Port() { client->unregister_port( jack_port ); }
     jack_port_t* get_jack_port() const { return jack_port; }
 };
 
@@ -163,16 +248,15 @@ public:
 	AudioPort( Client* client ) : Port( client ) {}
 	~AudioPort() {}
     sample_t* get_buffer() const {
-    	return (sample_t*)jack_port_get_buffer( get_jack_port(), get_client()->get_buffer_size() );
+    	return (sample_t*)get_client()->get_port_buffer( get_jack_port() );
     }
 };
 
 class AudioOutput : public AudioPort {
 public:
     AudioOutput( Client* client, const std::string& name ) : AudioPort( client ) {
-        set_jack_port( jack_port_register(
-        		get_client()->get_jack_client(),
-        		name.c_str(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput | JackPortIsTerminal, 0 ) );
+        set_jack_port( get_client()->register_port(
+        		name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput | JackPortIsTerminal ) );
         assert( get_jack_port() != 0 );
     }
     ~AudioOutput() {}
@@ -181,9 +265,8 @@ public:
 class AudioInput : public AudioPort {
 public:
 	AudioInput( Client* client, const std::string& name ) : AudioPort( client ) {
-        set_jack_port( jack_port_register(
-        		get_client()->get_jack_client(),
-        		name.c_str(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0 ) );
+        set_jack_port( get_client()->register_port(
+        		name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput ) );
         assert( get_jack_port() != 0 );
     }
 	~AudioInput() {}
@@ -0,0 +1,74 @@
+/**
+ * This file is part of repulse.
+ * (c) 2010 and onwards Juan Carlos Rodrigo Garcia.
+ *
+ * repulse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * repulse is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with repulse.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JACKMIDI_H_
+#define JACKMIDI_H_
+
+#include <cassert>
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include "jack.h"
+#include "midi.h"
+#include "alsa.h"
+
+namespace jack {
+
+// MIDI read from a JACK port. Every event comes with its frame inside the
+// current period, so it is fired right there, and reading the port does
+// not enter the kernel.
+class MidiInput : public Port, public alsa::IMidiInput {
+	void* buffer;
+	jack_nframes_t count;
+	jack_nframes_t index;
+	snd_seq_event_t event;
+public:
+	MidiInput( Client* client, const std::string& name ) :
+		Port( client ), alsa::IMidiInput( 0 ), buffer( 0 ), count( 0 ), index( 0 ) {
+        set_jack_port( get_client()->register_port(
+        		name, JACK_DEFAULT_MIDI_TYPE, JackPortIsInput ) );
+        assert( get_jack_port() != 0 );
+	}
+	~MidiInput() {}
+	void begin() {
+		buffer = get_client()->get_port_buffer( get_jack_port() );
+		count = jack_midi_get_event_count( buffer );
+		index = 0;
+	}
+	jack_nframes_t next( const jack_nframes_t& offset ) {
+		jack_nframes_t frames = get_client()->get_buffer_size();
+		jack_midi_event_t raw;
+		midi::Event wrapper;
+		*wrapper.get_event_ex() = &event;
+		for ( ; index < count; ++index ) {
+			if ( jack_midi_event_get( &raw, buffer, index ) != 0 ) {
+				continue;
+			}
+			if ( raw.time > offset ) {
+				return raw.time < frames ? raw.time : frames;
+			}
+			if ( midi::decode( raw.buffer, raw.size, event ) ) {
+				fire( wrapper );
+			}
+		}
+		return frames;
+	}
+};
+
+} // namespace jack
+
+#endif /* JACKMIDI_H_ */
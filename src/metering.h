@@ -0,0 +1,164 @@
+/**
+ * This file is part of repulse.
+ * (c) 2010 and onwards Juan Carlos Rodrigo Garcia.
+ *
+ * repulse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * repulse is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with repulse.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef METERING_H_
+#define METERING_H_
+
+#include <ostream>
+#include <iomanip>
+#include <climits>
+#include <time.h>
+#include "jack.h"
+
+namespace metering {
+
+// Load histogram in thousandths of the period; the last bucket counts
+// every period that took twice its time or more.
+static const size_t HISTOGRAM_SIZE = 2001;
+static const double PERCENTILE = 0.99;
+
+typedef unsigned long long nanoseconds_t;
+
+static inline nanoseconds_t now() {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Lock free counters of the time spent processing. Periods are only
+// added by the process thread, voices by the crew and xruns by the
+// backend; anyone may read them.
+class Load {
+	volatile nanoseconds_t count;
+	volatile nanoseconds_t total;
+	volatile nanoseconds_t min;
+	volatile nanoseconds_t max;
+	volatile nanoseconds_t period;
+	volatile int peak;
+	volatile int xruns;
+	volatile nanoseconds_t voice_count;
+	volatile nanoseconds_t voice_total;
+	volatile nanoseconds_t voice_max;
+	volatile nanoseconds_t histogram[ HISTOGRAM_SIZE ];
+public:
+	Load() :
+		count( 0 ), total( 0 ), min( ULLONG_MAX ), max( 0 ), period( 0 ),
+		peak( 0 ), xruns( 0 ), voice_count( 0 ), voice_total( 0 ), voice_max( 0 ) {
+		for ( size_t i = 0; i < HISTOGRAM_SIZE; ++i ) {
+			histogram[i] = 0;
+		}
+	}
+	~Load() {}
+	// Time spent in one period of the given frames.
+	void add_process( const nanoseconds_t& elapsed, const jack_nframes_t& frames, const jack_nframes_t& sample_rate ) {
+		period = frames * 1000000000ULL / sample_rate;
+		size_t bucket = period ? elapsed * 1000 / period : 0;
+		if ( bucket >= HISTOGRAM_SIZE ) {
+			bucket = HISTOGRAM_SIZE - 1;
+		}
+		histogram[ bucket ]++;
+		int percent = bucket / 10;
+		total += elapsed;
+		if ( elapsed < min ) {
+			min = elapsed;
+		}
+		if ( elapsed > max ) {
+			max = elapsed;
+		}
+		count++;
+		int last = peak;
+		while ( percent > last && !__sync_bool_compare_and_swap( &peak, last, percent ) ) {
+			last = peak;
+		}
+	}
+	// Time spent rendering one voice for one block.
+	void add_voice( const nanoseconds_t& elapsed ) {
+		__sync_fetch_and_add( &voice_total, elapsed );
+		__sync_fetch_and_add( &voice_count, 1 );
+		nanoseconds_t last = voice_max;
+		while ( elapsed > last && !__sync_bool_compare_and_swap( &voice_max, last, elapsed ) ) {
+			last = voice_max;
+		}
+	}
+	void add_xrun() {
+		__sync_add_and_fetch( &xruns, 1 );
+	}
+	// Highest load in percents since the last call.
+	int take_peak() {
+		return __sync_lock_test_and_set( &peak, 0 );
+	}
+	int get_xruns() const {
+		return xruns;
+	}
+	nanoseconds_t get_count() const {
+		return count;
+	}
+	nanoseconds_t get_min() const {
+		return count ? min : 0;
+	}
+	nanoseconds_t get_max() const {
+		return max;
+	}
+	nanoseconds_t get_mean() const {
+		return count ? total / count : 0;
+	}
+	nanoseconds_t get_period() const {
+		return period;
+	}
+	// Load in percents below which the given fraction of the periods fall.
+	double get_percentile( const double& fraction ) const {
+		nanoseconds_t seen = 0;
+		nanoseconds_t wanted = count * fraction;
+		size_t i;
+		for ( i = 0; i < HISTOGRAM_SIZE - 1; ++i ) {
+			seen += histogram[i];
+			if ( seen > wanted ) {
+				break;
+			}
+		}
+		return ( i + 1 ) / 10.;
+	}
+	nanoseconds_t get_voice_count() const {
+		return voice_count;
+	}
+	nanoseconds_t get_voice_mean() const {
+		return voice_count ? voice_total / voice_count : 0;
+	}
+	nanoseconds_t get_voice_max() const {
+		return voice_max;
+	}
+	void dump( std::ostream& out ) const {
+		const double us = 1000;
+		double p = get_percentile( PERCENTILE );
+		out << std::fixed << std::setprecision( 1 );
+		out << "process: " << get_count() << " periods of " << get_period() / us << " us" << std::endl;
+		out << "  time min " << get_min() / us << " us, mean " << get_mean() / us
+				<< " us, p99 " << p * get_period() / 100 / us << " us, max " << get_max() / us << " us" << std::endl;
+		if ( get_period() ) {
+			out << "  load mean " << 100. * get_mean() / get_period() << "%, p99 " << p
+					<< "%, max " << 100. * get_max() / get_period() << "%" << std::endl;
+		}
+		out << "xruns: " << get_xruns() << std::endl;
+		out << "voices: " << get_voice_count() << " blocks, mean " << get_voice_mean() / us
+				<< " us, max " << get_voice_max() / us << " us" << std::endl;
+	}
+};
+
+} // namespace metering
+
+#endif /* METERING_H_ */
@@ -196,6 +196,55 @@ public:
 	}
 };
 
+// Translates a raw MIDI message to the sequencer event ALSA would have
+// delivered for it.
+static inline bool decode( const unsigned char* data, const size_t& size, snd_seq_event_t& event ) {
+	if ( size < 2 ) {
+		return false;
+	}
+	memset( &event, 0, sizeof( event ) );
+	event.data.control.channel = data[0] & 0x0F;
+	switch ( data[0] & 0xF0 ) {
+	case 0x80:
+	case 0x90:
+	case 0xA0:
+		if ( size < 3 ) {
+			return false;
+		}
+		event.type = ( data[0] & 0xF0 ) == 0x80 ? SND_SEQ_EVENT_NOTEOFF
+				: ( ( data[0] & 0xF0 ) == 0x90 ? SND_SEQ_EVENT_NOTEON : SND_SEQ_EVENT_KEYPRESS );
+		event.data.note.note = data[1];
+		event.data.note.velocity = data[2];
+		break;
+	case 0xB0:
+		if ( size < 3 ) {
+			return false;
+		}
+		event.type = SND_SEQ_EVENT_CONTROLLER;
+		event.data.control.param = data[1];
+		event.data.control.value = data[2];
+		break;
+	case 0xC0:
+		event.type = SND_SEQ_EVENT_PGMCHANGE;
+		event.data.control.value = data[1];
+		break;
+	case 0xD0:
+		event.type = SND_SEQ_EVENT_CHANPRESS;
+		event.data.control.value = data[1];
+		break;
+	case 0xE0:
+		if ( size < 3 ) {
+			return false;
+		}
+		event.type = SND_SEQ_EVENT_PITCHBEND;
+		event.data.control.value = ( ( data[2] << 7 ) | data[1] ) + MIN_PITCH;
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
 } // namespace midi
 
 #endif /* MIDI_H_ */
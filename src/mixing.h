@@ -0,0 +1,169 @@
+/**
+ * This file is part of repulse.
+ * (c) 2010 and onwards Juan Carlos Rodrigo Garcia.
+ *
+ * repulse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * repulse is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with repulse.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MIXING_H_
+#define MIXING_H_
+
+#include <cassert>
+#include <cstring>
+#include "jack.h"
+#include "util.h"
+#include "simd.h"
+
+namespace mixing {
+
+static const size_t MAX_SOURCES = util::MAX_VOICES;
+
+typedef void (*MixKernel)( const jack::sample_t* const* sources, const util::floating_t* mix_left,
+		const util::floating_t* mix_right, const size_t& count,
+		jack::sample_t* left, jack::sample_t* right, const jack_nframes_t& frames );
+
+// Frames from i on, one at a time; the vector kernels end with it.
+static inline void mix_frames( const jack::sample_t* const* sources, const util::floating_t* mix_left,
+		const util::floating_t* mix_right, const size_t& count,
+		jack::sample_t* left, jack::sample_t* right, jack_nframes_t i, const jack_nframes_t& frames ) {
+	for ( ; i < frames; ++i ) {
+		jack::sample_t sum_left = 0;
+		jack::sample_t sum_right = 0;
+		for ( size_t s = 0; s < count; ++s ) {
+			sum_left += sources[s][i] * mix_left[s];
+			sum_right += sources[s][i] * mix_right[s];
+		}
+		left[i] = sum_left;
+		right[i] = sum_right;
+	}
+}
+
+static void mix_scalar( const jack::sample_t* const* sources, const util::floating_t* mix_left,
+		const util::floating_t* mix_right, const size_t& count,
+		jack::sample_t* left, jack::sample_t* right, const jack_nframes_t& frames ) {
+	mix_frames( sources, mix_left, mix_right, count, left, right, 0, frames );
+}
+
+#if defined( __SSE2__ )
+static void mix_sse2( const jack::sample_t* const* sources, const util::floating_t* mix_left,
+		const util::floating_t* mix_right, const size_t& count,
+		jack::sample_t* left, jack::sample_t* right, const jack_nframes_t& frames ) {
+	__m128 gains_left[ MAX_SOURCES ];
+	__m128 gains_right[ MAX_SOURCES ];
+	jack_nframes_t i = 0;
+	size_t s;
+	for ( s = 0; s < count; ++s ) {
+		gains_left[s] = _mm_set1_ps( mix_left[s] );
+		gains_right[s] = _mm_set1_ps( mix_right[s] );
+	}
+	for ( ; i + 4 <= frames; i += 4 ) {
+		__m128 sum_left = _mm_setzero_ps();
+		__m128 sum_right = _mm_setzero_ps();
+		for ( s = 0; s < count; ++s ) {
+			__m128 x = _mm_loadu_ps( sources[s] + i );
+			sum_left = _mm_add_ps( sum_left, _mm_mul_ps( x, gains_left[s] ) );
+			sum_right = _mm_add_ps( sum_right, _mm_mul_ps( x, gains_right[s] ) );
+		}
+		_mm_storeu_ps( left + i, sum_left );
+		_mm_storeu_ps( right + i, sum_right );
+	}
+	mix_frames( sources, mix_left, mix_right, count, left, right, i, frames );
+}
+#endif
+
+#if defined( SIMD_X86 )
+static SIMD_AVX2_TARGET void mix_avx2( const jack::sample_t* const* sources, const util::floating_t* mix_left,
+		const util::floating_t* mix_right, const size_t& count,
+		jack::sample_t* left, jack::sample_t* right, const jack_nframes_t& frames ) {
+	__m256 gains_left[ MAX_SOURCES ];
+	__m256 gains_right[ MAX_SOURCES ];
+	jack_nframes_t i = 0;
+	size_t s;
+	for ( s = 0; s < count; ++s ) {
+		gains_left[s] = _mm256_set1_ps( mix_left[s] );
+		gains_right[s] = _mm256_set1_ps( mix_right[s] );
+	}
+	for ( ; i + 8 <= frames; i += 8 ) {
+		__m256 sum_left = _mm256_setzero_ps();
+		__m256 sum_right = _mm256_setzero_ps();
+		for ( s = 0; s < count; ++s ) {
+			__m256 x = _mm256_loadu_ps( sources[s] + i );
+			sum_left = _mm256_fmadd_ps( x, gains_left[s], sum_left );
+			sum_right = _mm256_fmadd_ps( x, gains_right[s], sum_right );
+		}
+		_mm256_storeu_ps( left + i, sum_left );
+		_mm256_storeu_ps( right + i, sum_right );
+	}
+	mix_frames( sources, mix_left, mix_right, count, left, right, i, frames );
+}
+
+static SIMD_AVX512_TARGET void mix_avx512( const jack::sample_t* const* sources, const util::floating_t* mix_left,
+		const util::floating_t* mix_right, const size_t& count,
+		jack::sample_t* left, jack::sample_t* right, const jack_nframes_t& frames ) {
+	jack_nframes_t i = 0;
+	size_t s;
+	for ( ; i + 16 <= frames; i += 16 ) {
+		__m512 sum_left = _mm512_setzero_ps();
+		__m512 sum_right = _mm512_setzero_ps();
+		for ( s = 0; s < count; ++s ) {
+			__m512 x = _mm512_loadu_ps( sources[s] + i );
+			sum_left = _mm512_fmadd_ps( x, _mm512_set1_ps( mix_left[s] ), sum_left );
+			sum_right = _mm512_fmadd_ps( x, _mm512_set1_ps( mix_right[s] ), sum_right );
+		}
+		_mm512_storeu_ps( left + i, sum_left );
+		_mm512_storeu_ps( right + i, sum_right );
+	}
+	mix_frames( sources, mix_left, mix_right, count, left, right, i, frames );
+}
+#endif
+
+// Accumulates every source into both channels in a single pass over the
+// frames: the outputs are written once and the sources are read once.
+class StereoMix {
+	const jack::sample_t* sources[ MAX_SOURCES ];
+	util::floating_t mix_left[ MAX_SOURCES ];
+	util::floating_t mix_right[ MAX_SOURCES ];
+	size_t count;
+public:
+	StereoMix() : count( 0 ) {}
+	virtual ~StereoMix() {}
+	void clear() {
+		count = 0;
+	}
+	void add( const jack::sample_t* source,
+			const util::floating_t& mix_left, const util::floating_t& mix_right ) {
+		assert( count < MAX_SOURCES );
+		this->sources[ count ] = source;
+		this->mix_left[ count ] = mix_left;
+		this->mix_right[ count ] = mix_right;
+		count++;
+	}
+	const size_t& get_count() const {
+		return count;
+	}
+	void mix( jack::sample_t* left, jack::sample_t* right, const jack_nframes_t& frames ) const {
+		static const simd::Kernel< MixKernel > kernel( mix_scalar, SIMD_SSE2_VARIANT( mix_sse2 ),
+				SIMD_X86_VARIANT( mix_avx2 ), SIMD_X86_VARIANT( mix_avx512 ) );
+		if ( count == 0 ) {
+			memset( left, 0, frames * sizeof( jack::sample_t ) );
+			memset( right, 0, frames * sizeof( jack::sample_t ) );
+			return;
+		}
+		kernel.get()( sources, mix_left, mix_right, count, left, right, frames );
+	}
+};
+
+} // namespace mixing
+
+#endif /* MIXING_H_ */
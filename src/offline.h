@@ -0,0 +1,433 @@
+/**
+ * This file is part of repulse.
+ * (c) 2010 and onwards Juan Carlos Rodrigo Garcia.
+ *
+ * repulse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * repulse is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with repulse.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OFFLINE_H_
+#define OFFLINE_H_
+
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <sndfile.hh>
+#include "jack.h"
+#include "midi.h"
+#include "alsa.h"
+#include "repulse.h"
+
+namespace offline {
+
+static const jack_nframes_t   DEF_SAMPLE_RATE = 48000;
+static const jack_nframes_t   DEF_BUFFER_SIZE = 256;
+static const util::floating_t MAX_TAIL = 10;
+static const unsigned long    DEF_TEMPO = 500000;
+static const size_t           MAX_MESSAGE = 3;
+
+struct PortBuffer {
+	std::string name;
+	unsigned long flags;
+	jack::sample_t* buffer;
+};
+
+typedef std::vector<PortBuffer*> PortBuffers;
+
+// Backend without a server: the ports are plain buffers and the periods
+// are run back to back by process(), as fast as they can be rendered.
+class Client : public jack::Client {
+	PortBuffers ports;
+	jack_nframes_t frame_time;
+	bool active;
+public:
+	Client( const std::string& name,
+			const jack_nframes_t& sample_rate = DEF_SAMPLE_RATE,
+			const jack_nframes_t& buffer_size = DEF_BUFFER_SIZE ) :
+		jack::Client( name ), frame_time( 0 ), active( false ) {
+		set_sample_rate( sample_rate );
+		set_buffer_size( buffer_size );
+	}
+	~Client() {
+		PortBuffers::iterator it;
+		for ( it = ports.begin(); it != ports.end(); ++it ) {
+			delete [] (*it)->buffer;
+			delete *it;
+		}
+	}
+	void activate() {
+		active = true;
+	}
+	void deactivate() {
+		active = false;
+	}
+	jack_port_t* register_port( const std::string& name, const char* type, const unsigned long& flags ) {
+		// Only audio is carried, MIDI comes from a file.
+		if ( strcmp( type, JACK_DEFAULT_AUDIO_TYPE ) != 0 ) {
+			return 0;
+		}
+		PortBuffer* port = new PortBuffer();
+		port->name = name;
+		port->flags = flags;
+		port->buffer = new jack::sample_t[ get_buffer_size() ];
+		memset( port->buffer, 0, get_data_size() );
+		ports.push_back( port );
+		// The handle is only ever given back to this client.
+		return (jack_port_t*)port;
+	}
+	void unregister_port( jack_port_t* port ) {
+		PortBuffers::iterator it = std::find( ports.begin(), ports.end(), (PortBuffer*)port );
+		if ( it != ports.end() ) {
+			delete [] (*it)->buffer;
+			delete *it;
+			ports.erase( it );
+		}
+	}
+	void* get_port_buffer( jack_port_t* port ) {
+		return ((PortBuffer*)port)->buffer;
+	}
+	jack_nframes_t get_frame_time() const {
+		return frame_time;
+	}
+	jack_nframes_t get_last_frame_time() const {
+		return frame_time;
+	}
+	const PortBuffer* find_port( const std::string& name ) const {
+		PortBuffers::const_iterator it;
+		for ( it = ports.begin(); it != ports.end(); ++it ) {
+			if ( (*it)->name == name ) {
+				return *it;
+			}
+		}
+		return 0;
+	}
+	// Runs one period.
+	void process() {
+		if ( active ) {
+			on_process();
+		}
+		frame_time += get_buffer_size();
+	}
+};
+
+struct TimedMessage {
+	unsigned long tick;
+	jack_nframes_t frame;
+	size_t size;
+	unsigned char data[ MAX_MESSAGE ];
+};
+
+typedef std::vector<TimedMessage> TimedMessages;
+
+struct TempoChange {
+	unsigned long tick;
+	unsigned long tempo;
+};
+
+typedef std::vector<TempoChange> TempoChanges;
+
+static bool tick_less( const TimedMessage& a, const TimedMessage& b ) {
+	return a.tick < b.tick;
+}
+
+static bool tempo_less( const TempoChange& a, const TempoChange& b ) {
+	return a.tick < b.tick;
+}
+
+// Standard MIDI File, format 0 or 1. The channel messages of every track
+// are merged and placed on frames through the tempo map; system exclusive
+// and meta events other than the tempo are skipped.
+class MidiFile {
+	TimedMessages messages;
+	TempoChanges tempos;
+	unsigned short division;
+protected:
+	static unsigned long read_number( const unsigned char* data, const size_t& size ) {
+		unsigned long ret = 0;
+		for ( size_t i = 0; i < size; ++i ) {
+			ret = ( ret << 8 ) | data[i];
+		}
+		return ret;
+	}
+	static bool read_variable( const std::vector<unsigned char>& data, size_t& pos, const size_t& end,
+			unsigned long& value ) {
+		value = 0;
+		for ( size_t i = 0; i < 4; ++i ) {
+			if ( pos >= end ) {
+				return false;
+			}
+			unsigned char byte = data[ pos++ ];
+			value = ( value << 7 ) | ( byte & 0x7F );
+			if ( !( byte & 0x80 ) ) {
+				return true;
+			}
+		}
+		return false;
+	}
+	bool read_track( const std::vector<unsigned char>& data, size_t pos, const size_t& end ) {
+		unsigned long tick = 0;
+		unsigned long delta;
+		unsigned long length;
+		unsigned char status = 0;
+		while ( pos < end ) {
+			if ( !read_variable( data, pos, end, delta ) || pos >= end ) {
+				return false;
+			}
+			tick += delta;
+			if ( data[ pos ] & 0x80 ) {
+				status = data[ pos++ ];
+			} else if ( status == 0 ) {
+				return false;
+			}
+			if ( status == 0xFF ) {
+				// Meta event, status is not kept running after it.
+				if ( pos >= end ) {
+					return false;
+				}
+				unsigned char type = data[ pos++ ];
+				if ( !read_variable( data, pos, end, length ) || pos + length > end ) {
+					return false;
+				}
+				if ( type == 0x51 && length == 3 ) {
+					TempoChange change;
+					change.tick = tick;
+					change.tempo = read_number( &data[ pos ], 3 );
+					tempos.push_back( change );
+				} else if ( type == 0x2F ) {
+					return true;
+				}
+				pos += length;
+				status = 0;
+			} else if ( status == 0xF0 || status == 0xF7 ) {
+				if ( !read_variable( data, pos, end, length ) || pos + length > end ) {
+					return false;
+				}
+				pos += length;
+				status = 0;
+			} else {
+				TimedMessage message;
+				size_t size = ( status & 0xE0 ) == 0xC0 ? 2 : 3;
+				if ( pos + size - 1 > end ) {
+					return false;
+				}
+				message.tick = tick;
+				message.frame = 0;
+				message.size = size;
+				message.data[0] = status;
+				for ( size_t i = 1; i < size; ++i ) {
+					message.data[i] = data[ pos++ ];
+				}
+				messages.push_back( message );
+			}
+		}
+		return true;
+	}
+	void place( const jack_nframes_t& sample_rate ) {
+		// Ticks are turned into seconds one tempo segment at a time.
+		TimedMessages::iterator it;
+		TempoChanges::const_iterator tempo = tempos.begin();
+		unsigned long current = DEF_TEMPO;
+		unsigned long last_tick = 0;
+		double last_time = 0;
+		double ticks_per_second = 0;
+		if ( division & 0x8000 ) {
+			// SMPTE time: frames per second times ticks per frame.
+			ticks_per_second = (double)( 256 - ( division >> 8 ) ) * ( division & 0xFF );
+		}
+		for ( it = messages.begin(); it != messages.end(); ++it ) {
+			while ( tempo != tempos.end() && tempo->tick <= it->tick ) {
+				last_time += to_seconds( tempo->tick - last_tick, current, ticks_per_second );
+				last_tick = tempo->tick;
+				current = tempo->tempo;
+				++tempo;
+			}
+			double seconds = last_time + to_seconds( it->tick - last_tick, current, ticks_per_second );
+			it->frame = (jack_nframes_t)( seconds * sample_rate + 0.5 );
+		}
+	}
+	double to_seconds( const unsigned long& ticks, const unsigned long& tempo, const double& ticks_per_second ) const {
+		if ( ticks_per_second > 0 ) {
+			return ticks / ticks_per_second;
+		}
+		return ticks * ( tempo / 1000000.0 ) / division;
+	}
+public:
+	MidiFile() : division( 0 ) {}
+	virtual ~MidiFile() {}
+	bool load( const std::string& file_name, const jack_nframes_t& sample_rate ) {
+		std::ifstream in( file_name.c_str(), std::ios::in | std::ios::binary );
+		std::vector<unsigned char> data;
+		size_t pos = 0;
+		size_t tracks;
+		messages.clear();
+		tempos.clear();
+		if ( !in ) {
+			return false;
+		}
+		data.assign( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+		if ( data.size() < 14 || memcmp( &data[0], "MThd", 4 ) != 0 ) {
+			return false;
+		}
+		tracks = read_number( &data[10], 2 );
+		division = read_number( &data[12], 2 );
+		if ( division == 0 ) {
+			return false;
+		}
+		pos = 8 + read_number( &data[4], 4 );
+		for ( size_t i = 0; i < tracks && pos + 8 <= data.size(); ++i ) {
+			size_t length = read_number( &data[ pos + 4 ], 4 );
+			size_t end = pos + 8 + length;
+			if ( end > data.size() ) {
+				return false;
+			}
+			if ( memcmp( &data[ pos ], "MTrk", 4 ) == 0 && !read_track( data, pos + 8, end ) ) {
+				return false;
+			}
+			pos = end;
+		}
+		// Events on the same tick keep the order of their tracks.
+		std::stable_sort( messages.begin(), messages.end(), tick_less );
+		std::stable_sort( tempos.begin(), tempos.end(), tempo_less );
+		place( sample_rate );
+		return true;
+	}
+	const TimedMessages& get_messages() const {
+		return messages;
+	}
+};
+
+// Plays the messages of a MIDI file at their frame.
+class MidiInput : public alsa::IMidiInput {
+	Client* client;
+	const TimedMessages& messages;
+	size_t index;
+	jack_nframes_t start;
+	snd_seq_event_t event;
+public:
+	MidiInput( Client* client, const MidiFile& file ) :
+		alsa::IMidiInput( 0 ), client( client ), messages( file.get_messages() ), index( 0 ), start( 0 ) {}
+	~MidiInput() {}
+	void begin() {
+		start = client->get_last_frame_time();
+	}
+	jack_nframes_t next( const jack_nframes_t& offset ) {
+		jack_nframes_t frames = client->get_buffer_size();
+		midi::Event wrapper;
+		*wrapper.get_event_ex() = &event;
+		for ( ; index < messages.size(); ++index ) {
+			const TimedMessage& message = messages[ index ];
+			if ( message.frame > start + offset ) {
+				return message.frame - start < frames ? message.frame - start : frames;
+			}
+			if ( midi::decode( message.data, message.size, event ) ) {
+				fire( wrapper );
+			}
+		}
+		return frames;
+	}
+	bool is_finished() const {
+		return index >= messages.size();
+	}
+};
+
+struct Track {
+	SndfileHandle file;
+	const PortBuffer* left;
+	const PortBuffer* right;
+};
+
+typedef std::vector<Track> Tracks;
+
+// Writes output ports to WAV files in 32 bit float, as a stereo pair or
+// one mono file per port.
+class Recorder {
+	Client* client;
+	Tracks tracks;
+	std::vector<float> frames;
+public:
+	Recorder( Client* client ) : client( client ), frames( 2 * client->get_buffer_size() ) {}
+	virtual ~Recorder() {}
+	bool add( const std::string& file_name, const std::string& left, const std::string& right = "" ) {
+		Track track;
+		track.left = client->find_port( left );
+		track.right = right.empty() ? 0 : client->find_port( right );
+		if ( track.left == 0 || ( !right.empty() && track.right == 0 ) ) {
+			return false;
+		}
+		track.file = SndfileHandle( file_name, SFM_WRITE, SF_FORMAT_WAV | SF_FORMAT_FLOAT,
+				track.right ? 2 : 1, client->get_sample_rate() );
+		if ( SF_ERR_NO_ERROR != track.file.error() ) {
+			return false;
+		}
+		tracks.push_back( track );
+		return true;
+	}
+	void record( const jack_nframes_t& count ) {
+		Tracks::iterator it;
+		for ( it = tracks.begin(); it != tracks.end(); ++it ) {
+			if ( it->right ) {
+				for ( jack_nframes_t i = 0; i < count; ++i ) {
+					frames[ 2 * i ] = it->left->buffer[i];
+					frames[ 2 * i + 1 ] = it->right->buffer[i];
+				}
+				it->file.writef( &frames[0], count );
+			} else {
+				it->file.writef( it->left->buffer, count );
+			}
+		}
+	}
+};
+
+// Renders a MIDI file through the engine, then lets the sounds ring out
+// for up to MAX_TAIL seconds.
+class Bounce {
+	repulse::Engine* engine;
+	Client* client;
+	MidiInput* input;
+	Recorder* recorder;
+	jack_nframes_t frames;
+protected:
+	void period() {
+		client->process();
+		// Stretches asked for in a period are in by the next one, every time.
+		engine->wait_renders();
+		recorder->record( client->get_buffer_size() );
+		frames += client->get_buffer_size();
+	}
+public:
+	Bounce( repulse::Engine* engine, Client* client, MidiInput* input, Recorder* recorder ) :
+		engine( engine ), client( client ), input( input ), recorder( recorder ), frames( 0 ) {}
+	virtual ~Bounce() {}
+	const jack_nframes_t& run() {
+		jack_nframes_t end;
+		while ( !input->is_finished() ) {
+			period();
+		}
+		end = frames + client->time_to_frames( MAX_TAIL );
+		do {
+			period();
+		} while ( !engine->is_silent() && frames < end );
+		return frames;
+	}
+	const jack_nframes_t& get_frames() const {
+		return frames;
+	}
+};
+
+} // namespace offline
+
+#endif /* OFFLINE_H_ */
@@ -28,6 +28,7 @@
 #include "filtering.h"
 #include "envelope.h"
 #include "modulation.h"
+#include "voicing.h"
 
 namespace persistence {
 
@@ -52,17 +53,21 @@ static const std::string START_SOFT = "startSoft";
 static const std::string TRANSPOSE = "transpose";
 static const std::string TRANSPOSE_VELOCITY = "transposeVelocity";
 static const std::string TRANSPOSE_RANDOM = "transposeRandom";
+static const std::string TRANSPOSE_QUALITY = "transposeQuality";
 static const std::string STRETCH = "stretch";
 static const std::string STRETCH_VELOCITY = "stretchVelocity";
 static const std::string STRETCH_TYPE = "stretchType";
 static const std::string OVER_DRIVE = "overDrive";
 static const std::string OVER_DRIVE_ACTIVE = "overDriveActive";
+static const std::string OVER_DRIVE_QUALITY = "overDriveQuality";
 static const std::string FILTER_FREQUENCY = "filterFrequency";
 static const std::string FILTER_ACTIVE = "filterActive";
 static const std::string FILTER_TYPE = "filterType";
 static const std::string FILTER_VELOCITY = "filterVelocity";
 static const std::string FILTER_RANDOM = "filterRandom";
 static const std::string FILTER_RESONANCE = "filterResonance";
+static const std::string FILTER_ENVELOPE = "filterEnvelope";
+static const std::string FILTER_ENVELOPE_DECAY = "filterEnvelopeDecay";
 static const std::string DECAY = "decay";
 static const std::string DECAY_TYPE = "decayType";
 static const std::string PANNING = "panning";
@@ -72,6 +77,8 @@ static const std::string VOLUME = "volume";
 static const std::string VOLUME_VELOCITY = "volumeVelocity";
 static const std::string MUTED = "muted";
 static const std::string SOLOED = "soloed";
+static const std::string POLYPHONY = "polyphony";
+static const std::string STEALING = "stealing";
 static const std::string SELECTED_PRESET = "selectedPreset";
 static const std::string BASE_CHANNEL = "baseChannel";
 static const std::string BASE_NOTE = "baseNote";
@@ -182,6 +189,102 @@ static inline envelope::DecayType xml_to_decay_type( const std::string& value )
 	return ret;
 }
 
+static const std::string STEALING_TYPE_OLDEST = "oldest";
+static const std::string STEALING_TYPE_QUIETEST = "quietest";
+static const std::string STEALING_TYPE_LOWEST_VELOCITY = "velocity";
+
+static inline std::string stealing_type_to_xml( const voicing::StealingType& value ) {
+	std::string ret = STEALING_TYPE_OLDEST;
+	switch ( value ) {
+	case voicing::STEALING_TYPE_OLDEST:
+		ret = STEALING_TYPE_OLDEST;
+		break;
+	case voicing::STEALING_TYPE_QUIETEST:
+		ret = STEALING_TYPE_QUIETEST;
+		break;
+	case voicing::STEALING_TYPE_LOWEST_VELOCITY:
+		ret = STEALING_TYPE_LOWEST_VELOCITY;
+		break;
+	}
+	return ret;
+}
+
+static inline voicing::StealingType xml_to_stealing_type( const std::string& value ) {
+	voicing::StealingType ret = voicing::STEALING_DEF_TYPE;
+	if ( STEALING_TYPE_OLDEST == value ) {
+		ret = voicing::STEALING_TYPE_OLDEST;
+	} else if ( STEALING_TYPE_QUIETEST == value ) {
+		ret = voicing::STEALING_TYPE_QUIETEST;
+	} else if ( STEALING_TYPE_LOWEST_VELOCITY == value ) {
+		ret = voicing::STEALING_TYPE_LOWEST_VELOCITY;
+	}
+	return ret;
+}
+
+static const std::string OVER_DRIVE_QUALITY_1X = "1x";
+static const std::string OVER_DRIVE_QUALITY_2X = "2x";
+static const std::string OVER_DRIVE_QUALITY_4X = "4x";
+
+static inline std::string quality_to_xml( const filtering::OverDriveQuality& value ) {
+	std::string ret = OVER_DRIVE_QUALITY_1X;
+	switch ( value ) {
+	case filtering::OVER_DRIVE_QUALITY_1X:
+		ret = OVER_DRIVE_QUALITY_1X;
+		break;
+	case filtering::OVER_DRIVE_QUALITY_2X:
+		ret = OVER_DRIVE_QUALITY_2X;
+		break;
+	case filtering::OVER_DRIVE_QUALITY_4X:
+		ret = OVER_DRIVE_QUALITY_4X;
+		break;
+	}
+	return ret;
+}
+
+static inline filtering::OverDriveQuality xml_to_quality( const std::string& value ) {
+	filtering::OverDriveQuality ret = filtering::OVER_DRIVE_QUALITY_DEF_TYPE;
+	if ( OVER_DRIVE_QUALITY_1X == value ) {
+		ret = filtering::OVER_DRIVE_QUALITY_1X;
+	} else if ( OVER_DRIVE_QUALITY_2X == value ) {
+		ret = filtering::OVER_DRIVE_QUALITY_2X;
+	} else if ( OVER_DRIVE_QUALITY_4X == value ) {
+		ret = filtering::OVER_DRIVE_QUALITY_4X;
+	}
+	return ret;
+}
+
+static const std::string TUNER_QUALITY_LINEAR = "linear";
+static const std::string TUNER_QUALITY_HERMITE = "hermite";
+static const std::string TUNER_QUALITY_SINC = "sinc";
+
+static inline std::string transpose_quality_to_xml( const filtering::TunerQuality& value ) {
+	std::string ret = TUNER_QUALITY_HERMITE;
+	switch ( value ) {
+	case filtering::TUNER_QUALITY_LINEAR:
+		ret = TUNER_QUALITY_LINEAR;
+		break;
+	case filtering::TUNER_QUALITY_HERMITE:
+		ret = TUNER_QUALITY_HERMITE;
+		break;
+	case filtering::TUNER_QUALITY_SINC:
+		ret = TUNER_QUALITY_SINC;
+		break;
+	}
+	return ret;
+}
+
+static inline filtering::TunerQuality xml_to_transpose_quality( const std::string& value ) {
+	filtering::TunerQuality ret = filtering::TUNER_QUALITY_DEF_TYPE;
+	if ( TUNER_QUALITY_LINEAR == value ) {
+		ret = filtering::TUNER_QUALITY_LINEAR;
+	} else if ( TUNER_QUALITY_HERMITE == value ) {
+		ret = filtering::TUNER_QUALITY_HERMITE;
+	} else if ( TUNER_QUALITY_SINC == value ) {
+		ret = filtering::TUNER_QUALITY_SINC;
+	}
+	return ret;
+}
+
 static const std::string FREQUENCY_FILTER_TYPE_LOW_PASS = "lp";
 static const std::string FREQUENCY_FILTER_TYPE_HIGH_PASS = "hp";
 static const std::string FREQUENCY_FILTER_TYPE_BAND_PASS_1 = "bp1";
@@ -322,17 +425,21 @@ class Sound : public Serializable {
     util::floating_t transpose;
     util::floating_t transpose_velocity;
     util::floating_t transpose_random;
+    filtering::TunerQuality transpose_quality;
     util::floating_t stretch;
     util::floating_t stretch_velocity;
     filtering::TimeStretchType stretch_type;
     util::floating_t over_drive;
     bool over_drive_active;
+    filtering::OverDriveQuality over_drive_quality;
     util::floating_t filter_frequency;
     bool filter_active;
     filtering::FrequencyFilterType filter_type;
     util::floating_t filter_velocity;
     util::floating_t filter_random;
     util::floating_t filter_resonance;
+    util::floating_t filter_envelope;
+    util::floating_t filter_envelope_decay;
     util::floating_t decay;
     envelope::DecayType decay_type;
     util::floating_t panning;
@@ -342,6 +449,8 @@ class Sound : public Serializable {
     util::floating_t volume_velocity;
     bool muted;
     bool soloed;
+    size_t polyphony;
+    voicing::StealingType stealing;
 public:
 	Sound() :
 	    start( filtering::WAVE_DEF_START_TIME ),
@@ -349,17 +458,21 @@ public:
 	    transpose( filtering::TUNER_DEF_TRANSPOSE ),
 	    transpose_velocity( modulation::DEF_VELOCITY ),
 	    transpose_random( modulation::DEF_RANDOM ),
+	    transpose_quality( filtering::TUNER_QUALITY_DEF_TYPE ),
     	stretch( filtering::TIME_STRETCH_DEF_STRETCH ),
     	stretch_velocity( modulation::DEF_VELOCITY ),
     	stretch_type( filtering::TIME_STRETCH_DEF_TYPE ),
     	over_drive( filtering::OVER_DRIVE_DEF_DRIVE ),
 		over_drive_active( filtering::OVER_DRIVE_DEF_ACTIVE ),
+		over_drive_quality( filtering::OVER_DRIVE_QUALITY_DEF_TYPE ),
 	    filter_frequency( filtering::FREQUENCY_DEF_FREQUENCY ),
 	    filter_active( filtering::FREQUENCY_DEF_ACTIVE ),
 	    filter_type( filtering::FREQUENCY_FILTER_DEF_TYPE ),
 	    filter_velocity( modulation::DEF_VELOCITY ),
 	    filter_random( modulation::DEF_RANDOM ),
 	    filter_resonance( filtering::FREQUENCY_DEF_ACTIVE ),
+	    filter_envelope( filtering::FREQUENCY_DEF_ENVELOPE ),
+	    filter_envelope_decay( filtering::FREQUENCY_DEF_ENVELOPE_DECAY ),
 	    decay( envelope::DEF_DECAY ),
 	    decay_type( envelope::DECAY_DEF_TYPE ),
 	    panning( filtering::PANNER_DEF_PANNING ),
@@ -368,7 +481,9 @@ public:
 	    volume( filtering::GAIN_DEF_VOLUME ),
 	    volume_velocity( modulation::DEF_VELOCITY ),
 	    muted( false ),
-	    soloed( false ) {}
+	    soloed( false ),
+	    polyphony( voicing::DEF_POLYPHONY ),
+	    stealing( voicing::STEALING_DEF_TYPE ) {}
 	virtual ~Sound() {}
 	void set_start( const util::floating_t& start ) {
 	    this->start = start;
@@ -400,6 +515,12 @@ public:
 	const util::floating_t& get_transpose_random() const {
 	    return transpose_random;
 	}
+	void set_transpose_quality( const filtering::TunerQuality& transpose_quality ) {
+	    this->transpose_quality = transpose_quality;
+	}
+	const filtering::TunerQuality& get_transpose_quality() const {
+	    return transpose_quality;
+	}
 	void set_stretch( const util::floating_t& stretch ) {
 	    this->stretch = stretch;
 	}
@@ -430,6 +551,12 @@ public:
 	const bool& is_over_drive_active() const {
 	    return over_drive_active;
 	}
+	void set_over_drive_quality( const filtering::OverDriveQuality& over_drive_quality ) {
+	    this->over_drive_quality = over_drive_quality;
+	}
+	const filtering::OverDriveQuality& get_over_drive_quality() const {
+	    return over_drive_quality;
+	}
 	void set_filter_frequency( const util::floating_t& filter_frequency ) {
 	    this->filter_frequency = filter_frequency;
 	}
@@ -466,6 +593,18 @@ public:
 	const util::floating_t& get_filter_resonance() const {
 	    return filter_resonance;
 	}
+	void set_filter_envelope( const util::floating_t& filter_envelope ) {
+	    this->filter_envelope = filter_envelope;
+	}
+	const util::floating_t& get_filter_envelope() const {
+	    return filter_envelope;
+	}
+	void set_filter_envelope_decay( const util::floating_t& filter_envelope_decay ) {
+	    this->filter_envelope_decay = filter_envelope_decay;
+	}
+	const util::floating_t& get_filter_envelope_decay() const {
+	    return filter_envelope_decay;
+	}
 	void set_decay( const util::floating_t& decay ) {
 	    this->decay = decay;
 	}
@@ -520,6 +659,18 @@ public:
 	const bool& is_soloed() const {
 	    return soloed;
 	}
+	void set_polyphony( const size_t& polyphony ) {
+	    this->polyphony = polyphony;
+	}
+	const size_t& get_polyphony() const {
+	    return polyphony;
+	}
+	void set_stealing( const voicing::StealingType& stealing ) {
+	    this->stealing = stealing;
+	}
+	const voicing::StealingType& get_stealing() const {
+	    return stealing;
+	}
 	void deserialize( TiXmlElement& element );
 	const TiXmlElement& serialize( TiXmlElement& element ) const;
 	void to_stream( std::ostringstream& o ) const;
@@ -541,6 +692,9 @@ void Sound::deserialize( TiXmlElement& element ) {
 	if ( element.Attribute( attr::TRANSPOSE_RANDOM ) ) {
 		set_transpose_random( xml_to_floating( *element.Attribute( attr::TRANSPOSE_RANDOM ) ) );
 	}
+	if ( element.Attribute( attr::TRANSPOSE_QUALITY ) ) {
+		set_transpose_quality( xml_to_transpose_quality( *element.Attribute( attr::TRANSPOSE_QUALITY ) ) );
+	}
 	if ( element.Attribute( attr::STRETCH ) ) {
 		set_stretch( xml_to_floating( *element.Attribute( attr::STRETCH ) ) );
 	}
@@ -556,6 +710,9 @@ void Sound::deserialize( TiXmlElement& element ) {
 	if ( element.Attribute( attr::OVER_DRIVE_ACTIVE ) ) {
 		set_over_drive_active( xml_to_bool( *element.Attribute( attr::OVER_DRIVE_ACTIVE ) ) );
 	}
+	if ( element.Attribute( attr::OVER_DRIVE_QUALITY ) ) {
+		set_over_drive_quality( xml_to_quality( *element.Attribute( attr::OVER_DRIVE_QUALITY ) ) );
+	}
 	if ( element.Attribute( attr::FILTER_FREQUENCY ) ) {
 		set_filter_frequency( xml_to_floating( *element.Attribute( attr::FILTER_FREQUENCY ) ) );
 	}
@@ -574,6 +731,12 @@ void Sound::deserialize( TiXmlElement& element ) {
 	if ( element.Attribute( attr::FILTER_RESONANCE ) ) {
 		set_filter_resonance( xml_to_floating( *element.Attribute( attr::FILTER_RESONANCE ) ) );
 	}
+	if ( element.Attribute( attr::FILTER_ENVELOPE ) ) {
+		set_filter_envelope( xml_to_floating( *element.Attribute( attr::FILTER_ENVELOPE ) ) );
+	}
+	if ( element.Attribute( attr::FILTER_ENVELOPE_DECAY ) ) {
+		set_filter_envelope_decay( xml_to_floating( *element.Attribute( attr::FILTER_ENVELOPE_DECAY ) ) );
+	}
 	if ( element.Attribute( attr::DECAY ) ) {
 		set_decay( xml_to_floating( *element.Attribute( attr::DECAY ) ) );
 	}
@@ -601,6 +764,12 @@ void Sound::deserialize( TiXmlElement& element ) {
 	if ( element.Attribute( attr::SOLOED ) ) {
 		set_soloed( xml_to_bool( *element.Attribute( attr::SOLOED ) ) );
 	}
+	if ( element.Attribute( attr::POLYPHONY ) ) {
+		set_polyphony( xml_to_int( *element.Attribute( attr::POLYPHONY ) ) );
+	}
+	if ( element.Attribute( attr::STEALING ) ) {
+		set_stealing( xml_to_stealing_type( *element.Attribute( attr::STEALING ) ) );
+	}
 }
 
 const TiXmlElement& Sound::serialize( TiXmlElement& element ) const {
@@ -609,17 +778,21 @@ const TiXmlElement& Sound::serialize( TiXmlElement& element ) const {
 	element.SetAttribute( attr::TRANSPOSE, floating_to_xml( get_transpose() ) );
 	element.SetAttribute( attr::TRANSPOSE_VELOCITY, floating_to_xml( get_transpose_velocity() ) );
 	element.SetAttribute( attr::TRANSPOSE_RANDOM, floating_to_xml( get_transpose_random() ) );
+	element.SetAttribute( attr::TRANSPOSE_QUALITY, transpose_quality_to_xml( get_transpose_quality() ) );
 	element.SetAttribute( attr::STRETCH, floating_to_xml( get_stretch() ) );
 	element.SetAttribute( attr::STRETCH_VELOCITY, floating_to_xml( get_stretch_velocity() ) );
 	element.SetAttribute( attr::STRETCH_TYPE, stretch_type_to_xml( get_stretch_type() ) );
 	element.SetAttribute( attr::OVER_DRIVE, floating_to_xml( get_over_drive() ) );
 	element.SetAttribute( attr::OVER_DRIVE_ACTIVE, bool_to_xml( is_over_drive_active() ) );
+	element.SetAttribute( attr::OVER_DRIVE_QUALITY, quality_to_xml( get_over_drive_quality() ) );
 	element.SetAttribute( attr::FILTER_FREQUENCY, floating_to_xml( get_filter_frequency() ) );
 	element.SetAttribute( attr::FILTER_ACTIVE, bool_to_xml( is_filter_active() ) );
 	element.SetAttribute( attr::FILTER_TYPE, filter_type_to_xml( get_filter_type() ) );
 	element.SetAttribute( attr::FILTER_VELOCITY, floating_to_xml( get_filter_velocity() ) );
 	element.SetAttribute( attr::FILTER_RANDOM, floating_to_xml( get_filter_random() ) );
 	element.SetAttribute( attr::FILTER_RESONANCE, floating_to_xml( get_filter_resonance() ) );
+	element.SetAttribute( attr::FILTER_ENVELOPE, floating_to_xml( get_filter_envelope() ) );
+	element.SetAttribute( attr::FILTER_ENVELOPE_DECAY, floating_to_xml( get_filter_envelope_decay() ) );
 	element.SetAttribute( attr::DECAY, floating_to_xml( get_decay() ) );
 	element.SetAttribute( attr::DECAY_TYPE, decay_type_to_xml( get_decay_type() ) );
 	element.SetAttribute( attr::PANNING, floating_to_xml( get_panning() ) );
@@ -629,6 +802,8 @@ const TiXmlElement& Sound::serialize( TiXmlElement& element ) const {
 	element.SetAttribute( attr::VOLUME_VELOCITY, floating_to_xml( get_volume_velocity() ) );
 	element.SetAttribute( attr::MUTED, bool_to_xml( is_muted() ) );
 	element.SetAttribute( attr::SOLOED, bool_to_xml( is_soloed() ) );
+	element.SetAttribute( attr::POLYPHONY, int_to_xml( get_polyphony() ) );
+	element.SetAttribute( attr::STEALING, stealing_type_to_xml( get_stealing() ) );
     return element;
 }
 
@@ -639,17 +814,21 @@ void Sound::to_stream( std::ostringstream& o ) const {
 	o << " transpose: " << std::fixed << get_transpose() << std::endl;
 	o << " transpose_velocity: " << std::fixed << get_transpose_velocity() << std::endl;
 	o << " transpose_random: " << std::fixed << get_transpose_random() << std::endl;
+	o << " transpose_quality: " << transpose_quality_to_xml( get_transpose_quality() ) << std::endl;
 	o << " stretch: " << std::fixed << get_stretch() << std::endl;
 	o << " stretch_velocity: " << std::fixed << get_stretch_velocity() << std::endl;
 	o << " stretch_type: " << std::fixed << get_stretch_type() << std::endl;
 	o << " over_drive: " << std::fixed << get_over_drive() << std::endl;
 	o << " over_drive_active: " << std::boolalpha << is_over_drive_active() << std::endl;
+	o << " over_drive_quality: " << quality_to_xml( get_over_drive_quality() ) << std::endl;
 	o << " filter_frequency: " << std::fixed << get_filter_frequency() << std::endl;
 	o << " filter_active: " << std::boolalpha << is_filter_active() << std::endl;
 	o << " filter_type: " << filter_type_to_xml( get_filter_type() ) << std::endl;
 	o << " filter_velocity: " << std::fixed << get_filter_velocity() << std::endl;
 	o << " filter_random: " << std::fixed << get_filter_random() << std::endl;
 	o << " filter_resonance: " << std::fixed << get_filter_resonance() << std::endl;
+	o << " filter_envelope: " << std::fixed << get_filter_envelope() << std::endl;
+	o << " filter_envelope_decay: " << std::fixed << get_filter_envelope_decay() << std::endl;
 	o << " decay: " << std::fixed << get_decay() << std::endl;
 	o << " decay_type: " << decay_type_to_xml( get_decay_type() ) << std::endl;
 	o << " panning: " << std::fixed << get_panning() << std::endl;
@@ -659,6 +838,8 @@ void Sound::to_stream( std::ostringstream& o ) const {
 	o << " volume_velocity: " << std::fixed << get_volume_velocity() << std::endl;
 	o << " muted: " << std::boolalpha << is_muted() << std::endl;
 	o << " soloed: " << std::boolalpha << is_soloed() << std::endl;
+	o << " polyphony: " << get_polyphony() << std::endl;
+	o << " stealing: " << stealing_type_to_xml( get_stealing() ) << std::endl;
 }
 
 class Sounds : public ElementVector<Sound> {
@@ -19,38 +19,174 @@
 #include <ios>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <sys/time.h>
 #include "ui.h"
+#include "offline.h"
+
+static double now() {
+	struct timeval tv;
+	gettimeofday( &tv, 0 );
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Name of the stem of an output, file.wav gives file-out1.wav.
+static std::string stem_file( const std::string& wav_file, const std::string& output ) {
+	std::string::size_type dot = wav_file.find_last_of( '.' );
+	std::string::size_type sep = wav_file.find_last_of( util::PATH_SEP );
+	if ( dot == std::string::npos || ( sep != std::string::npos && dot < sep ) ) {
+		return wav_file + "-" + output;
+	}
+	return wav_file.substr( 0, dot ) + "-" + output + wav_file.substr( dot );
+}
+
+// Renders a MIDI file through a patch to WAV without JACK or ALSA.
+static int bounce( const std::string& patch_file, const std::string& midi_file, const std::string& wav_file,
+		const bool& stems, const size_t& workers, const size_t& pitch_budget, const size_t& stretch_budget,
+		const util::floating_t& tail_threshold, const jack_nframes_t& sample_rate, const jack_nframes_t& buffer_size ) {
+	offline::Client* client = new offline::Client( "repulse", sample_rate, buffer_size );
+	offline::MidiFile file;
+	if ( !file.load( midi_file, sample_rate ) ) {
+		std::cerr << "Can not read MIDI file " << midi_file << std::endl;
+		delete client;
+		return 1;
+	}
+	offline::MidiInput* input = new offline::MidiInput( client, file );
+	repulse::Engine* engine = new repulse::Engine( client, 0, input, workers );
+	int ret = 0;
+	engine->set_document_file( patch_file );
+	engine->set_pitch_budget( pitch_budget );
+	engine->set_stretch_budget( stretch_budget );
+	engine->set_tail_threshold( tail_threshold );
+	engine->load();
+	// The bounce is the same every time only with all the copies in.
+	engine->wait_renders();
+	{
+		offline::Recorder recorder( client );
+		bool added = true;
+		if ( stems ) {
+			std::ostringstream o;
+			for ( size_t i = 0; i < util::MAX_SOUNDS && added; ++i ) {
+				o << "out" << ( i + 1 );
+				added = recorder.add( stem_file( wav_file, o.str() ), o.str() );
+				o.str("");
+			}
+		} else {
+			added = recorder.add( wav_file, "out-L", "out-R" );
+		}
+		if ( added ) {
+			offline::Bounce bounce( engine, client, input, &recorder );
+			double start = now();
+			jack_nframes_t frames = bounce.run();
+			double elapsed = now() - start;
+			std::cout << "Rendered " << client->frames_to_time( frames ) << " s in "
+					<< elapsed << " s" << std::endl;
+			engine->get_meter().dump( std::cout );
+			std::cout << "kernels: " << simd::LEVEL_NAMES[ simd::Cpu::get_instance().get_level() ] << std::endl;
+		} else {
+			std::cerr << "Can not write " << wav_file << std::endl;
+			ret = 1;
+		}
+	}
+	delete engine;
+	return ret;
+}
 
 int main( int argc, char* argv[] ) {
 	int c;
 	std::string client_name = "repulse";
 	bool auto_connect = false;
-    while ( ( c = getopt( argc, argv, "cn:" ) ) != -1 ) {
+	size_t workers = threading::DEF_WORKERS;
+	size_t pitch_budget = filtering::WAVE_DEF_PITCH_BUDGET;
+	size_t stretch_budget = filtering::WAVE_DEF_STRETCH_BUDGET;
+	util::floating_t tail_threshold = util::DEF_TAIL_THRESHOLD;
+	repulse::MidiDriver midi_driver = repulse::MIDI_DRIVER_DEF;
+	std::string midi_file;
+	std::string wav_file;
+	bool stems = false;
+	jack_nframes_t sample_rate = offline::DEF_SAMPLE_RATE;
+	jack_nframes_t buffer_size = offline::DEF_BUFFER_SIZE;
+	size_t level = simd::Cpu::get_instance().get_best();
+    while ( ( c = getopt( argc, argv, "b:cf:i:m:n:o:p:r:st:w:z:" ) ) != -1 ) {
     	switch ( c ) {
+    	case 'b':
+    		pitch_budget = (size_t)atoi( optarg ) << 20;
+    		break;
     	case 'c':
     		auto_connect = true;
     		break;
+    	case 'f':
+    		midi_file = optarg;
+    		break;
+    	case 'i':
+    		level = simd::Cpu::find( optarg );
+    		break;
+    	case 'm':
+    		if ( std::string( optarg ) == "jack" ) {
+    			midi_driver = repulse::MIDI_DRIVER_JACK;
+    		} else {
+    			midi_driver = repulse::MIDI_DRIVER_ALSA;
+    		}
+    		break;
     	case 'n':
     		client_name = optarg;
     		break;
+    	case 'o':
+    		wav_file = optarg;
+    		break;
+    	case 'p':
+    		buffer_size = atoi( optarg );
+    		break;
+    	case 'r':
+    		sample_rate = atoi( optarg );
+    		break;
+    	case 's':
+    		stems = true;
+    		break;
+    	case 't':
+    		stretch_budget = (size_t)atoi( optarg ) << 20;
+    		break;
+    	case 'w':
+    		workers = atoi( optarg );
+    		break;
+    	case 'z':
+    		tail_threshold = util::decibels_to_tail_threshold( atof( optarg ) );
+    		break;
     	}
     }
-    if ( optind < argc ) {
-    	repulse::Engine* engine = new repulse::Engine( client_name );
+    if ( level > simd::LEVEL_LAST_TYPE || !simd::Cpu::get_instance().select( (simd::Level)level ) ) {
+    	std::cerr << "This processor can not run " << ( level > simd::LEVEL_LAST_TYPE ? "that" : simd::LEVEL_NAMES[ level ] )
+    			<< " kernels, the best it runs are " << simd::LEVEL_NAMES[ simd::Cpu::get_instance().get_best() ] << std::endl;
+    	return 1;
+    }
+    bool offline = !midi_file.empty() || !wav_file.empty();
+    if ( optind < argc && offline && !midi_file.empty() && !wav_file.empty()
+    		&& sample_rate > 0 && buffer_size > 0 ) {
+    	return bounce( argv[ optind ], midi_file, wav_file, stems, workers, pitch_budget, stretch_budget, tail_threshold, sample_rate, buffer_size );
+    } else if ( optind < argc && !offline ) {
+    	repulse::Engine* engine = repulse::Engine::create( client_name, workers, midi_driver );
     	engine->set_document_file( argv[ optind ] );
+    	engine->set_pitch_budget( pitch_budget );
+    	engine->set_stretch_budget( stretch_budget );
+    	engine->set_tail_threshold( tail_threshold );
     	engine->load();
     	if ( auto_connect ) {
     		engine->auto_connect();
     	}
-		ui::UI ui( engine );
-		while ( !ui.is_leave() ) {
-			ui.update();
+		{
+			ui::UI ui( engine );
+			while ( !ui.is_leave() ) {
+				ui.update();
+			}
 		}
 		engine->save_repulse();
+		engine->get_meter().dump( std::cout );
+		std::cout << "kernels: " << simd::LEVEL_NAMES[ simd::Cpu::get_instance().get_level() ] << std::endl;
 		delete engine;
 
     } else {
-        std::cout << "repulse [-c] [-n jack_client_name] <patch_file>" << std::endl;
+        std::cout << "repulse [-c] [-m alsa|jack] [-n jack_client_name] [-w workers] [-b megabytes] [-t megabytes] [-z decibels] [-i isa] <patch_file>" << std::endl;
+        std::cout << "repulse -f midi_file -o wav_file [-s] [-r sample_rate] [-p period] [-w workers] [-b megabytes] [-t megabytes] [-z decibels] [-i isa] <patch_file>" << std::endl;
     }
     return 0;
 }
@@ -20,13 +20,21 @@
 #define REPULSE_H_
 
 #include <set>
+#include <vector>
+#include <algorithm>
 #include <sstream>
 #include "jack.h"
 #include "alsa.h"
+#include "jackmidi.h"
 #include "midi.h"
 #include "envelope.h"
 #include "modulation.h"
 #include "filtering.h"
+#include "mixing.h"
+#include "voicing.h"
+#include "threading.h"
+#include "metering.h"
+#include "simd.h"
 #include "util.h"
 #include "persistence.h"
 
@@ -48,17 +56,169 @@ public:
 typedef std::set<EngineListener*> EngineListenerSet;
 
 class Sound;
+class Engine;
+
+typedef void (Sound::*SoundFloatingSetter)( const util::floating_t&, const bool& );
+typedef void (Sound::*SoundBoolSetter)( const bool&, const bool& );
+typedef void (Sound::*SoundStretchTypeSetter)( const filtering::TimeStretchType&, const bool& );
+typedef void (Sound::*SoundFilterTypeSetter)( const filtering::FrequencyFilterType&, const bool& );
+typedef void (Sound::*SoundDecayTypeSetter)( const envelope::DecayType&, const bool& );
+typedef void (Sound::*SoundNoteSetter)( unsigned char );
+typedef void (Engine::*EngineFloatingSetter)( const util::floating_t&, const bool& );
+typedef void (Engine::*EngineBoolSetter)( const bool&, const bool& );
+typedef void (Engine::*EngineByteSetter)( const unsigned char&, const bool& );
+typedef void (Engine::*EngineNoteMapSetter)( const util::NoteMapType&, const bool& );
+typedef void (Engine::*EngineIndexSetter)( const size_t&, const bool& );
+
+enum CommandType {
+	COMMAND_SOUND_FLOATING = 0,
+	COMMAND_SOUND_BOOL,
+	COMMAND_SOUND_STRETCH_TYPE,
+	COMMAND_SOUND_FILTER_TYPE,
+	COMMAND_SOUND_DECAY_TYPE,
+	COMMAND_SOUND_NOTE,
+	COMMAND_SOUND_WAVE,
+	COMMAND_SOUND_PITCHES,
+	COMMAND_SOUND_STRETCHED,
+	COMMAND_ENGINE_FLOATING,
+	COMMAND_ENGINE_BOOL,
+	COMMAND_ENGINE_BYTE,
+	COMMAND_ENGINE_NOTE_MAP,
+	COMMAND_ENGINE_INDEX,
+	COMMAND_ENGINE_PRESETS
+};
+
+static const size_t COMMAND_QUEUE_SIZE = 256;
+
+// Fixed size change sent from the user interface to the audio thread. The
+// kind of command follows from the type of the setter it is built with.
+struct Command {
+	CommandType type;
+	Sound* sound;
+	union {
+		SoundFloatingSetter sound_floating;
+		SoundBoolSetter sound_bool;
+		SoundStretchTypeSetter sound_stretch_type;
+		SoundFilterTypeSetter sound_filter_type;
+		SoundDecayTypeSetter sound_decay_type;
+		SoundNoteSetter sound_note;
+		EngineFloatingSetter engine_floating;
+		EngineBoolSetter engine_bool;
+		EngineByteSetter engine_byte;
+		EngineNoteMapSetter engine_note_map;
+		EngineIndexSetter engine_index;
+	} setter;
+	union {
+		util::floating_t floating;
+		bool boolean;
+		int integer;
+		unsigned char byte;
+		size_t index;
+		jack::sample_t* buffer;
+		filtering::PitchTable* pitches;
+		filtering::StretchRender* stretched;
+		persistence::Presets* presets;
+	} value;
+	jack_nframes_t buffer_size;
+	jack_nframes_t sample_rate;
+	Command() : type( COMMAND_SOUND_FLOATING ), sound( 0 ), buffer_size( 0 ), sample_rate( 0 ) {}
+	Command( Sound* sound, SoundFloatingSetter setter, const util::floating_t& value ) :
+		type( COMMAND_SOUND_FLOATING ), sound( sound ), buffer_size( 0 ), sample_rate( 0 ) {
+		this->setter.sound_floating = setter;
+		this->value.floating = value;
+	}
+	Command( Sound* sound, SoundBoolSetter setter, const bool& value ) :
+		type( COMMAND_SOUND_BOOL ), sound( sound ), buffer_size( 0 ), sample_rate( 0 ) {
+		this->setter.sound_bool = setter;
+		this->value.boolean = value;
+	}
+	Command( Sound* sound, SoundStretchTypeSetter setter, const filtering::TimeStretchType& value ) :
+		type( COMMAND_SOUND_STRETCH_TYPE ), sound( sound ), buffer_size( 0 ), sample_rate( 0 ) {
+		this->setter.sound_stretch_type = setter;
+		this->value.integer = value;
+	}
+	Command( Sound* sound, SoundFilterTypeSetter setter, const filtering::FrequencyFilterType& value ) :
+		type( COMMAND_SOUND_FILTER_TYPE ), sound( sound ), buffer_size( 0 ), sample_rate( 0 ) {
+		this->setter.sound_filter_type = setter;
+		this->value.integer = value;
+	}
+	Command( Sound* sound, SoundDecayTypeSetter setter, const envelope::DecayType& value ) :
+		type( COMMAND_SOUND_DECAY_TYPE ), sound( sound ), buffer_size( 0 ), sample_rate( 0 ) {
+		this->setter.sound_decay_type = setter;
+		this->value.integer = value;
+	}
+	Command( Sound* sound, SoundNoteSetter setter, const unsigned char& value ) :
+		type( COMMAND_SOUND_NOTE ), sound( sound ), buffer_size( 0 ), sample_rate( 0 ) {
+		this->setter.sound_note = setter;
+		this->value.byte = value;
+	}
+	Command( Sound* sound, jack::sample_t* buffer, const jack_nframes_t& buffer_size, const jack_nframes_t& sample_rate ) :
+		type( COMMAND_SOUND_WAVE ), sound( sound ), buffer_size( buffer_size ), sample_rate( sample_rate ) {
+		this->value.buffer = buffer;
+	}
+	Command( Sound* sound, filtering::PitchTable* pitches ) :
+		type( COMMAND_SOUND_PITCHES ), sound( sound ), buffer_size( 0 ), sample_rate( 0 ) {
+		this->value.pitches = pitches;
+	}
+	Command( Sound* sound, filtering::StretchRender* stretched ) :
+		type( COMMAND_SOUND_STRETCHED ), sound( sound ), buffer_size( 0 ), sample_rate( 0 ) {
+		this->value.stretched = stretched;
+	}
+	Command( EngineFloatingSetter setter, const util::floating_t& value ) :
+		type( COMMAND_ENGINE_FLOATING ), sound( 0 ), buffer_size( 0 ), sample_rate( 0 ) {
+		this->setter.engine_floating = setter;
+		this->value.floating = value;
+	}
+	Command( EngineBoolSetter setter, const bool& value ) :
+		type( COMMAND_ENGINE_BOOL ), sound( 0 ), buffer_size( 0 ), sample_rate( 0 ) {
+		this->setter.engine_bool = setter;
+		this->value.boolean = value;
+	}
+	Command( EngineByteSetter setter, const unsigned char& value ) :
+		type( COMMAND_ENGINE_BYTE ), sound( 0 ), buffer_size( 0 ), sample_rate( 0 ) {
+		this->setter.engine_byte = setter;
+		this->value.byte = value;
+	}
+	Command( EngineNoteMapSetter setter, const util::NoteMapType& value ) :
+		type( COMMAND_ENGINE_NOTE_MAP ), sound( 0 ), buffer_size( 0 ), sample_rate( 0 ) {
+		this->setter.engine_note_map = setter;
+		this->value.integer = value;
+	}
+	Command( EngineIndexSetter setter, const size_t& value ) :
+		type( COMMAND_ENGINE_INDEX ), sound( 0 ), buffer_size( 0 ), sample_rate( 0 ) {
+		this->setter.engine_index = setter;
+		this->value.index = value;
+	}
+	Command( persistence::Presets* presets ) :
+		type( COMMAND_ENGINE_PRESETS ), sound( 0 ), buffer_size( 0 ), sample_rate( 0 ) {
+		this->value.presets = presets;
+	}
+};
+
+typedef threading::Ring<Command, COMMAND_QUEUE_SIZE> CommandQueue;
+
+static const size_t STRETCH_REQUESTS = 64;
+
+// A render of a wave a pad asks for, from the audio thread.
+struct StretchRequest {
+	size_t sound;
+	size_t generation;
+	jack_nframes_t start_frame;
+	util::floating_t stretch;
+	filtering::TimeStretchType type;
+};
 
 class IEngine {
 public:
 	IEngine() {}
 	virtual ~IEngine() {}
 	virtual jack::Client* get_client() const { return 0; }
+	virtual voicing::Pool* get_pool() const { return 0; }
+	virtual void post( const Command& command ) {}
+	virtual void request_stretch( const StretchRequest& request ) {}
     virtual const std::string& get_name() const { return util::BLANK; }
 	virtual void add_listener( EngineListener* engine_listener ) {}
 	virtual void remove_listener( EngineListener* engine_listener ) {}
-	virtual void add_midi_listener( alsa::MidiInputListener* midi_listener ) {}
-	virtual void remove_midi_listener( alsa::MidiInputListener* midi_listener ) {}
     virtual void set_transpose_wheel( const util::floating_t& transpose_wheel, const bool& fire = true ) {}
     virtual const util::floating_t& get_transpose_wheel() const { return util::ZERO; }
     virtual void set_transpose_offset( const util::floating_t& transpose_offset, const bool& fire = true ) {}
@@ -88,70 +248,128 @@ public:
 class Sound :
 	public filtering::Filter,
 	public jack::Listener,
-	public alsa::MidiInputListener,
 	public EngineListener  {
-	util::MidiNoteOffset mno;
-	util::MidiControllerOffset mco;
 	jack::sample_t* buffer;
     util::floating_t sample;
 	IEngine* engine;
     jack::AudioOutput* output;
     filtering::Wave* wave;
-    filtering::TimeStretch* time_stretch;
-    filtering::Tuner* tuner;
-    filtering::OverDrive* over_drive;
-    filtering::Frequency* frequency;
-    envelope::Machine* envelope;
-    filtering::Gain* gain;
-    filtering::Panner panner;
+    voicing::Pool* pool;
     util::floating_t panning;
+    bool start_soft;
 	util::floating_t decay_time;
+	envelope::DecayType decay_type;
+    util::floating_t over_drive_drive;
+    bool over_drive_active;
+    filtering::OverDriveQuality over_drive_quality;
     util::floating_t stretch;
+    filtering::TimeStretchType stretch_type;
     util::floating_t volume;
     util::floating_t transpose;
+    filtering::TunerQuality transpose_quality;
     util::floating_t filter_frequency;
     util::floating_t filter_resonance;
+    util::floating_t filter_envelope;
+    util::floating_t filter_envelope_decay;
+    filtering::FrequencyFilterType filter_type;
+    bool filter_active;
+    size_t polyphony;
+    voicing::StealingType stealing;
     util::SoundIdentifier id;
     bool muted;
     bool soloed;
     bool playing;
+    jack_nframes_t quiet;
     modulation::Velocity volume_modulation;
     modulation::Velocity stretch_modulation;
     modulation::VelocityRandom transpose_modulation;
     modulation::VelocityRandom filter_frequency_modulation;
     modulation::VelocityRandom panning_modulation;
+protected:
+    void setup( voicing::Voice* voice ) {
+    	voice->set_wave( wave );
+    	voice->set_start_soft( start_soft );
+    	voice->set_decay_time( decay_time );
+    	voice->set_decay_type( decay_type );
+    	voice->set_over_drive_drive( over_drive_drive );
+    	voice->set_over_drive_active( over_drive_active );
+    	voice->set_over_drive_quality( over_drive_quality );
+    	voice->set_transpose_quality( transpose_quality );
+    	voice->set_filter_type( filter_type, filter_resonance, filter_frequency );
+    	voice->set_filter_resonance( filter_resonance );
+    	voice->set_filter_active( filter_active );
+    	voice->set_filter_envelope( filter_envelope );
+    	voice->set_filter_envelope_decay( filter_envelope_decay );
+    	voice->set_stretch_type( stretch_type );
+    	voice->set_volume( util::adjust_value( volume * engine->get_volume(),
+    			filtering::GAIN_MIN_VOLUME, filtering::GAIN_MAX_VOLUME ) );
+    	voice->set_stretch( get_voice_stretch() );
+    	voice->set_transpose( util::adjust_value( transpose + engine->get_transpose(),
+    			filtering::TUNER_MIN_TRANSPOSE, filtering::TUNER_MAX_TRANSPOSE ) );
+    	voice->set_filter_frequency( filter_frequency );
+    	voice->set_panning( panning );
+    }
+    // Stretch of the notes, before velocity.
+    util::floating_t get_voice_stretch() const {
+    	return util::adjust_value( stretch * engine->get_stretch(),
+    			filtering::TIME_STRETCH_MIN_STRETCH, filtering::TIME_STRETCH_MAX_STRETCH );
+    }
+    // Has the worker render the wave at the stretch just set, for the next
+    // notes. Those with less than full velocity on a modulated stretch play
+    // it live, as do the notes already sounding.
+    void request_stretch() {
+    	util::floating_t stretch = get_voice_stretch();
+    	if ( wave->get_buffer() && !util::almost_equal( stretch, filtering::TIME_STRETCH_NO_STRETCH )
+    			&& wave->find_stretched( stretch, stretch_type ) == filtering::WAVE_STRETCHES ) {
+    		StretchRequest request = { (size_t)id, wave->get_generation(), wave->get_start_frame(),
+    				stretch, stretch_type };
+    		engine->request_stretch( request );
+    	}
+    }
+    void update() {
+    	// Parameters also reach the notes that are already sounding.
+    	size_t i = 0;
+    	voicing::Voice* voice;
+    	while ( ( voice = pool->next( id, i ) ) != 0 ) {
+    		setup( voice );
+    	}
+    }
 public:
     Sound( IEngine* engine, const std::string& name, const util::SoundIdentifier& id ) :
     	filtering::Filter( engine->get_client() ),
     	jack::Listener(),
-    	alsa::MidiInputListener(),
        	EngineListener(),
     	buffer( 0 ),
        	sample( 0 ),
        	engine( engine ),
     	output( new jack::AudioOutput( engine->get_client(), name ) ),
     	wave( new filtering::Wave( engine->get_client() ) ),
-    	time_stretch( new filtering::TimeStretch( engine->get_client(), wave ) ),
-    	tuner( new filtering::Tuner( engine->get_client(), time_stretch ) ),
-    	over_drive( new filtering::OverDrive( engine->get_client() ) ),
-    	frequency( new filtering::Frequency( engine->get_client() ) ),
-    	envelope( new envelope::Machine( engine->get_client() ) ),
-    	gain( new filtering::Gain( engine->get_client() ) ),
+    	pool( engine->get_pool() ),
     	panning( filtering::PANNER_DEF_PANNING ),
+    	start_soft( envelope::DEF_SOFT_START ),
     	decay_time( envelope::DEF_DECAY ),
+    	decay_type( envelope::DECAY_DEF_TYPE ),
+    	over_drive_drive( filtering::OVER_DRIVE_DEF_DRIVE ),
+    	over_drive_active( filtering::OVER_DRIVE_DEF_ACTIVE ),
+    	over_drive_quality( filtering::OVER_DRIVE_QUALITY_DEF_TYPE ),
     	stretch( filtering::TIME_STRETCH_DEF_STRETCH ),
+    	stretch_type( filtering::TIME_STRETCH_DEF_TYPE ),
     	volume( filtering::GAIN_DEF_VOLUME ),
     	transpose( filtering::TUNER_DEF_TRANSPOSE ),
+    	transpose_quality( filtering::TUNER_QUALITY_DEF_TYPE ),
     	filter_frequency( filtering::FREQUENCY_DEF_FREQUENCY ),
     	filter_resonance( filtering::FREQUENCY_DEF_RESONANCE ),
+    	filter_envelope( filtering::FREQUENCY_DEF_ENVELOPE ),
+    	filter_envelope_decay( filtering::FREQUENCY_DEF_ENVELOPE_DECAY ),
+    	filter_type( filtering::FREQUENCY_FILTER_DEF_TYPE ),
+    	filter_active( filtering::FREQUENCY_DEF_ACTIVE ),
+    	polyphony( voicing::DEF_POLYPHONY ),
+    	stealing( voicing::STEALING_DEF_TYPE ),
     	id( id ),
     	muted( false ),
     	soloed( false ),
-    	playing( true ) {
-    	mno.set_id( id );
-    	mno.set_base_note( engine->get_base_note() );
-    	mno.set_note_map( engine->get_note_map() );
-    	mco.set_id( id );
+    	playing( true ),
+    	quiet( 0 ) {
         transpose_modulation.set_range(
         		filtering::TUNER_MIN_TRANSPOSE, filtering::TUNER_MAX_TRANSPOSE );
         filter_frequency_modulation.set_range(
@@ -159,20 +377,13 @@ public:
         panning_modulation.set_range(
         		filtering::PANNER_MIN_PANNING, filtering::PANNER_MAX_PANNING );
     	engine->add_listener( this );
-    	engine->add_midi_listener( this );
     	engine->get_client()->add_jack_listener( this );
     }
     ~Sound() {
         engine->get_client()->remove_jack_listener( this );
-    	engine->remove_midi_listener( this );
     	engine->remove_listener( this );
     	delete output;
         delete wave;
-        delete tuner;
-        delete over_drive;
-        delete frequency;
-        delete envelope;
-        delete gain;
     }
     void save_preset( persistence::Sound& sound ) const {
 	    sound.set_start( get_start_time() );
@@ -180,17 +391,21 @@ public:
 	    sound.set_transpose( get_transpose() );
 	    sound.set_transpose_velocity( get_transpose_velocity() );
 	    sound.set_transpose_random( get_transpose_random() );
+	    sound.set_transpose_quality( get_transpose_quality() );
 	    sound.set_stretch( get_stretch() );
 	    sound.set_stretch_velocity( get_stretch_velocity() );
 	    sound.set_stretch_type( get_stretch_type() );
 	    sound.set_over_drive( get_over_drive_drive() );
 	    sound.set_over_drive_active( is_over_drive_active() );
+	    sound.set_over_drive_quality( get_over_drive_quality() );
 	    sound.set_filter_frequency( get_filter_frequency() );
 	    sound.set_filter_active( is_filter_active() );
 	    sound.set_filter_type( get_filter_type() );
 	    sound.set_filter_velocity( get_filter_frequency_velocity() );
 	    sound.set_filter_random( get_filter_frequency_random() );
 	    sound.set_filter_resonance( get_filter_resonance() );
+	    sound.set_filter_envelope( get_filter_envelope() );
+	    sound.set_filter_envelope_decay( get_filter_envelope_decay() );
 	    sound.set_decay( get_decay_time() );
 	    sound.set_decay_type( get_decay_type() );
 	    sound.set_panning( get_panning() );
@@ -200,24 +415,30 @@ public:
 	    sound.set_volume_velocity( get_volume_velocity() );
 	    sound.set_muted( is_muted() );
 	    sound.set_soloed( is_soloed() );
+	    sound.set_polyphony( get_polyphony() );
+	    sound.set_stealing( get_stealing() );
     }
-    void recall_preset( persistence::Sound& sound, const bool& fire = false ) {
+    void recall_preset( const persistence::Sound& sound, const bool& fire = false ) {
 	    set_start_time( sound.get_start(), fire );
 	    set_start_soft( sound.is_start_soft(), fire );
 	    set_transpose( sound.get_transpose(), fire );
 	    set_transpose_velocity( sound.get_transpose_velocity(), fire );
 	    set_transpose_random( sound.get_transpose_random(), fire );
+	    set_transpose_quality( sound.get_transpose_quality(), fire );
 	    set_stretch( sound.get_stretch(), fire );
 	    set_stretch_velocity( sound.get_stretch_velocity(), fire );
 	    set_stretch_type( sound.get_stretch_type(), fire );
 	    set_over_drive_drive( sound.get_over_drive(), fire );
 	    set_over_drive_active( sound.is_over_drive_active(), fire );
+	    set_over_drive_quality( sound.get_over_drive_quality(), fire );
 	    set_filter_frequency( sound.get_filter_frequency(), fire );
 	    set_filter_active( sound.is_filter_active(), fire );
 	    set_filter_type( sound.get_filter_type(), fire );
 	    set_filter_frequency_velocity( sound.get_filter_velocity(), fire );
 	    set_filter_frequency_random( sound.get_filter_random(), fire );
 	    set_filter_resonance( sound.get_filter_resonance(), fire );
+	    set_filter_envelope( sound.get_filter_envelope(), fire );
+	    set_filter_envelope_decay( sound.get_filter_envelope_decay(), fire );
 	    set_decay_time( sound.get_decay(), fire );
 	    set_decay_type( sound.get_decay_type(), fire );
 	    set_panning( sound.get_panning(), fire );
@@ -227,6 +448,8 @@ public:
 	    set_volume_velocity( sound.get_volume_velocity(), fire );
 	    set_muted( sound.is_muted(), fire );
 	    set_soloed( sound.is_soloed(), fire );
+	    set_polyphony( sound.get_polyphony(), fire );
+	    set_stealing( sound.get_stealing(), fire );
     }
     bool is_playing() const {
     	return playing;
@@ -248,6 +471,9 @@ public:
     }
     const bool& is_soloed() const {
     	return soloed;
+    }
+    void solo( const bool& active, const bool& fire = true ) {
+    	engine->solo( id, active, fire );
     }
 	void set_volume_velocity( const util::floating_t& volume_velocity, const bool& fire = true ) {
 		volume_modulation.set_velocity( volume_velocity );
@@ -304,49 +530,59 @@ public:
     	return buffer;
     }
     void set_start_soft( const bool& start_soft, const bool& fire = true ) {
-    	envelope->set_start_soft( start_soft );
+    	this->start_soft = start_soft;
+    	update();
     }
     const bool& is_start_soft() const {
-    	return envelope->is_start_soft();
+    	return start_soft;
     }
     void set_decay_time( const util::floating_t& decay_time, const bool& fire = true ) {
-    	envelope->set_decay_time( decay_time );
+    	this->decay_time = util::adjust_value( decay_time, envelope::MIN_DECAY, envelope::MAX_DECAY );
+    	update();
     }
     const util::floating_t& get_decay_time() const {
-    	return envelope->get_decay_time();
+    	return decay_time;
     }
     void set_decay_type( const envelope::DecayType& decay_type, const bool& fire = true ) {
-    	envelope->set_decay_type( decay_type );
+    	this->decay_type = decay_type;
+    	update();
     }
     const envelope::DecayType& get_decay_type() const {
-    	return envelope->get_decay_type();
+    	return decay_type;
     }
     void set_over_drive_active( const bool& over_drive_active, const bool& fire = true ) {
-    	over_drive->set_active( over_drive_active );
+    	this->over_drive_active = over_drive_active;
+    	update();
     }
     const bool& is_over_drive_active() const {
-    	return over_drive->is_active();
+    	return over_drive_active;
+    }
+    void set_over_drive_quality( const filtering::OverDriveQuality& over_drive_quality, const bool& fire = true ) {
+    	this->over_drive_quality = over_drive_quality;
+    	update();
+    }
+    const filtering::OverDriveQuality& get_over_drive_quality() const {
+    	return over_drive_quality;
     }
     void set_over_drive_drive( const util::floating_t& over_drive_drive, const bool& fire = true ) {
-    	over_drive->set_drive( over_drive_drive );
+    	this->over_drive_drive = util::adjust_value( over_drive_drive,
+    			filtering::OVER_DRIVE_MIN_DRIVE, filtering::OVER_DRIVE_MAX_DRIVE );
+    	update();
     }
     const util::floating_t& get_over_drive_drive() const {
-    	return over_drive->get_drive();
+    	return over_drive_drive;
     }
     void set_filter_type( const filtering::FrequencyFilterType& filter_type, const bool& fire = true ) {
-    	if ( filter_type != frequency->get_filter_type() ) {
-    		frequency->set_filter_type( filter_type );
-    		frequency->set_resonance( filter_resonance );
-    		frequency->set_frequency( filter_frequency );
-    	}
+    	this->filter_type = filter_type;
+    	update();
     }
     const filtering::FrequencyFilterType& get_filter_type() const {
-    	return frequency->get_filter_type();
+    	return filter_type;
     }
 	void set_filter_frequency( const util::floating_t& filter_frequency, const bool& fire = true ) {
 		this->filter_frequency = util::adjust_value( filter_frequency,
 				filtering::FREQUENCY_MIN_FREQUENCY, filtering::FREQUENCY_MAX_FREQUENCY( engine->get_client() ) );
-		frequency->set_frequency( filter_frequency_modulation.modulate( this->filter_frequency ) );
+		update();
 	}
 	const util::floating_t& get_filter_frequency() const {
 		return filter_frequency;
@@ -354,50 +590,76 @@ public:
 	void set_filter_resonance( const util::floating_t& filter_resonance, const bool& fire = true ) {
 		this->filter_resonance = util::adjust_value( filter_resonance,
 				filtering::FREQUENCY_MIN_RESONANCE, filtering::FREQUENCY_MAX_RESONANCE );
-		frequency->set_resonance( filter_resonance );
+		update();
 	}
 	const util::floating_t& get_filter_resonance() const {
-		return frequency->get_resonance();
+		return filter_resonance;
+	}
+	// Octaves the cutoff starts away from the frequency on every note.
+	void set_filter_envelope( const util::floating_t& filter_envelope, const bool& fire = true ) {
+		this->filter_envelope = util::adjust_value( filter_envelope,
+				filtering::FREQUENCY_MIN_ENVELOPE, filtering::FREQUENCY_MAX_ENVELOPE );
+		update();
+	}
+	const util::floating_t& get_filter_envelope() const {
+		return filter_envelope;
+	}
+	void set_filter_envelope_decay( const util::floating_t& filter_envelope_decay, const bool& fire = true ) {
+		this->filter_envelope_decay = util::adjust_value( filter_envelope_decay,
+				filtering::FREQUENCY_MIN_ENVELOPE_DECAY, filtering::FREQUENCY_MAX_ENVELOPE_DECAY );
+		update();
+	}
+	const util::floating_t& get_filter_envelope_decay() const {
+		return filter_envelope_decay;
 	}
 	void set_filter_active( const bool& active, const bool& fire = true ) {
-		frequency->set_active( active );
+		this->filter_active = active;
+		update();
 	}
 	const bool& is_filter_active() const {
-		return frequency->is_active();
+		return filter_active;
 	}
 	void set_volume( const util::floating_t& volume, const bool& fire = true ) {
 		this->volume = util::adjust_value( volume, filtering::GAIN_MIN_VOLUME, filtering::GAIN_MAX_VOLUME );
-		gain->set_volume( volume_modulation.modulate( util::adjust_value( this->volume * engine->get_volume(),
-				filtering::GAIN_MIN_VOLUME, filtering::GAIN_MAX_VOLUME ) ) );
+		update();
 	}
 	const util::floating_t& get_volume() const {
 		return volume;
 	}
     void set_transpose( const util::floating_t& transpose, const bool& fire = true ) {
     	this->transpose = util::adjust_value( transpose, filtering::TUNER_MIN_TRANSPOSE, filtering::TUNER_MAX_TRANSPOSE );
-    	tuner->set_transpose( transpose_modulation.modulate(
-    			util::adjust_value( this->transpose + engine->get_transpose(),
-    					filtering::TUNER_MIN_TRANSPOSE, filtering::TUNER_MAX_TRANSPOSE ) ) );
+    	update();
     }
     const util::floating_t& get_transpose() const {
     	return transpose;
     }
+    void set_transpose_quality( const filtering::TunerQuality& transpose_quality, const bool& fire = true ) {
+    	this->transpose_quality = transpose_quality;
+    	update();
+    }
+    const filtering::TunerQuality& get_transpose_quality() const {
+    	return transpose_quality;
+    }
     void set_stretch( const util::floating_t& stretch, const bool& fire = true ) {
 		this->stretch = util::adjust_value( stretch,
 				filtering::TIME_STRETCH_MIN_STRETCH, filtering::TIME_STRETCH_MAX_STRETCH );
-		time_stretch->set_stretch( stretch_modulation.modulate( this->stretch * engine->get_stretch() ) );
+		update();
+		request_stretch();
 	}
 	const util::floating_t& get_stretch() const {
 		return stretch;
 	}
 	void set_stretch_type( const filtering::TimeStretchType& stretch_type, const bool& fire = true ) {
-		time_stretch->set_type( stretch_type );
+		this->stretch_type = stretch_type;
+		update();
+		request_stretch();
 	}
 	const filtering::TimeStretchType& get_stretch_type() const {
-		return time_stretch->get_type();
+		return stretch_type;
 	}
     void set_start_time( const util::floating_t& start_time, const bool& fire = true ) {
         wave->set_start_time( start_time );
+        request_stretch();
     }
     const util::floating_t& get_start_time() const {
     	return wave->get_start_time();
@@ -405,19 +667,27 @@ public:
     void set_panning( const util::floating_t& panning, const bool& fire = true ) {
         this->panning = util::adjust_value( panning,
         		filtering::PANNER_MIN_PANNING, filtering::PANNER_MAX_PANNING );
-        panner.set_panning( panning_modulation.modulate( this->panning ) );
+        update();
     }
     const util::floating_t& get_panning() const {
     	return panning;
     }
-	const util::floating_t& get_mix_left() const {
-		return panner.get_mix_left();
+    void set_polyphony( const size_t& polyphony, const bool& fire = true ) {
+    	this->polyphony = util::adjust_value( polyphony, voicing::MIN_POLYPHONY, voicing::MAX_POLYPHONY );
+    }
+    const size_t& get_polyphony() const {
+    	return polyphony;
+    }
+    void set_stealing( const voicing::StealingType& stealing, const bool& fire = true ) {
+    	this->stealing = stealing;
+    }
+    const voicing::StealingType& get_stealing() const {
+    	return stealing;
+    }
+    bool is_audible() const {
+    	return !( is_muted() || ( engine->is_soloed() && !is_soloed() ) );
     }
-	const util::floating_t& get_mix_right() const {
-		return panner.get_mix_right();
-	}
     virtual void note_on( unsigned char velocity ) {
-    	util::floating_t tmp;
     	// Modulate.
         volume_modulation.note_on( velocity );
         stretch_modulation.note_on( velocity );
@@ -425,57 +695,71 @@ public:
         filter_frequency_modulation.note_on( velocity );
         panning_modulation.note_on( velocity );
         // Apply values.
-        tmp = volume_modulation.modulate( util::adjust_value(
-				volume * engine->get_volume(),
-				filtering::GAIN_MIN_VOLUME, filtering::GAIN_MAX_VOLUME ) );
-        if ( tmp != gain->get_volume() ) {
-        	gain->set_volume( tmp );
-        }
-        tmp = stretch_modulation.modulate( util::adjust_value(
-				stretch * engine->get_stretch(),
-				filtering::TIME_STRETCH_MIN_STRETCH, filtering::TIME_STRETCH_MAX_STRETCH ) );
-        if ( tmp != time_stretch->get_stretch() ) {
-        	time_stretch->set_stretch( tmp );
-        }
-        tmp = transpose_modulation.modulate(
-        		util::adjust_value( transpose + engine->get_transpose(),
-        		filtering::TUNER_MIN_TRANSPOSE, filtering::TUNER_MAX_TRANSPOSE ) );
-		if ( tmp != tuner->get_transpose() ) {
-			tuner->set_transpose( tmp );
-		}
-        tmp = filter_frequency_modulation.modulate( filter_frequency );
-        if ( tmp != frequency->get_frequency() ) {
-        	frequency->set_frequency( tmp );
-        }
-        tmp = panning_modulation.modulate( panning );
-        if ( tmp != panner.get_panning() ) {
-        	panner.set_panning( tmp );
-        }
+        voicing::Voice* voice = pool->acquire( id, polyphony, stealing );
+        voice->modulate( volume_modulation, stretch_modulation, transpose_modulation,
+        		filter_frequency_modulation, panning_modulation, velocity );
+        setup( voice );
 		// Start the note.
-    	tuner->reset();
-    	envelope->note_on();
+        voice->note_on();
     	playing = true;
+    	quiet = 0;
     }
     void note_off() {
-    	envelope->note_off();
+    	size_t i = 0;
+    	voicing::Voice* voice;
+    	while ( ( voice = pool->next( id, i ) ) != 0 ) {
+    		voice->note_off();
+    	}
     }
     void silence() {
-    	envelope->silence();
+    	size_t i = 0;
+    	voicing::Voice* voice;
+    	while ( ( voice = pool->next( id, i ) ) != 0 ) {
+    		voice->silence();
+    	}
+    }
+    void render( voicing::Batch& batch ) {
+    	// The voices of a pad that can not be heard are left where they are.
+    	if ( is_audible() ) {
+			size_t i = 0;
+			voicing::Voice* voice;
+			while ( ( voice = pool->next( id, i ) ) != 0 ) {
+				batch.add( voice );
+			}
+    	}
     }
     void filter( jack::sample_t* samples ) {
-		if ( is_muted() || ( engine->is_soloed() && !is_soloed() )
-				|| tuner->is_finished() || envelope->is_finished() ) {
-			if ( playing ) {
-				memset( samples, 0, get_client()->get_data_size() );
-				playing = false;
+    	// Sums the voices rendered this period into samples.
+    	bool written = false;
+    	if ( is_audible() ) {
+    		jack_nframes_t buffer_size = get_client()->get_block_size();
+			size_t i = 0;
+			voicing::Voice* voice;
+			while ( ( voice = pool->next( id, i ) ) != 0 ) {
+				if ( voice->is_silent() ) {
+					continue;
+				}
+				if ( written ) {
+					const jack::sample_t* source = voice->get_buffer();
+					for ( jack_nframes_t j = 0; j < buffer_size; ++j ) {
+						samples[j] += source[j];
+					}
+				} else {
+					memcpy( samples, voice->get_buffer(), get_client()->get_block_data_size() );
+					written = true;
+				}
 			}
-		} else {
-			tuner->filter( samples );
-			over_drive->filter( samples );
-			frequency->filter( samples );
-			envelope->filter( samples );
-			gain->filter( samples );
-		}
+    	}
+    	if ( written ) {
+    		playing = true;
+    		quiet = 0;
+    	} else if ( playing ) {
+    		// The output is clean once a whole period of it has been cleared.
+			memset( samples, 0, get_client()->get_block_data_size() );
+			quiet += get_client()->get_block_size();
+			playing = quiet < get_client()->get_buffer_size();
+    	}
+    	set_silent( !written );
 	}
     void set_file_name( const std::string& file_name ) {
     	wave->set_file_name( file_name );
@@ -483,10 +767,54 @@ public:
     const std::string& get_file_name() const {
     	return wave->get_file_name();
     }
-    void load() {
-    	wave->load();
-    	tuner->reset();
-    	envelope->silence();
+    bool read_wave( jack::sample_t*& buffer, jack_nframes_t& buffer_size, jack_nframes_t& sample_rate ) const {
+    	return wave->read( buffer, buffer_size, sample_rate );
+    }
+    void swap_wave( jack::sample_t*& buffer, jack_nframes_t& buffer_size, jack_nframes_t& sample_rate ) {
+    	size_t i = 0;
+    	voicing::Voice* voice;
+    	wave->swap( buffer, buffer_size, sample_rate );
+    	while ( ( voice = pool->next( id, i ) ) != 0 ) {
+    		voice->reset();
+    		voice->silence();
+    	}
+    	request_stretch();
+    }
+    void swap_pitches( filtering::PitchTable*& pitches ) {
+    	size_t i = 0;
+    	voicing::Voice* voice;
+    	wave->swap_pitches( pitches );
+    	while ( ( voice = pool->next( id, i ) ) != 0 ) {
+    		if ( voice->is_copied() ) {
+    			voice->reset();
+    			voice->silence();
+    		}
+    	}
+    }
+    // Keeps a render the worker made, unless every slot it could take is
+    // still being read.
+    void swap_stretched( filtering::StretchRender*& stretched ) {
+    	bool busy[ filtering::WAVE_STRETCHES ];
+    	size_t i = 0;
+    	voicing::Voice* voice;
+    	for ( size_t j = 0; j < filtering::WAVE_STRETCHES; ++j ) {
+    		busy[j] = false;
+    	}
+    	while ( ( voice = pool->next( id, i ) ) != 0 ) {
+    		for ( size_t j = 0; j < filtering::WAVE_STRETCHES; ++j ) {
+    			if ( voice->get_stretched() && voice->get_stretched() == wave->get_stretched( j ) ) {
+    				busy[j] = true;
+    			}
+    		}
+    	}
+    	wave->swap_stretched( stretched, busy );
+    }
+    // Renders of the previous wave, one at a time, once a new one is in.
+    filtering::StretchRender* drop_stretched() {
+    	return wave->drop_stretched();
+    }
+    const size_t& get_wave_generation() const {
+    	return wave->get_generation();
     }
     ///////////////////////////////////////////////////////////////
     void on_sample_rate( jack::Client* client ) {
@@ -499,111 +827,117 @@ public:
     }
     ///////////////////////////////////////////////////////////////
 	void on_stretch( IEngine* engine, const util::floating_t& stretch, const bool& fire = true ) {
-		time_stretch->set_stretch( stretch_modulation.modulate( util::adjust_value( this->stretch * stretch,
-				filtering::TIME_STRETCH_MIN_STRETCH, filtering::TIME_STRETCH_MAX_STRETCH ) ) );
+		update();
+		request_stretch();
 	}
 	void on_volume( IEngine* engine, const util::floating_t& volume, const bool& fire = true ) {
-		gain->set_volume( volume_modulation.modulate( util::adjust_value( this->volume * volume,
-				filtering::GAIN_MIN_VOLUME, filtering::GAIN_MAX_VOLUME ) ) );
+		update();
 	}
 	void on_transpose( IEngine* engine, const util::floating_t& transpose, const bool& fire = true ) {
-		tuner->set_transpose( transpose_modulation.modulate( util::adjust_value(
-				this->transpose + transpose, filtering::TUNER_MIN_TRANSPOSE, filtering::TUNER_MAX_TRANSPOSE ) ) );
-	}
-	virtual void on_note_map( IEngine* engine, const util::NoteMapType& note_map, const bool& fire = true ) {
-		mno.set_note_map( note_map );
-	}
-	virtual void on_base_note( IEngine* engine, const unsigned char& base_note, const bool& fire = true ) {
-		mno.set_base_note( base_note );
+		update();
 	}
 	///////////////////////////////////////////////////////////////
-	void on_note_off( alsa::IMidiInput* input, const midi::NoteOff* event ) {
-		if ( engine->is_omni() || event->get_channel() == engine->get_base_channel() ) {
-			if ( mno.test( event->get_note() ) ) {
-				note_off();
-			}
-		}
-	}
-	void on_note_on( alsa::IMidiInput* input, const midi::NoteOn* event ) {
-		if ( engine->is_omni() || event->get_channel() == engine->get_base_channel() ) {
-			if ( mno.test( event->get_note() ) ) {
-				if ( event->is_note_off() ) {
-					note_off();
-				} else {
-					note_on( event->get_velocity() );
-				}
-			}
-		}
-	}
-	void on_after_touch( alsa::IMidiInput* input, const midi::AfterTouch* event ) {
-		// Not used
-	}
-	void on_controller( alsa::IMidiInput* input, const midi::Controller* event ) {
-		if ( event->get_channel() == engine->get_base_channel() ) {
-			if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_START_C10 ) ) {
-				set_start_time( util::controller_to_decimal( event->get_value(),
-						filtering::WAVE_MIN_START_TIME, filtering::WAVE_MAX_START_TIME ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_START_SOFT_C10 ) ) {
-				set_start_soft( util::controller_to_bool( event->get_value() ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_TRANSPOSE_C10 ) ) {
-				set_transpose( util::controller_to_decimal_center( event->get_value(),
-						filtering::TUNER_MIN_TRANSPOSE, filtering::TUNER_MAX_TRANSPOSE ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_STRETCH_C10 ) ) {
-				set_stretch( util::controller_to_decimal_center( event->get_value(),
-						filtering::TIME_STRETCH_MIN_STRETCH, filtering::TIME_STRETCH_MAX_STRETCH ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_OVER_DRIVE_C10 ) ) {
-				set_over_drive_drive( util::controller_to_decimal( event->get_value(),
-						filtering::OVER_DRIVE_MIN_DRIVE, filtering::OVER_DRIVE_MAX_DRIVE ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_FILTER_FREQUENCY_C10 ) ) {
-				set_filter_frequency( util::controller_to_decimal( event->get_value(),
-						filtering::FREQUENCY_MIN_FREQUENCY,
-						filtering::FREQUENCY_MAX_FREQUENCY( engine->get_client() ) ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_FILTER_RESONANCE_C10 ) ) {
-				set_filter_resonance( util::controller_to_decimal( event->get_value(),
-						filtering::FREQUENCY_MIN_RESONANCE, filtering::FREQUENCY_MAX_RESONANCE ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_DECAY_C10 ) ) {
-				set_decay_time( util::controller_to_decimal( event->get_value(),
-						envelope::MIN_DECAY, envelope::MAX_DECAY ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_PANNING_C10 ) ) {
-				set_panning( util::controller_to_decimal_center( event->get_value(),
-						filtering::PANNER_MIN_PANNING, filtering::PANNER_MAX_PANNING ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_VOLUME_C10 ) ) {
-				set_volume( util::controller_to_decimal_center( event->get_value(),
-						filtering::GAIN_MIN_VOLUME, filtering::GAIN_MAX_VOLUME ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_FILTER_ACTIVE_C10 ) ) {
-				set_filter_active( util::controller_to_bool( event->get_value() ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_OVER_DRIVE_ACTIVE_C10 ) ) {
-				set_over_drive_active( util::controller_to_bool( event->get_value() ), false );
-			}
-
-		} else if ( event->get_channel() == engine->get_base_channel() + 1 ) {
-			if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_TRANSPOSE_VELOCITY_C11 ) ) {
-				set_transpose_velocity( util::controller_to_percentage( event->get_value() ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_STRETCH_TYPE_C11 ) ) {
-				set_stretch_type( filtering::TimeStretch::controller_to_stretch_type( event->get_value() ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_FILTER_TYPE_C11 ) ) {
-				set_filter_type( filtering::Frequency::controller_to_filter_type( event->get_value() ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_TRANSPOSE_RANDOM_C11 ) ) {
-				set_transpose_random( util::controller_to_percentage( event->get_value() ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_STRETCH_VELOCITY_C11 ) ) {
-				set_stretch_velocity( util::controller_to_percentage( event->get_value() ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_FILTER_VELOCITY_C11 ) ) {
-				set_filter_frequency_velocity( util::controller_to_percentage( event->get_value() ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_FILTER_RANDOM_C11 ) ) {
-				set_filter_frequency_random( util::controller_to_percentage( event->get_value() ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_PANNING_VELOCITY_C11 ) ) {
-				set_panning_velocity( util::controller_to_percentage( event->get_value() ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_PANNING_RANDOM_C11 ) ) {
-				set_panning_random( util::controller_to_percentage( event->get_value() ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_VOLUME_VELOCITY_C11 ) ) {
-				set_volume_velocity( util::controller_to_percentage( event->get_value() ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_DECAY_TYPE_C11 ) ) {
-				set_decay_type( envelope::Machine::controller_to_decay_type( event->get_value() ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_MUTED_C11 ) ) {
-				set_muted( util::controller_to_bool( event->get_value() ), false );
-			} else if ( mco.test( event->get_controller(), util::MIDI_CONT_SOUND_SOLOED_C11 ) ) {
-				engine->solo( get_id(), util::controller_to_bool( event->get_value() ), false );
-			}
+	// Applies a controller the engine found for this sound.
+	void control( const util::MidiParameter& parameter, const unsigned char& value ) {
+		switch ( parameter ) {
+		case util::MIDI_PARAMETER_SOUND_START:
+			set_start_time( util::controller_to_decimal( value,
+					filtering::WAVE_MIN_START_TIME, filtering::WAVE_MAX_START_TIME ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_START_SOFT:
+			set_start_soft( util::controller_to_bool( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_TRANSPOSE:
+			set_transpose( util::controller_to_decimal_center( value,
+					filtering::TUNER_MIN_TRANSPOSE, filtering::TUNER_MAX_TRANSPOSE ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_STRETCH:
+			set_stretch( util::controller_to_decimal_center( value,
+					filtering::TIME_STRETCH_MIN_STRETCH, filtering::TIME_STRETCH_MAX_STRETCH ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_OVER_DRIVE:
+			set_over_drive_drive( util::controller_to_decimal( value,
+					filtering::OVER_DRIVE_MIN_DRIVE, filtering::OVER_DRIVE_MAX_DRIVE ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_OVER_DRIVE_ACTIVE:
+			set_over_drive_active( util::controller_to_bool( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_FILTER_FREQUENCY:
+			set_filter_frequency( util::controller_to_decimal( value,
+					filtering::FREQUENCY_MIN_FREQUENCY,
+					filtering::FREQUENCY_MAX_FREQUENCY( engine->get_client() ) ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_FILTER_ACTIVE:
+			set_filter_active( util::controller_to_bool( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_FILTER_RESONANCE:
+			set_filter_resonance( util::controller_to_decimal( value,
+					filtering::FREQUENCY_MIN_RESONANCE, filtering::FREQUENCY_MAX_RESONANCE ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_DECAY:
+			set_decay_time( util::controller_to_decimal( value,
+					envelope::MIN_DECAY, envelope::MAX_DECAY ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_PANNING:
+			set_panning( util::controller_to_decimal_center( value,
+					filtering::PANNER_MIN_PANNING, filtering::PANNER_MAX_PANNING ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_VOLUME:
+			set_volume( util::controller_to_decimal_center( value,
+					filtering::GAIN_MIN_VOLUME, filtering::GAIN_MAX_VOLUME ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_POLYPHONY:
+			set_polyphony( voicing::MIN_POLYPHONY + value
+					* ( voicing::MAX_POLYPHONY - voicing::MIN_POLYPHONY + 1 ) / 128, false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_STEALING:
+			set_stealing( voicing::Pool::controller_to_stealing_type( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_TRANSPOSE_VELOCITY:
+			set_transpose_velocity( util::controller_to_percentage( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_TRANSPOSE_RANDOM:
+			set_transpose_random( util::controller_to_percentage( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_STRETCH_VELOCITY:
+			set_stretch_velocity( util::controller_to_percentage( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_STRETCH_TYPE:
+			set_stretch_type( filtering::TimeStretch::controller_to_stretch_type( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_FILTER_TYPE:
+			set_filter_type( filtering::Frequency::controller_to_filter_type( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_FILTER_VELOCITY:
+			set_filter_frequency_velocity( util::controller_to_percentage( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_FILTER_RANDOM:
+			set_filter_frequency_random( util::controller_to_percentage( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_FILTER_ENVELOPE:
+			set_filter_envelope( util::controller_to_decimal_center( value,
+					filtering::FREQUENCY_MIN_ENVELOPE, filtering::FREQUENCY_MAX_ENVELOPE ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_DECAY_TYPE:
+			set_decay_type( envelope::Machine::controller_to_decay_type( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_PANNING_VELOCITY:
+			set_panning_velocity( util::controller_to_percentage( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_PANNING_RANDOM:
+			set_panning_random( util::controller_to_percentage( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_VOLUME_VELOCITY:
+			set_volume_velocity( util::controller_to_percentage( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_MUTED:
+			set_muted( util::controller_to_bool( value ), false );
+			break;
+		case util::MIDI_PARAMETER_SOUND_SOLOED:
+			solo( util::controller_to_bool( value ), false );
+			break;
+		default:
+			break;
 		}
 	}
 };
@@ -628,17 +962,226 @@ public:
     }
 };
 
+enum MidiDriver {
+	MIDI_DRIVER_ALSA = 0,
+	MIDI_DRIVER_JACK
+};
+
+static const MidiDriver MIDI_DRIVER_DEF = MIDI_DRIVER_ALSA;
+
+// Frees what the worker made or the audio thread is done with.
+static void dispose( const Command& command ) {
+	if ( command.type == COMMAND_SOUND_PITCHES ) {
+		delete command.value.pitches;
+	} else if ( command.type == COMMAND_SOUND_STRETCHED ) {
+		delete command.value.stretched;
+	} else if ( command.type == COMMAND_ENGINE_PRESETS ) {
+		delete command.value.presets;
+	} else {
+		delete [] command.value.buffer;
+	}
+}
+
+// Renders the stretches the pads ask for, on the worker, and hands them
+// to the audio thread. It reads its own copies of the waves, given over
+// by the pitch jobs, so that a wave may be replaced in the meantime. Only
+// the latest request of a pad is rendered; the ones before it would not
+// be played anyway. Whatever the audio thread hands back, waves, copies
+// and renders, it frees whenever it is woken. The renders kept take no
+// more than the budget; past it the stretches play live.
+class StretchRenderer : public threading::Job {
+	Sound** sounds;
+	CommandQueue* rendered;
+	CommandQueue* returned;
+	threading::Ring<StretchRequest, STRETCH_REQUESTS> requests;
+	StretchRequest latest[ util::MAX_SOUNDS ];
+	bool wanted[ util::MAX_SOUNDS ];
+	jack::sample_t* sources[ util::MAX_SOUNDS ];
+	jack_nframes_t sizes[ util::MAX_SOUNDS ];
+	jack_nframes_t rates[ util::MAX_SOUNDS ];
+	size_t generations[ util::MAX_SOUNDS ];
+	size_t budget;
+	size_t used;
+protected:
+	void render( const size_t& i ) {
+		const StretchRequest& request = latest[i];
+		// A request for a wave not handed over yet waits for it.
+		if ( generations[i] < request.generation ) {
+			return;
+		}
+		wanted[i] = false;
+		jack_nframes_t start_frame = std::min( request.start_frame, sizes[i] );
+		if ( generations[i] > request.generation
+				|| !filtering::StretchRender::fits( sizes[i] - start_frame, request.stretch )
+				|| used + filtering::StretchRender::to_bytes( sizes[i] - start_frame, request.stretch ) > budget ) {
+			return;
+		}
+		filtering::StretchRender* stretched = new filtering::StretchRender(
+				request.generation, request.start_frame, request.stretch, request.type );
+		stretched->render( sources[i], sizes[i], rates[i] );
+		used += stretched->get_bytes();
+		while ( !rendered->push( Command( sounds[i], stretched ) ) ) {
+			collect();
+			usleep( 1000 );
+		}
+	}
+public:
+	StretchRenderer( Sound** sounds, CommandQueue* rendered, CommandQueue* returned ) :
+		sounds( sounds ), rendered( rendered ), returned( returned ),
+		budget( filtering::WAVE_DEF_STRETCH_BUDGET ), used( 0 ) {
+		for ( size_t i = 0; i < util::MAX_SOUNDS; ++i ) {
+			wanted[i] = false;
+			sources[i] = 0;
+			sizes[i] = 0;
+			rates[i] = 0;
+			generations[i] = 0;
+		}
+	}
+	virtual ~StretchRenderer() {
+		for ( size_t i = 0; i < util::MAX_SOUNDS; ++i ) {
+			delete [] sources[i];
+		}
+	}
+	// Frees what the audio thread handed back, on the worker. The audio
+	// thread keeps renders back while there is no room for what they
+	// replace, so this also runs while the worker waits on it.
+	void collect() {
+		Command command;
+		while ( returned->pop( command ) ) {
+			if ( command.type == COMMAND_SOUND_STRETCHED ) {
+				used -= command.value.stretched->get_bytes();
+			}
+			dispose( command );
+		}
+	}
+	// Set before the worker gets requests.
+	void set_budget( const size_t& budget ) {
+		this->budget = budget;
+	}
+	const size_t& get_budget() const {
+		return budget;
+	}
+	// From the audio thread; false when too many are waiting already.
+	bool request( const StretchRequest& request ) {
+		return requests.push( request );
+	}
+	// Takes over the copy of a wave, on the worker.
+	void set_source( const size_t& i, jack::sample_t* source, const jack_nframes_t& source_size,
+			const jack_nframes_t& source_rate, const size_t& generation ) {
+		delete [] sources[i];
+		sources[i] = source;
+		sizes[i] = source_size;
+		rates[i] = source_rate;
+		generations[i] = generation;
+		if ( wanted[i] ) {
+			render( i );
+		}
+	}
+	void run( const size_t& index ) {
+		StretchRequest request;
+		collect();
+		while ( requests.pop( request ) ) {
+			latest[ request.sound ] = request;
+			wanted[ request.sound ] = true;
+		}
+		for ( size_t i = 0; i < util::MAX_SOUNDS; ++i ) {
+			if ( wanted[i] ) {
+				render( i );
+			}
+		}
+	}
+};
+
+// Renders the copies of one wave asked for on load, on the worker, and
+// hands them to the audio thread. It reads its own copy of the wave, so
+// that the wave may be replaced in the meantime, and then gives that copy
+// over to the stretch renderer.
+class PitchJob : public threading::Job {
+	Sound* sound;
+	size_t index;
+	CommandQueue* rendered;
+	StretchRenderer* renderer;
+	size_t generation;
+	filtering::PitchTable* pitches;
+	jack::sample_t* source;
+	jack_nframes_t source_size;
+	jack_nframes_t source_rate;
+	jack_nframes_t sample_rate;
+	std::vector<int> wanted;
+public:
+	PitchJob( Sound* sound, const size_t& index, CommandQueue* rendered, StretchRenderer* renderer,
+			const size_t& generation, const jack::sample_t* source, const jack_nframes_t& source_size,
+			const jack_nframes_t& source_rate, const jack_nframes_t& sample_rate ) :
+		sound( sound ), index( index ), rendered( rendered ), renderer( renderer ),
+		generation( generation ), pitches( new filtering::PitchTable( generation ) ),
+		source( new jack::sample_t[ source_size ] ), source_size( source_size ),
+		source_rate( source_rate ), sample_rate( sample_rate ) {
+		std::copy( source, source + source_size, this->source );
+	}
+	virtual ~PitchJob() {
+		delete pitches;
+		delete [] source;
+	}
+	void add( const int& pitch ) {
+		wanted.push_back( pitch );
+	}
+	void run( const size_t& index ) {
+		for ( size_t i = 0; i < wanted.size(); ++i ) {
+			pitches->render( wanted[i], source, source_size,
+					filtering::PitchTable::to_step( wanted[i], source_rate, sample_rate ) );
+		}
+		if ( !wanted.empty() ) {
+			while ( !rendered->push( Command( sound, pitches ) ) ) {
+				renderer->collect();
+				usleep( 1000 );
+			}
+			pitches = 0;
+		}
+		renderer->set_source( this->index, source, source_size, source_rate, generation );
+		source = 0;
+	}
+};
+
+// A copy the budget may hold, the closest to the presets first.
+struct PitchRequest {
+	int distance;
+	size_t sound;
+	int pitch;
+	bool operator<( const PitchRequest& other ) const {
+		if ( distance != other.distance ) {
+			return distance < other.distance;
+		}
+		if ( sound != other.sound ) {
+			return sound < other.sound;
+		}
+		return pitch < other.pitch;
+	}
+};
+
 class Engine : public IEngine, public jack::Listener, public alsa::MidiInputListener {
 	EngineListenerSet listeners;
 	jack::Client* client;
+	voicing::Pool* pool;
+	voicing::Batch batch;
+	threading::Crew* crew;
+	metering::Load meter;
+	CommandQueue commands;
+	CommandQueue returned;
+	CommandQueue rendered;
+	StretchRenderer* renderer;
+	threading::Worker* worker;
+	bool returning;
+	size_t pitch_budget;
+	size_t generations[ util::MAX_SOUNDS ];
     Sound* sounds[ util::MAX_SOUNDS ];
     persistence::RepulseDocument document;
     jack::AudioOutput* output_left;
     jack::AudioOutput* output_right;
     jack::sample_t* buffer_right;
     jack::sample_t* buffer_left;
+    mixing::StereoMix mix;
     alsa::Sequencer* sequencer;
-    alsa::MidiInput* midi_input;
+    alsa::IMidiInput* midi_input;
     util::floating_t stretch_offset;
     util::floating_t stretch_wheel;
     util::floating_t volume;
@@ -647,7 +1190,13 @@ class Engine : public IEngine, public jack::Listener, public alsa::MidiInputList
     //////////////////////////////////
     bool linked;
     size_t soloed;
+    // The audio thread's copy of the presets of the document, which only
+    // the user interface changes.
+    persistence::Presets* presets;
+    // Kept by the user interface. A preset recalled on the audio thread,
+    // as by a program change, is left in recalled_preset for it to take.
     int selected_preset;
+    volatile int recalled_preset;
 	unsigned char base_channel;
 	unsigned char base_note;
 	bool local_keyboard;
@@ -655,6 +1204,7 @@ class Engine : public IEngine, public jack::Listener, public alsa::MidiInputList
 	bool omni;
 	bool mono;
 	util::NoteMapType note_map;
+	util::MidiDispatch dispatch;
 protected:
     void fire_stretch( const util::floating_t& stretch, const bool& fire = true ) {
     	EngineListenerSet::const_iterator it;
@@ -686,16 +1236,194 @@ protected:
     		(*it)->on_base_note( this, base_note, fire );
     	}
     }
+    // Room a command needs among the returned ones: what it replaces.
+    static size_t to_return( const Command& command ) {
+    	switch ( command.type ) {
+    	case COMMAND_SOUND_WAVE:
+    		return 2 + filtering::WAVE_STRETCHES;
+    	case COMMAND_SOUND_PITCHES:
+    	case COMMAND_SOUND_STRETCHED:
+    	case COMMAND_ENGINE_PRESETS:
+    		return 1;
+    	default:
+    		return 0;
+    	}
+    }
+    // Whether the worker has freed enough for the command to run. If not,
+    // it waits for a later period.
+    bool can_execute( const Command& command ) const {
+    	return returned.get_free() >= to_return( command );
+    }
+    // Hands what the audio thread is done with to the worker, which is
+    // woken at the end of the period. can_execute() made room for it.
+    void give_back( const Command& command ) {
+    	bool pushed = returned.push( command );
+    	assert( pushed );
+    	returning = true;
+    }
+    // Runs a command on the audio thread.
+    void execute( const Command& command ) {
+    	Sound* sound = command.sound;
+    	switch ( command.type ) {
+    	case COMMAND_SOUND_FLOATING:
+    		(sound->*command.setter.sound_floating)( command.value.floating, true );
+    		break;
+    	case COMMAND_SOUND_BOOL:
+    		(sound->*command.setter.sound_bool)( command.value.boolean, true );
+    		break;
+    	case COMMAND_SOUND_STRETCH_TYPE:
+    		(sound->*command.setter.sound_stretch_type)(
+    				(filtering::TimeStretchType)command.value.integer, true );
+    		break;
+    	case COMMAND_SOUND_FILTER_TYPE:
+    		(sound->*command.setter.sound_filter_type)(
+    				(filtering::FrequencyFilterType)command.value.integer, true );
+    		break;
+    	case COMMAND_SOUND_DECAY_TYPE:
+    		(sound->*command.setter.sound_decay_type)(
+    				(envelope::DecayType)command.value.integer, true );
+    		break;
+    	case COMMAND_SOUND_NOTE:
+    		(sound->*command.setter.sound_note)( command.value.byte );
+    		break;
+    	case COMMAND_SOUND_WAVE: {
+    		// The previous wave goes back to the worker to be freed, along
+    		// with the copies and renders made of it.
+    		Command old = command;
+    		filtering::PitchTable* pitches = 0;
+    		filtering::StretchRender* stretched;
+    		sound->swap_wave( old.value.buffer, old.buffer_size, old.sample_rate );
+    		give_back( old );
+    		sound->swap_pitches( pitches );
+    		if ( pitches ) {
+    			give_back( Command( sound, pitches ) );
+    		}
+    		while ( ( stretched = sound->drop_stretched() ) != 0 ) {
+    			give_back( Command( sound, stretched ) );
+    		}
+    		break;
+    	}
+    	case COMMAND_SOUND_PITCHES: {
+    		filtering::PitchTable* pitches = command.value.pitches;
+    		sound->swap_pitches( pitches );
+    		if ( pitches ) {
+    			give_back( Command( sound, pitches ) );
+    		}
+    		break;
+    	}
+    	case COMMAND_SOUND_STRETCHED: {
+    		filtering::StretchRender* stretched = command.value.stretched;
+    		sound->swap_stretched( stretched );
+    		if ( stretched ) {
+    			give_back( Command( sound, stretched ) );
+    		}
+    		break;
+    	}
+    	case COMMAND_ENGINE_FLOATING:
+    		(this->*command.setter.engine_floating)( command.value.floating, true );
+    		break;
+    	case COMMAND_ENGINE_BOOL:
+    		(this->*command.setter.engine_bool)( command.value.boolean, true );
+    		break;
+    	case COMMAND_ENGINE_BYTE:
+    		(this->*command.setter.engine_byte)( command.value.byte, true );
+    		break;
+    	case COMMAND_ENGINE_NOTE_MAP:
+    		(this->*command.setter.engine_note_map)(
+    				(util::NoteMapType)command.value.integer, true );
+    		break;
+    	case COMMAND_ENGINE_INDEX:
+    		(this->*command.setter.engine_index)( command.value.index, true );
+    		break;
+    	case COMMAND_ENGINE_PRESETS:
+    		give_back( Command( presets ) );
+    		presets = command.value.presets;
+    		break;
+    	}
+    }
+    // Installs the copies and renders the worker is done with, once the
+    // wave they were made of is in.
+    void install() {
+    	const Command* command;
+    	while ( ( command = rendered.front() ) != 0 && can_execute( *command ) ) {
+    		size_t generation = command->type == COMMAND_SOUND_PITCHES
+    				? command->value.pitches->get_generation() : command->value.stretched->get_generation();
+    		if ( generation > command->sound->get_wave_generation() ) {
+    			break;
+    		}
+    		execute( *command );
+    		rendered.pop();
+    	}
+    }
+    // Picks the copies that fit in the budget, nearest to the transposes
+    // of the presets first, then spreading over the engine transpose.
+    void plan_pitches( std::vector<PitchJob*>& jobs, const jack_nframes_t* sizes, const jack_nframes_t* rates ) {
+    	std::vector<PitchRequest> requests;
+    	persistence::Presets& presets = document.get_root().get_presets();
+    	for ( size_t i = 0; i < util::MAX_SOUNDS; ++i ) {
+    		if ( !jobs[i] ) {
+    			continue;
+    		}
+    		std::set<int> bases;
+    		for ( size_t j = 0; j < presets.size(); ++j ) {
+    			if ( i < presets[j].get_sounds().size() ) {
+    				util::floating_t transpose = presets[j].get_sounds()[i].get_transpose()
+    						+ presets[j].get_engine().get_transpose();
+    				int base = floor( transpose + 0.5 );
+    				if ( util::almost_equal( transpose, (util::floating_t)base, (util::floating_t)1e-4 ) ) {
+    					bases.insert( base );
+    				}
+    			}
+    		}
+    		if ( bases.empty() ) {
+    			bases.insert( 0 );
+    		}
+    		for ( int pitch = filtering::WAVE_MIN_PITCH; pitch <= filtering::WAVE_MAX_PITCH; ++pitch ) {
+    			// The wave itself plays at no transpose, unless its rate is off.
+    			if ( pitch == 0 && rates[i] == client->get_sample_rate() ) {
+    				continue;
+    			}
+    			PitchRequest request = { INT_MAX, i, pitch };
+    			std::set<int>::const_iterator it;
+    			for ( it = bases.begin(); it != bases.end(); ++it ) {
+    				request.distance = std::min( request.distance, abs( pitch - *it ) );
+    			}
+    			requests.push_back( request );
+    		}
+    	}
+    	std::sort( requests.begin(), requests.end() );
+    	size_t used = 0;
+    	for ( size_t k = 0; k < requests.size(); ++k ) {
+    		const PitchRequest& request = requests[k];
+    		size_t bytes = filtering::PitchTable::to_frames( sizes[ request.sound ],
+    				filtering::PitchTable::to_step( request.pitch, rates[ request.sound ], client->get_sample_rate() ) )
+    				* sizeof( jack::sample_t );
+    		if ( used + bytes <= pitch_budget ) {
+    			used += bytes;
+    			jobs[ request.sound ]->add( request.pitch );
+    		}
+    	}
+    }
 public:
-    Engine( const std::string& name ) :
+    // The engine owns the backend it runs on. The sequencer is only
+    // needed by an ALSA MIDI input and may be null.
+    Engine( jack::Client* client, alsa::Sequencer* sequencer, alsa::IMidiInput* midi_input,
+    		const size_t& workers = threading::DEF_WORKERS ) :
     	IEngine(),
     	jack::Listener(),
     	alsa::MidiInputListener(),
-		client( new jack::Client( name ) ),
+		client( client ),
+		pool( new voicing::Pool( client ) ),
+		batch( client ),
+		crew( new threading::Crew( client, workers ) ),
+		renderer( new StretchRenderer( sounds, &rendered, &returned ) ),
+		worker( new threading::Worker( renderer ) ),
+		returning( false ),
+		pitch_budget( filtering::WAVE_DEF_PITCH_BUDGET ),
         output_left( new jack::AudioOutput( client, "out-L" ) ),
         output_right( new jack::AudioOutput( client, "out-R" ) ),
-        sequencer( new alsa::Sequencer( name ) ),
-        midi_input( new alsa::MidiInput( sequencer, name ) ),
+        sequencer( sequencer ),
+        midi_input( midi_input ),
 		stretch_offset( filtering::TIME_STRETCH_DEF_STRETCH ),
 		stretch_wheel( 0 ),
 		volume( filtering::GAIN_DEF_VOLUME ),
@@ -703,7 +1431,9 @@ public:
 		transpose_wheel( 0 ),
 		linked( false ),
 		soloed( 0 ),
+		presets( new persistence::Presets() ),
 		selected_preset( 0 ),
+		recalled_preset( -1 ),
 		base_channel( util::MIDI_CONT_BASE_CHANNEL ),
 		base_note( midi::MIDDLE_C ),
 		local_keyboard( false ),
@@ -712,6 +1442,12 @@ public:
 		mono( false ),
 		note_map( util::NOTE_MAP_DEF_TYPE ) {
         std::ostringstream o;
+        // The processor is asked here rather than on the first period.
+        simd::Cpu::get_instance();
+        dispatch.map_notes( base_note, note_map );
+        for ( size_t i = 0; i < util::MAX_SOUNDS; ++i ) {
+        	generations[i] = 0;
+        }
         for ( size_t i = 0; i < util::MAX_SOUNDS; ++i ) {
         	o << "out" << ( i + 1 );
         	if ( i < 6 ) {
@@ -729,28 +1465,59 @@ public:
 		for ( size_t i = 0; i < util::MAX_SOUNDS; ++i ) {
 			sounds[i]->acquire();
 		}
+        batch.set_meter( &meter );
         client->add_jack_listener( this );
 		midi_input->add_listener( this );
     }
     ~Engine() {
+    	Command command;
     	client->deactivate();
         client->remove_jack_listener( this );
 		midi_input->remove_listener( this );
+		delete worker;
+		renderer->collect();
+		delete renderer;
+		while ( commands.pop( command ) ) {
+			if ( command.type == COMMAND_SOUND_WAVE || command.type == COMMAND_ENGINE_PRESETS ) {
+				dispose( command );
+			}
+		}
+		delete presets;
+		while ( rendered.pop( command ) ) {
+			dispose( command );
+		}
         for ( size_t i = 0; i < util::MAX_SOUNDS; ++i ) {
             delete sounds[i];
         }
+        delete crew;
+        delete pool;
         delete midi_input;
         delete sequencer;
         delete output_left;
         delete output_right;
         delete client;
     }
+    // Engine on the JACK server, with MIDI from the given driver.
+    static Engine* create( const std::string& name, const size_t& workers = threading::DEF_WORKERS,
+    		const MidiDriver& midi_driver = MIDI_DRIVER_DEF ) {
+    	jack::Client* client = new jack::JackClient( name );
+    	alsa::Sequencer* sequencer = 0;
+    	alsa::IMidiInput* midi_input;
+    	if ( MIDI_DRIVER_ALSA == midi_driver ) {
+    		sequencer = new alsa::Sequencer( name );
+    		midi_input = new alsa::MidiInput( sequencer, name, client );
+    	} else {
+    		midi_input = new jack::MidiInput( client, "midi-in" );
+    	}
+    	return new Engine( client, sequencer, midi_input, workers );
+    }
     //////////////////////////////////////////////////////
     const util::NoteMapType& get_note_map() const {
     	return note_map;
     }
 	void set_note_map( const util::NoteMapType& note_map, const bool& fire = true ) {
 		this->note_map = note_map;
+		dispatch.map_notes( base_note, note_map );
 		fire_note_map( note_map, fire );
 	}
     const std::string& get_name() const {
@@ -773,6 +1540,7 @@ public:
     }
     void set_base_note( const unsigned char& base_note, const bool& fire = true ) {
     	this->base_note = base_note;
+    	dispatch.map_notes( base_note, note_map );
     	fire_base_note( base_note );
     }
     const bool is_local_keyboard() const {
@@ -816,6 +1584,11 @@ public:
     }
     void load_document() {
     	document.load();
+    	post_presets();
+    }
+    // Sends a copy of the presets to the audio thread, after a change.
+    void post_presets() {
+    	post( Command( new persistence::Presets( document.get_root().get_presets() ) ) );
     }
     void save_document() {
     	document.save();
@@ -823,6 +1596,9 @@ public:
     void load_waves() {
     	util::StringPair base = util::path_split( util::string_strip( get_document_file() ) );
     	std::string path;
+    	std::vector<PitchJob*> jobs( util::MAX_SOUNDS, (PitchJob*)0 );
+    	jack_nframes_t sizes[ util::MAX_SOUNDS ];
+    	jack_nframes_t rates[ util::MAX_SOUNDS ];
     	size_t i = 0;
     	persistence::Waves::const_iterator it;
     	for ( it = document.get_root().get_waves().begin();
@@ -834,25 +1610,69 @@ public:
     			base.second = path;
     			get_sounds()[i]->set_file_name( util::path_join( base ) );
     		}
-			get_sounds()[i]->load();
+			// Read here, installed by the audio thread.
+			jack::sample_t* buffer;
+			jack_nframes_t buffer_size;
+			jack_nframes_t sample_rate;
+			if ( get_sounds()[i]->read_wave( buffer, buffer_size, sample_rate ) ) {
+				jobs[i] = new PitchJob( get_sounds()[i], i, &rendered, renderer, ++generations[i],
+						buffer, buffer_size, sample_rate, client->get_sample_rate() );
+				sizes[i] = buffer_size;
+				rates[i] = sample_rate;
+				post( Command( get_sounds()[i], buffer, buffer_size, sample_rate ) );
+			}
+    	}
+    	// The copies are made in the background and come in when ready.
+    	plan_pitches( jobs, sizes, rates );
+    	for ( i = 0; i < util::MAX_SOUNDS; ++i ) {
+    		if ( jobs[i] ) {
+    			worker->queue( jobs[i] );
+    		}
     	}
     }
+    // Memory the copies of the waves may take, in bytes; none when zero.
+    void set_pitch_budget( const size_t& pitch_budget ) {
+    	this->pitch_budget = pitch_budget;
+    }
+    const size_t& get_pitch_budget() const {
+    	return pitch_budget;
+    }
+    // Memory the renders of the stretches may take, in bytes; none when zero.
+    void set_stretch_budget( const size_t& stretch_budget ) {
+    	renderer->set_budget( stretch_budget );
+    }
+    const size_t& get_stretch_budget() const {
+    	return renderer->get_budget();
+    }
+    // Level decaying tails are cut to zero at; never when zero.
+    void set_tail_threshold( const util::floating_t& tail_threshold ) {
+    	pool->set_tail_threshold( tail_threshold );
+    }
+    const util::floating_t& get_tail_threshold() const {
+    	return pool->get_tail_threshold();
+    }
+    // Blocks until the copies and the stretches asked for are rendered.
+    // They are installed at the start of the next period.
+    void wait_renders() {
+    	worker->wait();
+    }
     void load_repulse() {
     	set_selected_preset( document.get_root().get_selected_preset() );
-    	recall_preset( get_selected_preset() );
+    	post( Command( &Engine::recall_preset, (size_t)get_selected_preset() ) );
     }
     void save_repulse() {
     	document.get_root().set_selected_preset( get_selected_preset() );
 		save_document();
     }
     void next_preset() {
-    	selected_preset = ( selected_preset + 1 ) % document.get_root().get_presets().size();
+    	set_selected_preset( ( get_selected_preset() + 1 ) % document.get_root().get_presets().size() );
     }
     void previous_preset() {
-    	selected_preset--;
-		if ( selected_preset < 0 ) {
-			selected_preset = document.get_root().get_presets().size() - 1;
+    	int selected = get_selected_preset() - 1;
+		if ( selected < 0 ) {
+			selected = document.get_root().get_presets().size() - 1;
 		}
+		set_selected_preset( selected );
     }
     size_t create_preset() {
     	std::ostringstream o;
@@ -862,18 +1682,21 @@ public:
     size_t create_preset( const std::string& name ) {
     	document.get_root().get_presets().push_back( persistence::Preset( name ) );
     	save_document();
+    	post_presets();
     	return document.get_root().get_presets().size() - 1;
     }
     void delete_preset( const size_t& id ) {
     	if ( id < document.get_root().get_presets().size() ) {
     		document.get_root().get_presets().erase( document.get_root().get_presets().begin() + id );
     		save_document();
+    		post_presets();
     	}
     }
     void rename_preset( const size_t& id, const std::string& name ) {
     	if ( id < document.get_root().get_presets().size() ) {
     		document.get_root().get_presets()[ id ].set_name( name );
     		save_document();
+    		post_presets();
     	}
     }
     void save_preset( const size_t& id ) {
@@ -897,11 +1720,13 @@ public:
 				sounds[ i ]->save_preset( *it );
 			}
 			save_document();
+			post_presets();
     	}
     }
+    // Runs on the audio thread, from its copy of the presets.
     void recall_preset( const size_t& id, const bool& fire = false ) {
-    	if ( id < document.get_root().get_presets().size() ) {
-    		persistence::Preset& preset = document.get_root().get_presets()[ id ];
+    	if ( id < presets->size() ) {
+    		const persistence::Preset& preset = (*presets)[ id ];
 			set_volume( preset.get_engine().get_volume(), fire );
 			set_stretch_offset( preset.get_engine().get_stretch(), fire );
 			set_transpose_offset( preset.get_engine().get_transpose(), fire );
@@ -914,37 +1739,57 @@ public:
 			set_mono( preset.get_engine().is_mono(), fire );
 			set_note_map( preset.get_engine().get_note_map(), fire );
 			size_t i = 0;
-			persistence::Sounds::iterator it;
+			persistence::Sounds::const_iterator it;
 			for ( it = preset.get_sounds().begin(); it != preset.get_sounds().end() && i < util::MAX_SOUNDS; ++it, ++i ) {
 				sounds[ i ]->recall_preset( *it, fire );
 			}
-			set_selected_preset( id, fire );
+			__sync_lock_test_and_set( &recalled_preset, (int)id );
     	}
     }
+	// From the user interface, which takes a recalled preset first.
 	const int& get_selected_preset() {
+		int recalled = __sync_lock_test_and_set( &recalled_preset, -1 );
+		if ( recalled >= 0 ) {
+			selected_preset = recalled;
+		}
 		return selected_preset;
 	}
 	void set_selected_preset( const int& selected_preset, const bool& fire = true ) {
 		this->selected_preset = selected_preset;
 	}
 	const std::string& get_selected_preset_name() {
-		return get_document().get_root().get_presets()[ get_selected_preset() ].get_name();
+		if ( (size_t)get_selected_preset() < document.get_root().get_presets().size() ) {
+			return document.get_root().get_presets()[ get_selected_preset() ].get_name();
+		}
+		return util::BLANK;
 	}
     virtual jack::Client* get_client() const {
 		return client;
 	}
+	voicing::Pool* get_pool() const {
+		return pool;
+	}
+	metering::Load& get_meter() {
+		return meter;
+	}
+	// Has the worker render a stretch, from the audio thread.
+	void request_stretch( const StretchRequest& request ) {
+		if ( renderer->request( request ) ) {
+			worker->wake();
+		}
+	}
+	// Queues a change for the audio thread. Only one thread may post.
+	void post( const Command& command ) {
+		while ( !commands.push( command ) ) {
+			usleep( 1000 );
+		}
+	}
     void add_listener( EngineListener* listener ) {
 		listeners.insert( listener );
 	}
 	void remove_listener( EngineListener* listener ) {
 		listeners.erase( listener );
 	}
-	void add_midi_listener( alsa::MidiInputListener* midi_listener ) {
-		midi_input->add_listener( midi_listener );
-	}
-	void remove_midi_listener( alsa::MidiInputListener* midi_listener ) {
-		midi_input->remove_listener( midi_listener );
-	}
 	void solo( const util::SoundIdentifier& id, const bool& active, const bool& fire = true ) {
 		Sound* sound = sounds[ id ];
 		if ( active && !sound->is_soloed() ) {
@@ -1016,31 +1861,74 @@ public:
     Sound** get_sounds() {
     	return sounds;
     }
-	void on_process( jack::Client* client ) {
+	void render( const jack_nframes_t& offset ) {
         size_t i;
         Sound* sound;
-        // Mixdown
-        midi_input->next();
+        // Render every voice, spread over the crew when there is one.
+        batch.clear();
+        for ( i = 0; i < util::MAX_SOUNDS; ++i ) {
+        	sounds[i]->render( batch );
+        }
+        batch.render( crew );
         if ( is_mono() ) {
 			for ( i = 0; i < util::MAX_SOUNDS; ++i ) {
 				sound = sounds[i];
-				sound->filter( sound->get_buffer() );
+				sound->filter( sound->get_buffer() + offset );
 			}
         } else {
-            jack::sample_t* buffer_sound;
-			memset( buffer_left, 0, client->get_data_size() );
-			memset( buffer_right, 0, client->get_data_size() );
-			jack_nframes_t buffer_size = client->get_buffer_size();
+        	mix.clear();
 			for ( i = 0; i < util::MAX_SOUNDS; ++i ) {
 				sound = sounds[i];
-				buffer_sound = sound->get_buffer();
-				sound->filter( buffer_sound );
-				for ( jack_nframes_t j = 0; j < buffer_size; ++j ) {
-					buffer_right[j] += buffer_sound[j] * sound->get_mix_right();
-					buffer_left[j] += buffer_sound[j] * sound->get_mix_left();
+				sound->filter( sound->get_buffer() + offset );
+				if ( !sound->is_silent() ) {
+					// Each voice keeps the panning of the note that started it.
+					size_t j = 0;
+					voicing::Voice* voice;
+					while ( ( voice = pool->next( i, j ) ) != 0 ) {
+						if ( !voice->is_silent() ) {
+							mix.add( voice->get_buffer(), voice->get_mix_left(), voice->get_mix_right() );
+						}
+					}
 				}
 			}
+			mix.mix( buffer_left + offset, buffer_right + offset, client->get_block_size() );
+        }
+	}
+	void on_process( jack::Client* client ) {
+        metering::nanoseconds_t start = metering::now();
+        const Command* command;
+        util::set_denormals_zero();
+        jack_nframes_t frames = client->get_buffer_size();
+        jack_nframes_t offset = 0;
+        jack_nframes_t next;
+        while ( ( command = commands.front() ) != 0 && can_execute( *command ) ) {
+        	execute( *command );
+        	commands.pop();
+        }
+        install();
+        if ( returning ) {
+        	returning = false;
+        	worker->wake();
         }
+        // Mixdown, split where events fall inside the period.
+        midi_input->begin();
+        while ( offset < frames ) {
+        	next = midi_input->next( offset );
+        	client->set_block_size( next - offset );
+        	render( offset );
+        	offset = next;
+        }
+        client->set_block_size( frames );
+        meter.add_process( metering::now() - start, frames, client->get_sample_rate() );
+	}
+	// True once every sound has faded out.
+	bool is_silent() const {
+		for ( size_t i = 0; i < util::MAX_SOUNDS; ++i ) {
+			if ( !sounds[i]->is_silent() ) {
+				return false;
+			}
+		}
+		return true;
 	}
 	void all_sound_off() {
 		for ( size_t i = 0; i < util::MAX_SOUNDS; ++i ) {
@@ -1060,36 +1948,83 @@ public:
 		}
 	}
 	//////////////////////////////////////////////////////////////////////////
-	void on_controller( alsa::IMidiInput* input, const midi::Controller* event ) {
+	void on_note_off( alsa::IMidiInput* input, const midi::NoteOff* event ) {
+		if ( is_omni() || event->get_channel() == get_base_channel() ) {
+			const unsigned char& id = dispatch.get_sound( event->get_note() );
+			if ( id != util::MIDI_NO_SOUND ) {
+				sounds[ id ]->note_off();
+			}
+		}
+	}
+	void on_note_on( alsa::IMidiInput* input, const midi::NoteOn* event ) {
 		if ( is_omni() || event->get_channel() == get_base_channel() ) {
-			if ( event->get_controller() == util::MIDI_CONT_ENGINE_LINKED_C10 ) {
-				set_linked( util::controller_to_bool( event->get_value() ), false );
-			} else if ( event->get_controller() == util::MIDI_CONT_ENGINE_TRANSPOSE_C10 ) {
-				set_transpose_offset( util::controller_to_decimal_center( event->get_value(),
-						filtering::TUNER_MIN_TRANSPOSE, filtering::TUNER_MAX_TRANSPOSE ), false );
-			} else if ( event->get_controller() == util::MIDI_CONT_ENGINE_STRETCH_C10 ) {
-				set_stretch_offset( util::controller_to_decimal_center( event->get_value(),
-						filtering::TIME_STRETCH_MIN_STRETCH, filtering::TIME_STRETCH_MAX_STRETCH ), false );
-			} else if ( event->get_controller() == util::MIDI_CONT_ENGINE_VOLUME_C10 ) {
-				set_volume( util::controller_to_decimal_center( event->get_value(),
-						filtering::GAIN_MIN_VOLUME, filtering::GAIN_MAX_VOLUME ), false );
-			} else if ( event->get_controller() == util::MIDI_CONT_ENGINE_ALL_SOUND_OFF_C10 ) {
-				all_sound_off();
-			} else if ( event->get_controller() == util::MIDI_CONT_ENGINE_ALL_CONTROLLERS_OFF_C10 ) {
-				all_controllers_off();
-			} else if ( event->get_controller() == util::MIDI_CONT_ENGINE_LOCAL_KEYBOARD_C10 ) {
-				set_local_keyboard( util::controller_to_bool( event->get_value() ) );
-			} else if ( event->get_controller() == util::MIDI_CONT_ENGINE_ALL_NOTES_OFF_C10 ) {
-				all_notes_off();
-			} else if ( event->get_controller() == util::MIDI_CONT_ENGINE_OMNI_MODE_OFF_C10 ) {
-				set_omni( !util::controller_to_bool( event->get_value() ) );
-			} else if ( event->get_controller() == util::MIDI_CONT_ENGINE_OMNI_MODE_ON_C10 ) {
-				set_omni( util::controller_to_bool( event->get_value() ) );
-			} else if ( event->get_controller() == util::MIDI_CONT_ENGINE_MONO_OPERATION_C10 ) {
-				set_mono( util::controller_to_bool( event->get_value() ) );
+			const unsigned char& id = dispatch.get_sound( event->get_note() );
+			if ( id == util::MIDI_NO_SOUND ) {
+				return;
+			}
+			if ( event->is_note_off() ) {
+				sounds[ id ]->note_off();
+			} else {
+				sounds[ id ]->note_on( event->get_velocity() );
 			}
 		}
 	}
+	void on_controller( alsa::IMidiInput* input, const midi::Controller* event ) {
+		util::MidiRow row = util::MIDI_ROW_OTHER;
+		if ( event->get_channel() == get_base_channel() ) {
+			row = util::MIDI_ROW_C10;
+		} else if ( event->get_channel() == get_base_channel() + 1 ) {
+			row = util::MIDI_ROW_C11;
+		}
+		const util::MidiTarget& target = dispatch.get_target( row, event->get_controller() );
+		if ( target.sound != util::MIDI_NO_SOUND ) {
+			sounds[ target.sound ]->control( target.parameter, event->get_value() );
+			return;
+		}
+		if ( !is_omni() && row != util::MIDI_ROW_C10 ) {
+			return;
+		}
+		switch ( target.parameter ) {
+		case util::MIDI_PARAMETER_ENGINE_LINKED:
+			set_linked( util::controller_to_bool( event->get_value() ), false );
+			break;
+		case util::MIDI_PARAMETER_ENGINE_TRANSPOSE:
+			set_transpose_offset( util::controller_to_decimal_center( event->get_value(),
+					filtering::TUNER_MIN_TRANSPOSE, filtering::TUNER_MAX_TRANSPOSE ), false );
+			break;
+		case util::MIDI_PARAMETER_ENGINE_STRETCH:
+			set_stretch_offset( util::controller_to_decimal_center( event->get_value(),
+					filtering::TIME_STRETCH_MIN_STRETCH, filtering::TIME_STRETCH_MAX_STRETCH ), false );
+			break;
+		case util::MIDI_PARAMETER_ENGINE_VOLUME:
+			set_volume( util::controller_to_decimal_center( event->get_value(),
+					filtering::GAIN_MIN_VOLUME, filtering::GAIN_MAX_VOLUME ), false );
+			break;
+		case util::MIDI_PARAMETER_ENGINE_ALL_SOUND_OFF:
+			all_sound_off();
+			break;
+		case util::MIDI_PARAMETER_ENGINE_ALL_CONTROLLERS_OFF:
+			all_controllers_off();
+			break;
+		case util::MIDI_PARAMETER_ENGINE_LOCAL_KEYBOARD:
+			set_local_keyboard( util::controller_to_bool( event->get_value() ) );
+			break;
+		case util::MIDI_PARAMETER_ENGINE_ALL_NOTES_OFF:
+			all_notes_off();
+			break;
+		case util::MIDI_PARAMETER_ENGINE_OMNI_MODE_OFF:
+			set_omni( !util::controller_to_bool( event->get_value() ) );
+			break;
+		case util::MIDI_PARAMETER_ENGINE_OMNI_MODE_ON:
+			set_omni( util::controller_to_bool( event->get_value() ) );
+			break;
+		case util::MIDI_PARAMETER_ENGINE_MONO_OPERATION:
+			set_mono( util::controller_to_bool( event->get_value() ) );
+			break;
+		default:
+			break;
+		}
+	}
 	void on_program_change( alsa::IMidiInput* input, const midi::ProgramChange* event ) {
 		if ( is_omni() || event->get_channel() == get_base_channel() ) {
 			recall_preset( event->get_program(), false );
@@ -1119,23 +2054,13 @@ public:
 	void on_shutdown( jack::Client* client ) {
 		// TODO: implement
 	}
+	void on_xrun( jack::Client* client ) {
+		meter.add_xrun();
+	}
 	//////////////////////////////////////////////////////////////////////////
     void auto_connect() {
-    	const char** ports;
-    	if ( ( ports = jack_get_ports( client->get_jack_client(), 0, 0, JackPortIsPhysical | JackPortIsInput ) ) != 0 ) {
-			int i = 0;
-			while ( ports[i] != 0 && i < 2 ) {
-				switch ( i ) {
-				case 0:
-					jack_connect( client->get_jack_client(), jack_port_name( output_left->get_jack_port() ), ports[i] );
-					break;
-				case 1:
-					jack_connect( client->get_jack_client(), jack_port_name( output_right->get_jack_port() ), ports[i] );
-					break;
-				}
-				i++;
-			}
-    	}
+    	client->connect_physical( output_left->get_jack_port(), 0 );
+    	client->connect_physical( output_right->get_jack_port(), 1 );
     }
 };
 
@@ -0,0 +1,135 @@
+/**
+ * This file is part of repulse.
+ * (c) 2010 and onwards Juan Carlos Rodrigo Garcia.
+ *
+ * repulse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * repulse is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with repulse.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#include <string>
+#include <cpu_detect.h>
+
+// Kernels above the SSE2 baseline are built for their instruction set with
+// function attributes, whatever the compiler flags, and only run where the
+// processor has it.
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#include <immintrin.h>
+#define SIMD_X86
+#define SIMD_AVX2_TARGET __attribute__(( target( "avx2,fma" ) ))
+#define SIMD_AVX512_TARGET __attribute__(( target( "avx512f,avx2,fma" ) ))
+#endif
+
+// The variant of a kernel for a level, or none where it is not built.
+#if defined( __SSE2__ )
+#define SIMD_SSE2_VARIANT( f ) f
+#else
+#define SIMD_SSE2_VARIANT( f ) 0
+#endif
+#if defined( SIMD_X86 )
+#define SIMD_X86_VARIANT( f ) f
+#else
+#define SIMD_X86_VARIANT( f ) 0
+#endif
+
+namespace simd {
+
+// Instruction sets the kernels come in. The AVX2 level takes FMA along.
+enum Level {
+	LEVEL_SCALAR = 0,
+	LEVEL_SSE2,
+	LEVEL_AVX2,
+	LEVEL_AVX512
+};
+
+static const Level LEVEL_LAST_TYPE = LEVEL_AVX512;
+static const char* const LEVEL_NAMES[] = { "scalar", "sse2", "avx2", "avx512" };
+
+// Extensions SoundTouch must leave alone at each level, so that the time
+// stretch runs the same instruction set as the rest.
+static const unsigned int LEVEL_DISABLED[] = {
+	0xffffffff,
+	SUPPORT_AVX2 | SUPPORT_FMA | SUPPORT_AVX512,
+	SUPPORT_AVX512,
+	0
+};
+
+// The processor, asked once what it runs. Every kernel follows the level
+// selected here, SoundTouch included.
+class Cpu {
+	unsigned int extensions;
+	Level best;
+	Level level;
+	Cpu() : extensions( detectCPUextensions() ), best( LEVEL_SCALAR ), level( LEVEL_SCALAR ) {
+#if defined( __SSE2__ )
+		best = LEVEL_SSE2;
+#endif
+#if defined( SIMD_X86 )
+		if ( ( extensions & ( SUPPORT_AVX2 | SUPPORT_FMA ) ) == ( SUPPORT_AVX2 | SUPPORT_FMA ) ) {
+			best = LEVEL_AVX2;
+			if ( extensions & SUPPORT_AVX512 ) {
+				best = LEVEL_AVX512;
+			}
+		}
+#endif
+		select( best );
+	}
+public:
+	static Cpu& get_instance() {
+		static Cpu instance;
+		return instance;
+	}
+	const Level& get_best() const { return best; }
+	const Level& get_level() const { return level; }
+	// Runs no more than the given level from now on. Time stretches made
+	// before keep theirs, so this goes before the engine is created.
+	bool select( const Level& level ) {
+		if ( level > best ) {
+			return false;
+		}
+		this->level = level;
+		disableExtensions( LEVEL_DISABLED[ level ] );
+		return true;
+	}
+	// The level of the given name, LEVEL_LAST_TYPE + 1 if none.
+	static size_t find( const std::string& name ) {
+		size_t i = LEVEL_SCALAR;
+		while ( i <= LEVEL_LAST_TYPE && name != LEVEL_NAMES[i] ) {
+			++i;
+		}
+		return i;
+	}
+};
+
+// The variants of one kernel, filled in upwards so that a level without a
+// variant of its own runs the one below it.
+template < typename F >
+class Kernel {
+	F variants[ LEVEL_LAST_TYPE + 1 ];
+public:
+	Kernel( F scalar, F sse2 = 0, F avx2 = 0, F avx512 = 0 ) {
+		variants[ LEVEL_SCALAR ] = scalar;
+		variants[ LEVEL_SSE2 ] = sse2 ? sse2 : variants[ LEVEL_SCALAR ];
+		variants[ LEVEL_AVX2 ] = avx2 ? avx2 : variants[ LEVEL_SSE2 ];
+		variants[ LEVEL_AVX512 ] = avx512 ? avx512 : variants[ LEVEL_AVX2 ];
+	}
+	const F& get() const {
+		return variants[ Cpu::get_instance().get_level() ];
+	}
+};
+
+} // namespace simd
+
+#endif /* SIMD_H_ */
@@ -0,0 +1,359 @@
+/**
+ * This file is part of repulse.
+ * (c) 2010 and onwards Juan Carlos Rodrigo Garcia.
+ *
+ * repulse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * repulse is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with repulse.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THREADING_H_
+#define THREADING_H_
+
+#include <cassert>
+#include <climits>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "jack.h"
+#include "util.h"
+
+namespace threading {
+
+static const size_t MAX_WORKERS = 16;
+static const size_t DEF_WORKERS = 0;
+static const int    BARRIER_SPINS = 4096;
+static const size_t CACHE_LINE = 64;
+
+static inline void relax() {
+#if defined( __i386__ ) || defined( __x86_64__ )
+	__asm__ __volatile__ ( "pause" ::: "memory" );
+#else
+	__sync_synchronize();
+#endif
+}
+
+static inline void futex_wait( volatile int* address, const int& value ) {
+	syscall( SYS_futex, (int*)address, FUTEX_WAIT_PRIVATE, value, 0, 0, 0 );
+}
+
+static inline void futex_wake( volatile int* address ) {
+	syscall( SYS_futex, (int*)address, FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0 );
+}
+
+// Reusable barrier. Waiters spin for a while, since the next period is
+// usually close, and then sleep on a futex. The last one to arrive only
+// enters the kernel when somebody is actually sleeping.
+class Barrier {
+	int parties;
+	volatile int arrived;
+	volatile int generation;
+	volatile int sleepers;
+public:
+	Barrier( const int& parties ) :
+		parties( parties ), arrived( 0 ), generation( 0 ), sleepers( 0 ) {}
+	virtual ~Barrier() {}
+	void wait() {
+		int current = generation;
+		if ( __sync_add_and_fetch( &arrived, 1 ) == parties ) {
+			arrived = 0;
+			__sync_add_and_fetch( &generation, 1 );
+			if ( sleepers > 0 ) {
+				futex_wake( &generation );
+			}
+		} else {
+			for ( int i = 0; i < BARRIER_SPINS && current == generation; ++i ) {
+				relax();
+			}
+			while ( current == generation ) {
+				__sync_add_and_fetch( &sleepers, 1 );
+				futex_wait( &generation, current );
+				__sync_sub_and_fetch( &sleepers, 1 );
+			}
+			__sync_synchronize();
+		}
+	}
+};
+
+// Wait-free queue between exactly one producer and one consumer thread.
+// The indices live on their own cache lines so that the two sides do not
+// fight over them.
+template< class T, size_t SIZE >
+class Ring {
+	T items[ SIZE ];
+	char padding_items[ CACHE_LINE ];
+	volatile size_t head;
+	char padding_head[ CACHE_LINE - sizeof( size_t ) ];
+	volatile size_t tail;
+	char padding_tail[ CACHE_LINE - sizeof( size_t ) ];
+public:
+	Ring() : head( 0 ), tail( 0 ) {}
+	virtual ~Ring() {}
+	bool push( const T& item ) {
+		size_t next = ( tail + 1 ) % SIZE;
+		if ( next == head ) {
+			return false;
+		}
+		items[ tail ] = item;
+		__sync_synchronize();
+		tail = next;
+		return true;
+	}
+	bool pop( T& item ) {
+		if ( head == tail ) {
+			return false;
+		}
+		__sync_synchronize();
+		item = items[ head ];
+		__sync_synchronize();
+		head = ( head + 1 ) % SIZE;
+		return true;
+	}
+	// The oldest item, left in place until pop() drops it.
+	const T* front() const {
+		if ( head == tail ) {
+			return 0;
+		}
+		__sync_synchronize();
+		return &items[ head ];
+	}
+	void pop() {
+		__sync_synchronize();
+		head = ( head + 1 ) % SIZE;
+	}
+	bool is_empty() const {
+		return head == tail;
+	}
+	// Items the producer may still push; the consumer only ever adds to it.
+	size_t get_free() const {
+		return ( head + SIZE - tail - 1 ) % SIZE;
+	}
+};
+
+class Job {
+public:
+	Job() {}
+	virtual ~Job() {}
+	virtual void run( const size_t& index ) = 0;
+};
+
+class Crew;
+
+struct Seat {
+	Crew* crew;
+	size_t index;
+};
+
+// Worker threads that help the calling thread with a job. Each period the
+// caller opens the start barrier, everybody takes items until none are
+// left, and the caller returns once all of them met at the finish barrier.
+class Crew {
+	pthread_t threads[ MAX_WORKERS ];
+	Seat seats[ MAX_WORKERS ];
+	size_t workers;
+	Barrier* start;
+	Barrier* finish;
+	Job* job;
+	size_t count;
+	volatile size_t next;
+	volatile bool quit;
+	static void* callback( void* arg ) {
+		Seat* seat = (Seat*)arg;
+		seat->crew->on_thread( seat->index );
+		return 0;
+	}
+protected:
+	void work() {
+		size_t i;
+		while ( ( i = __sync_fetch_and_add( &next, 1 ) ) < count ) {
+			job->run( i );
+		}
+	}
+	void pin( const size_t& index ) {
+		// The first processor is left to the JACK thread.
+		long processors = sysconf( _SC_NPROCESSORS_ONLN );
+		if ( processors > 1 ) {
+			cpu_set_t set;
+			CPU_ZERO( &set );
+			CPU_SET( ( index + 1 ) % processors, &set );
+			pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+		}
+	}
+	void on_thread( const size_t& index ) {
+		pin( index );
+		util::set_denormals_zero();
+		for ( ;; ) {
+			start->wait();
+			if ( quit ) {
+				break;
+			}
+			work();
+			finish->wait();
+		}
+	}
+	bool spawn( const size_t& index, const int& priority ) {
+		pthread_attr_t attr;
+		struct sched_param param;
+		bool ret;
+		pthread_attr_init( &attr );
+		if ( priority >= 0 ) {
+			param.sched_priority = priority;
+			pthread_attr_setinheritsched( &attr, PTHREAD_EXPLICIT_SCHED );
+			pthread_attr_setschedpolicy( &attr, SCHED_FIFO );
+			pthread_attr_setschedparam( &attr, &param );
+		}
+		ret = 0 == pthread_create( &threads[ index ], &attr, callback, &seats[ index ] );
+		pthread_attr_destroy( &attr );
+		return ret;
+	}
+public:
+	Crew( jack::Client* client, const size_t& workers ) :
+		workers( workers < MAX_WORKERS ? workers : MAX_WORKERS ),
+		start( 0 ), finish( 0 ), job( 0 ), count( 0 ), next( 0 ), quit( false ) {
+		// Workers run at the priority of the JACK thread they help.
+		int priority = client->is_realtime() ? client->get_realtime_priority() : -1;
+		start = new Barrier( this->workers + 1 );
+		finish = new Barrier( this->workers + 1 );
+		for ( size_t i = 0; i < this->workers; ++i ) {
+			seats[i].crew = this;
+			seats[i].index = i;
+			if ( !spawn( i, priority ) ) {
+				// Without real time privileges a normal thread still helps.
+				bool spawned = spawn( i, -1 );
+				assert( spawned );
+			}
+		}
+	}
+	virtual ~Crew() {
+		quit = true;
+		start->wait();
+		for ( size_t i = 0; i < workers; ++i ) {
+			pthread_join( threads[i], 0 );
+		}
+		delete start;
+		delete finish;
+	}
+	const size_t& get_workers() const {
+		return workers;
+	}
+	void run( Job* job, const size_t& count ) {
+		if ( workers == 0 || count < 2 ) {
+			for ( size_t i = 0; i < count; ++i ) {
+				job->run( i );
+			}
+		} else {
+			this->job = job;
+			this->count = count;
+			next = 0;
+			start->wait();
+			work();
+			finish->wait();
+		}
+	}
+};
+
+static const size_t WORKER_JOBS = 64;
+
+// One background thread for work that must stay off the audio thread,
+// run in the order it was queued. Only one thread may queue jobs; the
+// worker owns them and deletes each one once it has run. The service, if
+// any, is run whenever the worker is woken, from whatever thread.
+class Worker {
+	pthread_t thread;
+	Ring<Job*, WORKER_JOBS> jobs;
+	Job* service;
+	volatile int queued;
+	volatile int pending;
+	volatile int wakes;
+	volatile bool quit;
+	static void* callback( void* arg ) {
+		((Worker*)arg)->on_thread();
+		return 0;
+	}
+protected:
+	void done( const int& count ) {
+		if ( __sync_sub_and_fetch( &pending, count ) == 0 ) {
+			futex_wake( &pending );
+		}
+	}
+	void on_thread() {
+		// Renders come out the same as on the audio thread.
+		util::set_denormals_zero();
+		for ( ;; ) {
+			int seen = queued;
+			Job* job;
+			while ( jobs.pop( job ) ) {
+				job->run( 0 );
+				delete job;
+				done( 1 );
+			}
+			// Wakes that come in while the service runs get another turn.
+			int woken = __sync_lock_test_and_set( &wakes, 0 );
+			if ( woken ) {
+				service->run( 0 );
+				done( woken );
+			}
+			if ( quit ) {
+				break;
+			}
+			futex_wait( &queued, seen );
+		}
+	}
+	void signal() {
+		__sync_add_and_fetch( &queued, 1 );
+		futex_wake( &queued );
+	}
+public:
+	Worker( Job* service = 0 ) : service( service ), queued( 0 ), pending( 0 ), wakes( 0 ), quit( false ) {
+		bool spawned = 0 == pthread_create( &thread, 0, callback, this );
+		assert( spawned );
+	}
+	virtual ~Worker() {
+		quit = true;
+		signal();
+		pthread_join( thread, 0 );
+		Job* job;
+		while ( jobs.pop( job ) ) {
+			delete job;
+		}
+	}
+	void queue( Job* job ) {
+		__sync_add_and_fetch( &pending, 1 );
+		while ( !jobs.push( job ) ) {
+			usleep( 1000 );
+		}
+		signal();
+	}
+	// Has the service run soon. Never blocks, so the audio thread may call it.
+	void wake() {
+		assert( service );
+		__sync_add_and_fetch( &pending, 1 );
+		__sync_add_and_fetch( &wakes, 1 );
+		signal();
+	}
+	// Blocks until every queued job has run, and the service for every wake.
+	void wait() {
+		int left;
+		while ( ( left = pending ) > 0 ) {
+			futex_wait( &pending, left );
+		}
+	}
+	bool is_idle() const {
+		return pending == 0;
+	}
+};
+
+} // namespace threading
+
+#endif /* THREADING_H_ */
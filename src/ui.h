@@ -521,6 +521,11 @@ protected:
 	virtual repulse::Sound* get_sound() const {
 		return sound;
 	}
+	// Changes are applied by the audio thread.
+	template< class S, class T >
+	void post( S setter, const T& value ) {
+		sound->get_engine()->post( repulse::Command( sound, setter, value ) );
+	}
 	virtual BlockVector& get_blocks() {
 		return blocks;
 	}
@@ -585,99 +590,100 @@ public:
 		case ROW_START:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_start_time( sound->get_start_time() + 0.001 );
+				post( &repulse::Sound::set_start_time, sound->get_start_time() + 0.001 );
 				break;
 			case EDIT_DOWN:
-				sound->set_start_time( sound->get_start_time() - 0.001 );
+				post( &repulse::Sound::set_start_time, sound->get_start_time() - 0.001 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_start_time( sound->get_start_time() + 0.0001 );
+				post( &repulse::Sound::set_start_time, sound->get_start_time() + 0.0001 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_start_time( sound->get_start_time() - 0.0001 );
+				post( &repulse::Sound::set_start_time, sound->get_start_time() - 0.0001 );
 				break;
 			}
 			break;
 		case ROW_SOFT:
-			sound->set_start_soft( !sound->is_start_soft() );
+			post( &repulse::Sound::set_start_soft, !sound->is_start_soft() );
 			break;
 		case ROW_TRANSPOSE:
 			switch ( edit_mode ) {
 			case EDIT_UP:
 			case EDIT_UP_FINE:
-				sound->set_transpose( sound->get_transpose() + 1 );
+				post( &repulse::Sound::set_transpose, sound->get_transpose() + 1 );
 				break;
 			case EDIT_DOWN:
 			case EDIT_DOWN_FINE:
-				sound->set_transpose( sound->get_transpose() - 1 );
+				post( &repulse::Sound::set_transpose, sound->get_transpose() - 1 );
 				break;
 			}
 			break;
 		case ROW_TRANSPOSE_VELOCITY:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_transpose_velocity( sound->get_transpose_velocity() + 0.01 );
+				post( &repulse::Sound::set_transpose_velocity, sound->get_transpose_velocity() + 0.01 );
 				break;
 			case EDIT_DOWN:
-				sound->set_transpose_velocity( sound->get_transpose_velocity() - 0.01 );
+				post( &repulse::Sound::set_transpose_velocity, sound->get_transpose_velocity() - 0.01 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_transpose_velocity( sound->get_transpose_velocity() + 0.001 );
+				post( &repulse::Sound::set_transpose_velocity, sound->get_transpose_velocity() + 0.001 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_transpose_velocity( sound->get_transpose_velocity() - 0.001 );
+				post( &repulse::Sound::set_transpose_velocity, sound->get_transpose_velocity() - 0.001 );
 				break;
 			}
 			break;
 		case ROW_TRANSPOSE_RANDOM:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_transpose_random( sound->get_transpose_random() + 0.01 );
+				post( &repulse::Sound::set_transpose_random, sound->get_transpose_random() + 0.01 );
 				break;
 			case EDIT_DOWN:
-				sound->set_transpose_random( sound->get_transpose_random() - 0.01 );
+				post( &repulse::Sound::set_transpose_random, sound->get_transpose_random() - 0.01 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_transpose_random( sound->get_transpose_random() + 0.001 );
+				post( &repulse::Sound::set_transpose_random, sound->get_transpose_random() + 0.001 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_transpose_random( sound->get_transpose_random() - 0.001 );
+				post( &repulse::Sound::set_transpose_random, sound->get_transpose_random() - 0.001 );
 				break;
 			}
 			break;
 		case ROW_STRETCH:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_stretch( sound->get_stretch() + 0.01 );
+				post( &repulse::Sound::set_stretch, sound->get_stretch() + 0.01 );
 				break;
 			case EDIT_DOWN:
-				sound->set_stretch( sound->get_stretch() - 0.01 );
+				post( &repulse::Sound::set_stretch, sound->get_stretch() - 0.01 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_stretch( sound->get_stretch() + 0.001 );
+				post( &repulse::Sound::set_stretch, sound->get_stretch() + 0.001 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_stretch( sound->get_stretch() - 0.001 );
+				post( &repulse::Sound::set_stretch, sound->get_stretch() - 0.001 );
 				break;
 			}
 			break;
 		case ROW_STRETCH_VELOCITY:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_stretch_velocity( sound->get_stretch_velocity() + 0.01 );
+				post( &repulse::Sound::set_stretch_velocity, sound->get_stretch_velocity() + 0.01 );
 				break;
 			case EDIT_DOWN:
-				sound->set_stretch_velocity( sound->get_stretch_velocity() - 0.01 );
+				post( &repulse::Sound::set_stretch_velocity, sound->get_stretch_velocity() - 0.01 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_stretch_velocity( sound->get_stretch_velocity() + 0.001 );
+				post( &repulse::Sound::set_stretch_velocity, sound->get_stretch_velocity() + 0.001 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_stretch_velocity( sound->get_stretch_velocity() - 0.001 );
+				post( &repulse::Sound::set_stretch_velocity, sound->get_stretch_velocity() - 0.001 );
 				break;
 			}
 			break;
 		case ROW_STRETCH_TYPE:
+			tmp = sound->get_stretch_type();
 			switch ( edit_mode ) {
 			case EDIT_UP:
 			case EDIT_UP_FINE:
@@ -691,47 +697,48 @@ public:
 				}
 				break;
 			}
-			sound->set_stretch_type( (filtering::TimeStretchType)tmp );
+			post( &repulse::Sound::set_stretch_type, (filtering::TimeStretchType)tmp );
 			break;
 		case ROW_DRIVE:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_over_drive_drive( sound->get_over_drive_drive() + 1 );
+				post( &repulse::Sound::set_over_drive_drive, sound->get_over_drive_drive() + 1 );
 				break;
 			case EDIT_DOWN:
-				sound->set_over_drive_drive( sound->get_over_drive_drive() - 1 );
+				post( &repulse::Sound::set_over_drive_drive, sound->get_over_drive_drive() - 1 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_over_drive_drive( sound->get_over_drive_drive() + 0.1 );
+				post( &repulse::Sound::set_over_drive_drive, sound->get_over_drive_drive() + 0.1 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_over_drive_drive( sound->get_over_drive_drive() - 0.1 );
+				post( &repulse::Sound::set_over_drive_drive, sound->get_over_drive_drive() - 0.1 );
 				break;
 			}
 			break;
 		case ROW_SAT:
-			sound->set_over_drive_active( !sound->is_over_drive_active() );
+			post( &repulse::Sound::set_over_drive_active, !sound->is_over_drive_active() );
 			break;
 		case ROW_FREQ:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_filter_frequency( sound->get_filter_frequency() + 100 );
+				post( &repulse::Sound::set_filter_frequency, sound->get_filter_frequency() + 100 );
 				break;
 			case EDIT_DOWN:
-				sound->set_filter_frequency( sound->get_filter_frequency() - 100 );
+				post( &repulse::Sound::set_filter_frequency, sound->get_filter_frequency() - 100 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_filter_frequency( sound->get_filter_frequency() + 10 );
+				post( &repulse::Sound::set_filter_frequency, sound->get_filter_frequency() + 10 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_filter_frequency( sound->get_filter_frequency() - 10 );
+				post( &repulse::Sound::set_filter_frequency, sound->get_filter_frequency() - 10 );
 				break;
 			}
 			break;
 		case ROW_FILTER:
-			sound->set_filter_active( !sound->is_filter_active() );
+			post( &repulse::Sound::set_filter_active, !sound->is_filter_active() );
 			break;
 		case ROW_FILTER_TYPE:
+			tmp = sound->get_filter_type();
 			switch ( edit_mode ) {
 			case EDIT_UP:
 			case EDIT_UP_FINE:
@@ -745,73 +752,74 @@ public:
 				}
 				break;
 			}
-			sound->set_filter_type( (filtering::FrequencyFilterType)tmp );
+			post( &repulse::Sound::set_filter_type, (filtering::FrequencyFilterType)tmp );
 			break;
 		case ROW_RES:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_filter_resonance( sound->get_filter_resonance() - 0.05 );
+				post( &repulse::Sound::set_filter_resonance, sound->get_filter_resonance() - 0.05 );
 				break;
 			case EDIT_DOWN:
-				sound->set_filter_resonance( sound->get_filter_resonance() + 0.05 );
+				post( &repulse::Sound::set_filter_resonance, sound->get_filter_resonance() + 0.05 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_filter_resonance( sound->get_filter_resonance() - 0.005 );
+				post( &repulse::Sound::set_filter_resonance, sound->get_filter_resonance() - 0.005 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_filter_resonance( sound->get_filter_resonance() + 0.005 );
+				post( &repulse::Sound::set_filter_resonance, sound->get_filter_resonance() + 0.005 );
 				break;
 			}
 			break;
 		case ROW_FILTER_VELOCITY:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_filter_frequency_velocity( sound->get_filter_frequency_velocity() + 0.01 );
+				post( &repulse::Sound::set_filter_frequency_velocity, sound->get_filter_frequency_velocity() + 0.01 );
 				break;
 			case EDIT_DOWN:
-				sound->set_filter_frequency_velocity( sound->get_filter_frequency_velocity() - 0.01 );
+				post( &repulse::Sound::set_filter_frequency_velocity, sound->get_filter_frequency_velocity() - 0.01 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_filter_frequency_velocity( sound->get_filter_frequency_velocity() + 0.001 );
+				post( &repulse::Sound::set_filter_frequency_velocity, sound->get_filter_frequency_velocity() + 0.001 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_filter_frequency_velocity( sound->get_filter_frequency_velocity() - 0.001 );
+				post( &repulse::Sound::set_filter_frequency_velocity, sound->get_filter_frequency_velocity() - 0.001 );
 				break;
 			}
 			break;
 		case ROW_FILTER_RANDOM:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_filter_frequency_random( sound->get_filter_frequency_random() + 0.01 );
+				post( &repulse::Sound::set_filter_frequency_random, sound->get_filter_frequency_random() + 0.01 );
 				break;
 			case EDIT_DOWN:
-				sound->set_filter_frequency_random( sound->get_filter_frequency_random() - 0.01 );
+				post( &repulse::Sound::set_filter_frequency_random, sound->get_filter_frequency_random() - 0.01 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_filter_frequency_random( sound->get_filter_frequency_random() + 0.001 );
+				post( &repulse::Sound::set_filter_frequency_random, sound->get_filter_frequency_random() + 0.001 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_filter_frequency_random( sound->get_filter_frequency_random() - 0.001 );
+				post( &repulse::Sound::set_filter_frequency_random, sound->get_filter_frequency_random() - 0.001 );
 				break;
 			}
 			break;
 		case ROW_DECAY:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_decay_time( sound->get_decay_time() + 0.1 );
+				post( &repulse::Sound::set_decay_time, sound->get_decay_time() + 0.1 );
 				break;
 			case EDIT_DOWN:
-				sound->set_decay_time( sound->get_decay_time() - 0.1 );
+				post( &repulse::Sound::set_decay_time, sound->get_decay_time() - 0.1 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_decay_time( sound->get_decay_time() + 0.01 );
+				post( &repulse::Sound::set_decay_time, sound->get_decay_time() + 0.01 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_decay_time( sound->get_decay_time() - 0.01 );
+				post( &repulse::Sound::set_decay_time, sound->get_decay_time() - 0.01 );
 				break;
 			}
 			break;
 		case ROW_TYPE:
+			tmp = sound->get_decay_type();
 			switch ( edit_mode ) {
 			case EDIT_UP:
 			case EDIT_UP_FINE:
@@ -825,93 +833,93 @@ public:
 				}
 				break;
 			}
-			sound->set_decay_type( (envelope::DecayType)tmp );
+			post( &repulse::Sound::set_decay_type, (envelope::DecayType)tmp );
 			break;
 		case ROW_PAN:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_panning( sound->get_panning() + 0.01 );
+				post( &repulse::Sound::set_panning, sound->get_panning() + 0.01 );
 				break;
 			case EDIT_DOWN:
-				sound->set_panning( sound->get_panning() - 0.01 );
+				post( &repulse::Sound::set_panning, sound->get_panning() - 0.01 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_panning( sound->get_panning() + 0.001 );
+				post( &repulse::Sound::set_panning, sound->get_panning() + 0.001 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_panning( sound->get_panning() - 0.001 );
+				post( &repulse::Sound::set_panning, sound->get_panning() - 0.001 );
 				break;
 			}
 			break;
 		case ROW_PAN_VELOCITY:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_panning_velocity( sound->get_panning_velocity() + 0.01 );
+				post( &repulse::Sound::set_panning_velocity, sound->get_panning_velocity() + 0.01 );
 				break;
 			case EDIT_DOWN:
-				sound->set_panning_velocity( sound->get_panning_velocity() - 0.01 );
+				post( &repulse::Sound::set_panning_velocity, sound->get_panning_velocity() - 0.01 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_panning_velocity( sound->get_panning_velocity() + 0.001 );
+				post( &repulse::Sound::set_panning_velocity, sound->get_panning_velocity() + 0.001 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_panning_velocity( sound->get_panning_velocity() - 0.001 );
+				post( &repulse::Sound::set_panning_velocity, sound->get_panning_velocity() - 0.001 );
 				break;
 			}
 			break;
 		case ROW_PAN_RANDOM:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_panning_random( sound->get_panning_random() + 0.1 );
+				post( &repulse::Sound::set_panning_random, sound->get_panning_random() + 0.1 );
 				break;
 			case EDIT_DOWN:
-				sound->set_panning_random( sound->get_panning_random() - 0.1 );
+				post( &repulse::Sound::set_panning_random, sound->get_panning_random() - 0.1 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_panning_random( sound->get_panning_random() + 0.01 );
+				post( &repulse::Sound::set_panning_random, sound->get_panning_random() + 0.01 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_panning_random( sound->get_panning_random() - 0.01 );
+				post( &repulse::Sound::set_panning_random, sound->get_panning_random() - 0.01 );
 				break;
 			}
 			break;
 		case ROW_VOLUME:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_volume( sound->get_volume() + 0.1 );
+				post( &repulse::Sound::set_volume, sound->get_volume() + 0.1 );
 				break;
 			case EDIT_DOWN:
-				sound->set_volume( sound->get_volume() - 0.1 );
+				post( &repulse::Sound::set_volume, sound->get_volume() - 0.1 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_volume( sound->get_volume() + 0.01 );
+				post( &repulse::Sound::set_volume, sound->get_volume() + 0.01 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_volume( sound->get_volume() - 0.01 );
+				post( &repulse::Sound::set_volume, sound->get_volume() - 0.01 );
 				break;
 			}
 			break;
 		case ROW_VOLUME_VELOCITY:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				sound->set_volume_velocity( sound->get_volume_velocity() + 0.01 );
+				post( &repulse::Sound::set_volume_velocity, sound->get_volume_velocity() + 0.01 );
 				break;
 			case EDIT_DOWN:
-				sound->set_volume_velocity( sound->get_volume_velocity() - 0.01 );
+				post( &repulse::Sound::set_volume_velocity, sound->get_volume_velocity() - 0.01 );
 				break;
 			case EDIT_UP_FINE:
-				sound->set_volume_velocity( sound->get_volume_velocity() + 0.001 );
+				post( &repulse::Sound::set_volume_velocity, sound->get_volume_velocity() + 0.001 );
 				break;
 			case EDIT_DOWN_FINE:
-				sound->set_volume_velocity( sound->get_volume_velocity() - 0.001 );
+				post( &repulse::Sound::set_volume_velocity, sound->get_volume_velocity() - 0.001 );
 				break;
 			}
 			break;
 		case ROW_MUTED:
-			sound->set_muted( !sound->is_muted() );
+			post( &repulse::Sound::set_muted, !sound->is_muted() );
 			break;
 		case ROW_SOLOED:
-			sound->get_engine()->solo( sound->get_id(), !sound->is_soloed() );
+			post( &repulse::Sound::solo, !sound->is_soloed() );
 			break;
 		}
 	}
@@ -944,7 +952,8 @@ public:
 	~SoundJoin() {}
 	void edit_value( const EditMode& edit_mode ) {
 		if ( get_selected_row() == ROW_LINKED ) {
-			get_sound()->get_engine()->set_linked( !get_sound()->get_engine()->is_linked() );
+			get_sound()->get_engine()->post( repulse::Command(
+					&repulse::Engine::set_linked, !get_sound()->get_engine()->is_linked() ) );
 		} else {
 			Sound::edit_value( edit_mode );
 		}
@@ -1023,16 +1032,16 @@ public:
 		case ROW_STRETCH:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				engine->set_stretch_offset( engine->get_stretch_offset() + 0.1 );
+				engine->post( repulse::Command( &repulse::Engine::set_stretch_offset, engine->get_stretch_offset() + 0.1 ) );
 				break;
 			case EDIT_DOWN:
-				engine->set_stretch_offset( engine->get_stretch_offset() - 0.1 );
+				engine->post( repulse::Command( &repulse::Engine::set_stretch_offset, engine->get_stretch_offset() - 0.1 ) );
 				break;
 			case EDIT_UP_FINE:
-				engine->set_stretch_offset( engine->get_stretch_offset() + 0.01 );
+				engine->post( repulse::Command( &repulse::Engine::set_stretch_offset, engine->get_stretch_offset() + 0.01 ) );
 				break;
 			case EDIT_DOWN_FINE:
-				engine->set_stretch_offset( engine->get_stretch_offset() - 0.01 );
+				engine->post( repulse::Command( &repulse::Engine::set_stretch_offset, engine->get_stretch_offset() - 0.01 ) );
 				break;
 			}
 			break;
@@ -1040,32 +1049,32 @@ public:
 			switch ( edit_mode ) {
 			case EDIT_UP:
 			case EDIT_UP_FINE:
-				engine->set_transpose_offset( engine->get_transpose_offset() + 1 );
+				engine->post( repulse::Command( &repulse::Engine::set_transpose_offset, engine->get_transpose_offset() + 1 ) );
 				break;
 			case EDIT_DOWN:
 			case EDIT_DOWN_FINE:
-				engine->set_transpose_offset( engine->get_transpose_offset() - 1 );
+				engine->post( repulse::Command( &repulse::Engine::set_transpose_offset, engine->get_transpose_offset() - 1 ) );
 				break;
 			}
 			break;
 		case ROW_VOLUME:
 			switch ( edit_mode ) {
 			case EDIT_UP:
-				engine->set_volume( engine->get_volume() + 0.1 );
+				engine->post( repulse::Command( &repulse::Engine::set_volume, engine->get_volume() + 0.1 ) );
 				break;
 			case EDIT_DOWN:
-				engine->set_volume( engine->get_volume() - 0.1 );
+				engine->post( repulse::Command( &repulse::Engine::set_volume, engine->get_volume() - 0.1 ) );
 				break;
 			case EDIT_UP_FINE:
-				engine->set_volume( engine->get_volume() + 0.01 );
+				engine->post( repulse::Command( &repulse::Engine::set_volume, engine->get_volume() + 0.01 ) );
 				break;
 			case EDIT_DOWN_FINE:
-				engine->set_volume( engine->get_volume() - 0.01 );
+				engine->post( repulse::Command( &repulse::Engine::set_volume, engine->get_volume() - 0.01 ) );
 				break;
 			}
 			break;
 		case ROW_LINKED:
-			engine->set_linked( !engine->is_linked() );
+			engine->post( repulse::Command( &repulse::Engine::set_linked, !engine->is_linked() ) );
 			break;
 		}
 	}
@@ -1107,9 +1116,12 @@ protected:
 					split_file_name( engine->get_sounds()[ i ]->get_file_name() ) ) );
 			o.str("");
 		}
+		// Peak load since the last draw and xruns so far.
+		std::ostringstream o;
+		o << std::setw( 3 ) << engine->get_meter().take_peak() << "% x" << engine->get_meter().get_xruns();
 		blocks.push_back( StringVector() );
 		blocks[i].push_back( to_width( "Engine" ) );
-		blocks[i].push_back( to_width( "" ) );
+		blocks[i].push_back( to_width( o.str() ) );
 	}
 public:
 	Header( repulse::Engine* engine, const int& x, const int& y ) :
@@ -1396,35 +1408,35 @@ public:
 				break;
 			case 'q':
 			case 'Q':
-				engine->get_sounds()[ util::SOUND_01 ]->note_on( 120 );
+				engine->post( repulse::Command( engine->get_sounds()[ util::SOUND_01 ], &repulse::Sound::note_on, 120 ) );
 				break;
 			case 'w':
 			case 'W':
-				engine->get_sounds()[ util::SOUND_02 ]->note_on( 120 );
+				engine->post( repulse::Command( engine->get_sounds()[ util::SOUND_02 ], &repulse::Sound::note_on, 120 ) );
 				break;
 			case 'e':
 			case 'E':
-				engine->get_sounds()[ util::SOUND_03 ]->note_on( 120 );
+				engine->post( repulse::Command( engine->get_sounds()[ util::SOUND_03 ], &repulse::Sound::note_on, 120 ) );
 				break;
 			case 'r':
 			case 'R':
-				engine->get_sounds()[ util::SOUND_04 ]->note_on( 120 );
+				engine->post( repulse::Command( engine->get_sounds()[ util::SOUND_04 ], &repulse::Sound::note_on, 120 ) );
 				break;
 			case 't':
 			case 'T':
-				engine->get_sounds()[ util::SOUND_05 ]->note_on( 120 );
+				engine->post( repulse::Command( engine->get_sounds()[ util::SOUND_05 ], &repulse::Sound::note_on, 120 ) );
 				break;
 			case 'y':
 			case 'Y':
-				engine->get_sounds()[ util::SOUND_06 ]->note_on( 120 );
+				engine->post( repulse::Command( engine->get_sounds()[ util::SOUND_06 ], &repulse::Sound::note_on, 120 ) );
 				break;
 			case 'u':
 			case 'U':
-				engine->get_sounds()[ util::SOUND_07 ]->note_on( 120 );
+				engine->post( repulse::Command( engine->get_sounds()[ util::SOUND_07 ], &repulse::Sound::note_on, 120 ) );
 				break;
 			case 'i':
 			case 'I':
-				engine->get_sounds()[ util::SOUND_08 ]->note_on( 120 );
+				engine->post( repulse::Command( engine->get_sounds()[ util::SOUND_08 ], &repulse::Sound::note_on, 120 ) );
 				break;
 			case '+':
 				engine->next_preset();
@@ -1439,31 +1451,31 @@ public:
 				engine->save_preset( engine->get_selected_preset() );
 				break;
 			case CONTROL_R:
-				engine->recall_preset( engine->get_selected_preset() );
+				engine->post( repulse::Command( &repulse::Engine::recall_preset, (size_t)engine->get_selected_preset() ) );
 				break;
 			case CONTROL_W:
-				engine->set_alternate_wheel( !engine->is_alternate_wheel() );
+				engine->post( repulse::Command( &repulse::Engine::set_alternate_wheel, !engine->is_alternate_wheel() ) );
 				break;
 			case CONTROL_O:
-				engine->set_omni( !engine->is_omni() );
+				engine->post( repulse::Command( &repulse::Engine::set_omni, !engine->is_omni() ) );
 				break;
 			case CONTROL_V:
-				engine->set_mono( !engine->is_mono() );
+				engine->post( repulse::Command( &repulse::Engine::set_mono, !engine->is_mono() ) );
 				break;
 			case CONTROL_L:
-				engine->set_local_keyboard( !engine->is_local_keyboard() );
+				engine->post( repulse::Command( &repulse::Engine::set_local_keyboard, !engine->is_local_keyboard() ) );
 				break;
 			case CONTROL_E:
 				leave = true;
 				break;
 			case CONTROL_T:
-				engine->set_base_note( ( engine->get_base_note() + 1 ) % 128 );
+				engine->post( repulse::Command( &repulse::Engine::set_base_note, ( engine->get_base_note() + 1 ) % 128 ) );
 				break;
 			case CONTROL_J:
-				engine->set_base_channel( ( engine->get_base_channel() + 1 ) % 15 );
+				engine->post( repulse::Command( &repulse::Engine::set_base_channel, ( engine->get_base_channel() + 1 ) % 15 ) );
 				break;
 			case CONTROL_F:
-				engine->set_note_map( (util::NoteMapType)( ( engine->get_note_map() + 1 ) % 2 ) );
+				engine->post( repulse::Command( &repulse::Engine::set_note_map, (util::NoteMapType)( ( engine->get_note_map() + 1 ) % 2 ) ) );
 				break;
 			case CONTROL_U:
 				engine->load();
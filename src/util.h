@@ -20,6 +20,9 @@
 #define UTIL_H_
 
 #include <cmath>
+#if defined( __SSE__ )
+#include <xmmintrin.h>
+#endif
 
 namespace util {
 
@@ -31,6 +34,15 @@ static const floating_t PI = acos(-1);
 static const floating_t PI_HALF = PI / 2;
 static const floating_t PI_DOUBLE = PI * 2;
 static const size_t MAX_SOUNDS = 8;
+static const size_t MAX_VOICES = 32;
+// Decaying state below this level (-120 dB) is flushed to zero.
+static const floating_t DEF_TAIL_THRESHOLD = 1e-6;
+
+// Level of a tail threshold given in decibels below full scale; zero
+// decibels turns the cut off.
+static inline floating_t decibels_to_tail_threshold( const floating_t& decibels ) {
+	return decibels > 0 ? pow( 10., -decibels / 20. ) : 0;
+}
 
 enum SoundIdentifier {
 	SOUND_01 = 0,
@@ -43,6 +55,16 @@ enum SoundIdentifier {
 	SOUND_08
 };
 
+// Flushes denormal results to zero (FTZ) and reads denormal operands as
+// zero (DAZ) on the calling thread. Without SSE math only the tail
+// thresholds keep the state away from denormals.
+static inline void set_denormals_zero( const bool& zero = true ) {
+#if defined( __SSE__ )
+	unsigned int csr = _mm_getcsr();
+	_mm_setcsr( zero ? csr | 0x8040 : csr & ~0x8040 );
+#endif
+}
+
 template<class T>
 static inline bool almost_equal( const T& a, const T& b, const T& d = 1e-10 ) {
 	return fabs( b - a ) < d;
@@ -126,6 +148,8 @@ static const unsigned char MIDI_CONT_SOUND_FILTER_RESONANCE_C10 = 8;
 static const unsigned char MIDI_CONT_SOUND_DECAY_C10 = 9;
 static const unsigned char MIDI_CONT_SOUND_PANNING_C10 = 10;
 static const unsigned char MIDI_CONT_SOUND_VOLUME_C10 = 11;
+static const unsigned char MIDI_CONT_SOUND_POLYPHONY_C10 = 12;
+static const unsigned char MIDI_CONT_SOUND_STEALING_C10 = 13;
 static const unsigned char MIDI_CONT_ENGINE_ALL_SOUND_OFF_C10 = 120;
 static const unsigned char MIDI_CONT_ENGINE_ALL_CONTROLLERS_OFF_C10 = 121;
 static const unsigned char MIDI_CONT_ENGINE_LOCAL_KEYBOARD_C10 = 122;
@@ -147,6 +171,7 @@ static const unsigned char MIDI_CONT_SOUND_PANNING_RANDOM_C11 = 9;
 static const unsigned char MIDI_CONT_SOUND_VOLUME_VELOCITY_C11 = 10;
 static const unsigned char MIDI_CONT_SOUND_MUTED_C11 = 11;
 static const unsigned char MIDI_CONT_SOUND_SOLOED_C11 = 12;
+static const unsigned char MIDI_CONT_SOUND_FILTER_ENVELOPE_C11 = 13;
 
 enum NoteMapType {
 	NOTE_MAP_KEYBOARD = 0,
@@ -160,54 +185,159 @@ static const int MIDI_NOTE_MAP[][ MAX_SOUNDS ] = {
 
 static const NoteMapType NOTE_MAP_DEF_TYPE = NOTE_MAP_KEYBOARD;
 
-class MidiNoteOffset {
-	unsigned char id;
-	int base_note;
-	int note;
-	NoteMapType note_map;
-protected:
-	void update() {
-		note = base_note + MIDI_NOTE_MAP[ note_map ][ id ];
-	}
-public:
-	MidiNoteOffset() : id( 0 ), note_map( NOTE_MAP_DEF_TYPE ) {}
-	virtual ~MidiNoteOffset() {}
-	void set_id( const unsigned char& id ) {
-		this->id = id;
-		update();
-	}
-	void set_base_note( const unsigned char& base_note ) {
-		this->base_note = base_note;
-		update();
-	}
-	void set_note_map( const NoteMapType& note_map ) {
-		this->note_map = note_map;
-		update();
-	}
-	bool test( const int& note ) const {
-		return this->note == note;
-	}
+// What a controller drives. Sound parameters repeat every
+// MIDI_CONT_STRIDE controllers from MIDI_CONT_INIT, on the base channel
+// (C10) and on the channel after it (C11).
+enum MidiParameter {
+	MIDI_PARAMETER_NONE = 0,
+	MIDI_PARAMETER_SOUND_START,
+	MIDI_PARAMETER_SOUND_START_SOFT,
+	MIDI_PARAMETER_SOUND_TRANSPOSE,
+	MIDI_PARAMETER_SOUND_STRETCH,
+	MIDI_PARAMETER_SOUND_OVER_DRIVE,
+	MIDI_PARAMETER_SOUND_OVER_DRIVE_ACTIVE,
+	MIDI_PARAMETER_SOUND_FILTER_FREQUENCY,
+	MIDI_PARAMETER_SOUND_FILTER_ACTIVE,
+	MIDI_PARAMETER_SOUND_FILTER_RESONANCE,
+	MIDI_PARAMETER_SOUND_DECAY,
+	MIDI_PARAMETER_SOUND_PANNING,
+	MIDI_PARAMETER_SOUND_VOLUME,
+	MIDI_PARAMETER_SOUND_POLYPHONY,
+	MIDI_PARAMETER_SOUND_STEALING,
+	MIDI_PARAMETER_SOUND_TRANSPOSE_VELOCITY,
+	MIDI_PARAMETER_SOUND_TRANSPOSE_RANDOM,
+	MIDI_PARAMETER_SOUND_STRETCH_VELOCITY,
+	MIDI_PARAMETER_SOUND_STRETCH_TYPE,
+	MIDI_PARAMETER_SOUND_FILTER_TYPE,
+	MIDI_PARAMETER_SOUND_FILTER_VELOCITY,
+	MIDI_PARAMETER_SOUND_FILTER_RANDOM,
+	MIDI_PARAMETER_SOUND_DECAY_TYPE,
+	MIDI_PARAMETER_SOUND_PANNING_VELOCITY,
+	MIDI_PARAMETER_SOUND_PANNING_RANDOM,
+	MIDI_PARAMETER_SOUND_VOLUME_VELOCITY,
+	MIDI_PARAMETER_SOUND_MUTED,
+	MIDI_PARAMETER_SOUND_SOLOED,
+	MIDI_PARAMETER_SOUND_FILTER_ENVELOPE,
+	MIDI_PARAMETER_ENGINE_LINKED,
+	MIDI_PARAMETER_ENGINE_TRANSPOSE,
+	MIDI_PARAMETER_ENGINE_STRETCH,
+	MIDI_PARAMETER_ENGINE_VOLUME,
+	MIDI_PARAMETER_ENGINE_ALL_SOUND_OFF,
+	MIDI_PARAMETER_ENGINE_ALL_CONTROLLERS_OFF,
+	MIDI_PARAMETER_ENGINE_LOCAL_KEYBOARD,
+	MIDI_PARAMETER_ENGINE_ALL_NOTES_OFF,
+	MIDI_PARAMETER_ENGINE_OMNI_MODE_OFF,
+	MIDI_PARAMETER_ENGINE_OMNI_MODE_ON,
+	MIDI_PARAMETER_ENGINE_MONO_OPERATION
+};
+
+static const unsigned char MIDI_NO_SOUND = MAX_SOUNDS;
+static const size_t        MIDI_VALUES = 128;
+
+// Channels are looked up relative to the base channel.
+enum MidiRow {
+	MIDI_ROW_C10 = 0,
+	MIDI_ROW_C11,
+	MIDI_ROW_OTHER
+};
+
+static const size_t MIDI_ROWS = MIDI_ROW_OTHER + 1;
+
+struct MidiTarget {
+	unsigned char sound;
+	MidiParameter parameter;
 };
 
-class MidiControllerOffset {
-	unsigned char id;
-	unsigned char init;
-	unsigned char stride;
-	unsigned char base;
+// Finds the pad a note plays and what a controller drives with a single
+// lookup. Controllers are laid out relative to the base channel, so only
+// the notes change with the base note and the note map.
+class MidiDispatch {
+	unsigned char notes[ MIDI_VALUES ];
+	MidiTarget controllers[ MIDI_ROWS ][ MIDI_VALUES ];
 protected:
-	void update() {
-		base = ( id * stride ) + init;
+	void add_sound( const MidiRow& row, const unsigned char& offset, const MidiParameter& parameter ) {
+		for ( size_t id = 0; id < MAX_SOUNDS; ++id ) {
+			MidiTarget& target = controllers[ row ][ MIDI_CONT_INIT + id * MIDI_CONT_STRIDE + offset ];
+			target.sound = id;
+			target.parameter = parameter;
+		}
+	}
+	void add_engine( const unsigned char& controller, const MidiParameter& parameter ) {
+		// Engine controllers are heard on any channel in omni mode.
+		for ( size_t row = 0; row < MIDI_ROWS; ++row ) {
+			controllers[ row ][ controller ].sound = MIDI_NO_SOUND;
+			controllers[ row ][ controller ].parameter = parameter;
+		}
 	}
 public:
-	MidiControllerOffset() : id( 0 ), init( MIDI_CONT_INIT ),
-		stride( MIDI_CONT_STRIDE ), base( init ) {}
-	void set_id( const unsigned char& id ) {
-		this->id = id;
-		update();
+	MidiDispatch() {
+		for ( size_t row = 0; row < MIDI_ROWS; ++row ) {
+			for ( size_t i = 0; i < MIDI_VALUES; ++i ) {
+				controllers[ row ][ i ].sound = MIDI_NO_SOUND;
+				controllers[ row ][ i ].parameter = MIDI_PARAMETER_NONE;
+			}
+		}
+		add_sound( MIDI_ROW_C10, MIDI_CONT_SOUND_START_C10, MIDI_PARAMETER_SOUND_START );
+		add_sound( MIDI_ROW_C10, MIDI_CONT_SOUND_START_SOFT_C10, MIDI_PARAMETER_SOUND_START_SOFT );
+		add_sound( MIDI_ROW_C10, MIDI_CONT_SOUND_TRANSPOSE_C10, MIDI_PARAMETER_SOUND_TRANSPOSE );
+		add_sound( MIDI_ROW_C10, MIDI_CONT_SOUND_STRETCH_C10, MIDI_PARAMETER_SOUND_STRETCH );
+		add_sound( MIDI_ROW_C10, MIDI_CONT_SOUND_OVER_DRIVE_C10, MIDI_PARAMETER_SOUND_OVER_DRIVE );
+		add_sound( MIDI_ROW_C10, MIDI_CONT_SOUND_OVER_DRIVE_ACTIVE_C10, MIDI_PARAMETER_SOUND_OVER_DRIVE_ACTIVE );
+		add_sound( MIDI_ROW_C10, MIDI_CONT_SOUND_FILTER_FREQUENCY_C10, MIDI_PARAMETER_SOUND_FILTER_FREQUENCY );
+		add_sound( MIDI_ROW_C10, MIDI_CONT_SOUND_FILTER_ACTIVE_C10, MIDI_PARAMETER_SOUND_FILTER_ACTIVE );
+		add_sound( MIDI_ROW_C10, MIDI_CONT_SOUND_FILTER_RESONANCE_C10, MIDI_PARAMETER_SOUND_FILTER_RESONANCE );
+		add_sound( MIDI_ROW_C10, MIDI_CONT_SOUND_DECAY_C10, MIDI_PARAMETER_SOUND_DECAY );
+		add_sound( MIDI_ROW_C10, MIDI_CONT_SOUND_PANNING_C10, MIDI_PARAMETER_SOUND_PANNING );
+		add_sound( MIDI_ROW_C10, MIDI_CONT_SOUND_VOLUME_C10, MIDI_PARAMETER_SOUND_VOLUME );
+		add_sound( MIDI_ROW_C10, MIDI_CONT_SOUND_POLYPHONY_C10, MIDI_PARAMETER_SOUND_POLYPHONY );
+		add_sound( MIDI_ROW_C10, MIDI_CONT_SOUND_STEALING_C10, MIDI_PARAMETER_SOUND_STEALING );
+		add_sound( MIDI_ROW_C11, MIDI_CONT_SOUND_TRANSPOSE_VELOCITY_C11, MIDI_PARAMETER_SOUND_TRANSPOSE_VELOCITY );
+		add_sound( MIDI_ROW_C11, MIDI_CONT_SOUND_TRANSPOSE_RANDOM_C11, MIDI_PARAMETER_SOUND_TRANSPOSE_RANDOM );
+		add_sound( MIDI_ROW_C11, MIDI_CONT_SOUND_STRETCH_VELOCITY_C11, MIDI_PARAMETER_SOUND_STRETCH_VELOCITY );
+		add_sound( MIDI_ROW_C11, MIDI_CONT_SOUND_STRETCH_TYPE_C11, MIDI_PARAMETER_SOUND_STRETCH_TYPE );
+		add_sound( MIDI_ROW_C11, MIDI_CONT_SOUND_FILTER_TYPE_C11, MIDI_PARAMETER_SOUND_FILTER_TYPE );
+		add_sound( MIDI_ROW_C11, MIDI_CONT_SOUND_FILTER_VELOCITY_C11, MIDI_PARAMETER_SOUND_FILTER_VELOCITY );
+		add_sound( MIDI_ROW_C11, MIDI_CONT_SOUND_FILTER_RANDOM_C11, MIDI_PARAMETER_SOUND_FILTER_RANDOM );
+		add_sound( MIDI_ROW_C11, MIDI_CONT_SOUND_DECAY_TYPE_C11, MIDI_PARAMETER_SOUND_DECAY_TYPE );
+		add_sound( MIDI_ROW_C11, MIDI_CONT_SOUND_PANNING_VELOCITY_C11, MIDI_PARAMETER_SOUND_PANNING_VELOCITY );
+		add_sound( MIDI_ROW_C11, MIDI_CONT_SOUND_PANNING_RANDOM_C11, MIDI_PARAMETER_SOUND_PANNING_RANDOM );
+		add_sound( MIDI_ROW_C11, MIDI_CONT_SOUND_VOLUME_VELOCITY_C11, MIDI_PARAMETER_SOUND_VOLUME_VELOCITY );
+		add_sound( MIDI_ROW_C11, MIDI_CONT_SOUND_MUTED_C11, MIDI_PARAMETER_SOUND_MUTED );
+		add_sound( MIDI_ROW_C11, MIDI_CONT_SOUND_SOLOED_C11, MIDI_PARAMETER_SOUND_SOLOED );
+		add_sound( MIDI_ROW_C11, MIDI_CONT_SOUND_FILTER_ENVELOPE_C11, MIDI_PARAMETER_SOUND_FILTER_ENVELOPE );
+		add_engine( MIDI_CONT_ENGINE_LINKED_C10, MIDI_PARAMETER_ENGINE_LINKED );
+		add_engine( MIDI_CONT_ENGINE_TRANSPOSE_C10, MIDI_PARAMETER_ENGINE_TRANSPOSE );
+		add_engine( MIDI_CONT_ENGINE_STRETCH_C10, MIDI_PARAMETER_ENGINE_STRETCH );
+		add_engine( MIDI_CONT_ENGINE_VOLUME_C10, MIDI_PARAMETER_ENGINE_VOLUME );
+		add_engine( MIDI_CONT_ENGINE_ALL_SOUND_OFF_C10, MIDI_PARAMETER_ENGINE_ALL_SOUND_OFF );
+		add_engine( MIDI_CONT_ENGINE_ALL_CONTROLLERS_OFF_C10, MIDI_PARAMETER_ENGINE_ALL_CONTROLLERS_OFF );
+		add_engine( MIDI_CONT_ENGINE_LOCAL_KEYBOARD_C10, MIDI_PARAMETER_ENGINE_LOCAL_KEYBOARD );
+		add_engine( MIDI_CONT_ENGINE_ALL_NOTES_OFF_C10, MIDI_PARAMETER_ENGINE_ALL_NOTES_OFF );
+		add_engine( MIDI_CONT_ENGINE_OMNI_MODE_OFF_C10, MIDI_PARAMETER_ENGINE_OMNI_MODE_OFF );
+		add_engine( MIDI_CONT_ENGINE_OMNI_MODE_ON_C10, MIDI_PARAMETER_ENGINE_OMNI_MODE_ON );
+		add_engine( MIDI_CONT_ENGINE_MONO_OPERATION_C10, MIDI_PARAMETER_ENGINE_MONO_OPERATION );
+		for ( size_t i = 0; i < MIDI_VALUES; ++i ) {
+			notes[i] = MIDI_NO_SOUND;
+		}
+	}
+	virtual ~MidiDispatch() {}
+	void map_notes( const int& base_note, const NoteMapType& note_map ) {
+		int note;
+		for ( size_t i = 0; i < MIDI_VALUES; ++i ) {
+			notes[i] = MIDI_NO_SOUND;
+		}
+		for ( size_t id = 0; id < MAX_SOUNDS; ++id ) {
+			note = base_note + MIDI_NOTE_MAP[ note_map ][ id ];
+			if ( note >= 0 && note < (int)MIDI_VALUES ) {
+				notes[ note ] = id;
+			}
+		}
+	}
+	const unsigned char& get_sound( const unsigned char& note ) const {
+		return notes[ note & 0x7F ];
 	}
-	virtual ~MidiControllerOffset() {}
-	bool test( const unsigned char& controller, const unsigned char& offset ) const {
-		return ( base + offset ) == controller;
+	const MidiTarget& get_target( const MidiRow& row, const unsigned char& controller ) const {
+		return controllers[ row ][ controller & 0x7F ];
 	}
 };
 
@@ -0,0 +1,1099 @@
+/**
+ * This file is part of repulse.
+ * (c) 2010 and onwards Juan Carlos Rodrigo Garcia.
+ *
+ * repulse is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * repulse is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with repulse.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VOICING_H_
+#define VOICING_H_
+
+#include "jack.h"
+#include "filtering.h"
+#include "envelope.h"
+#include "modulation.h"
+#include "threading.h"
+#include "metering.h"
+#include "simd.h"
+#include "util.h"
+
+namespace voicing {
+
+// Working copy of everything a kernel reads or updates, taken from the
+// filters before a block and given back after it.
+struct Block {
+	bool drive_active;
+	bool frequency_active;
+	util::floating_t drive;
+	util::floating_t dc;
+	util::floating_t b0;
+	util::floating_t b1;
+	util::floating_t b2;
+	util::floating_t a1;
+	util::floating_t a2;
+	util::floating_t s1;
+	util::floating_t s2;
+	util::floating_t x1;
+	util::floating_t x2;
+	bool sweeping;
+	jack_nframes_t sweep_frames;
+	util::floating_t db0;
+	util::floating_t db1;
+	util::floating_t db2;
+	util::floating_t da1;
+	util::floating_t da2;
+	util::floating_t amplitude;
+	util::floating_t slope;
+	util::floating_t curve;
+	util::floating_t volume;
+};
+
+// How a kernel runs the biquad: not at all, with fixed coefficients or
+// with coefficients moving every frame towards a sweep target.
+enum FilterMode {
+	FILTER_MODE_OFF = 0,
+	FILTER_MODE_STATIC,
+	FILTER_MODE_SWEEP
+};
+
+static const FilterMode FILTER_MODE_LAST = FILTER_MODE_SWEEP;
+
+// Over drive, biquad, envelope segment and gain in a single pass. Every
+// stage rounds to a sample as the separate filters do, so the output is
+// the same as running them one after the other.
+template< bool DRIVE, FilterMode FILTER, envelope::Segment SEGMENT >
+void kernel( Block& block, jack::sample_t* samples, const jack_nframes_t& frames ) {
+	if ( frames == 0 ) {
+		return;
+	}
+	const util::floating_t drive = block.drive;
+	const util::floating_t dc = block.dc;
+	util::floating_t b0 = block.b0;
+	util::floating_t b1 = block.b1;
+	util::floating_t b2 = block.b2;
+	util::floating_t a1 = block.a1;
+	util::floating_t a2 = block.a2;
+	const util::floating_t db0 = block.db0;
+	const util::floating_t db1 = block.db1;
+	const util::floating_t db2 = block.db2;
+	const util::floating_t da1 = block.da1;
+	const util::floating_t da2 = block.da2;
+	const util::floating_t curve = block.curve;
+	const util::floating_t volume = block.volume;
+	util::floating_t s1 = block.s1;
+	util::floating_t s2 = block.s2;
+	util::floating_t x1 = block.x1;
+	util::floating_t x2 = block.x2;
+	util::floating_t amplitude = block.amplitude;
+	util::floating_t slope = block.slope;
+	for ( jack_nframes_t i = 0; i < frames; ++i ) {
+		jack::sample_t sample = samples[i];
+		if ( DRIVE ) {
+			sample = filtering::OverDrive::clip( sample * drive + dc );
+		}
+		x2 = x1;
+		x1 = sample;
+		if ( FILTER_MODE_OFF != FILTER ) {
+			jack::sample_t y0 = b0 * sample + s1;
+			s1 = b1 * sample - a1 * y0 + s2;
+			s2 = b2 * sample - a2 * y0;
+			sample = y0;
+		}
+		if ( FILTER_MODE_SWEEP == FILTER ) {
+			b0 += db0;
+			b1 += db1;
+			b2 += db2;
+			a1 += da1;
+			a2 += da2;
+		}
+		if ( envelope::SEGMENT_MUTE == SEGMENT ) {
+			samples[i] = 0;
+		} else {
+			if ( envelope::SEGMENT_RAMP == SEGMENT ) {
+				sample *= amplitude;
+				amplitude += slope;
+				slope += curve;
+			}
+			samples[i] = sample * volume;
+		}
+	}
+	if ( FILTER_MODE_SWEEP == FILTER ) {
+		block.b0 = b0;
+		block.b1 = b1;
+		block.b2 = b2;
+		block.a1 = a1;
+		block.a2 = a2;
+	}
+	block.s1 = s1;
+	block.s2 = s2;
+	block.x1 = x1;
+	block.x2 = x2;
+	block.amplitude = amplitude;
+	block.slope = slope;
+}
+
+typedef void (*Kernel)( Block& block, jack::sample_t* samples, const jack_nframes_t& frames );
+
+// Indexed by over drive active, filter mode and envelope segment. The
+// filter type only changes the coefficients, so it is not a dimension.
+static const Kernel KERNELS[2][ FILTER_MODE_LAST + 1 ][ envelope::SEGMENT_LAST + 1 ] = {
+	{
+		{
+			kernel< false, FILTER_MODE_OFF, envelope::SEGMENT_MUTE >,
+			kernel< false, FILTER_MODE_OFF, envelope::SEGMENT_RAMP >,
+			kernel< false, FILTER_MODE_OFF, envelope::SEGMENT_FLAT >
+		}, {
+			kernel< false, FILTER_MODE_STATIC, envelope::SEGMENT_MUTE >,
+			kernel< false, FILTER_MODE_STATIC, envelope::SEGMENT_RAMP >,
+			kernel< false, FILTER_MODE_STATIC, envelope::SEGMENT_FLAT >
+		}, {
+			kernel< false, FILTER_MODE_SWEEP, envelope::SEGMENT_MUTE >,
+			kernel< false, FILTER_MODE_SWEEP, envelope::SEGMENT_RAMP >,
+			kernel< false, FILTER_MODE_SWEEP, envelope::SEGMENT_FLAT >
+		}
+	}, {
+		{
+			kernel< true, FILTER_MODE_OFF, envelope::SEGMENT_MUTE >,
+			kernel< true, FILTER_MODE_OFF, envelope::SEGMENT_RAMP >,
+			kernel< true, FILTER_MODE_OFF, envelope::SEGMENT_FLAT >
+		}, {
+			kernel< true, FILTER_MODE_STATIC, envelope::SEGMENT_MUTE >,
+			kernel< true, FILTER_MODE_STATIC, envelope::SEGMENT_RAMP >,
+			kernel< true, FILTER_MODE_STATIC, envelope::SEGMENT_FLAT >
+		}, {
+			kernel< true, FILTER_MODE_SWEEP, envelope::SEGMENT_MUTE >,
+			kernel< true, FILTER_MODE_SWEEP, envelope::SEGMENT_RAMP >,
+			kernel< true, FILTER_MODE_SWEEP, envelope::SEGMENT_FLAT >
+		}
+	}
+};
+
+// Runs over drive, frequency, envelope and gain as one filter. The kernels
+// are picked again by select() whenever a stage is switched on or off.
+// A bank splits filter() in begin(), render() and end() to run several
+// chains at once.
+class Chain : public filtering::Filter {
+	filtering::OverDrive* over_drive;
+	filtering::Frequency* frequency;
+	envelope::Machine* envelope;
+	filtering::Gain* gain;
+	const Kernel* kernels;
+	const Kernel* sweeps;
+protected:
+	// The coefficients of the filter and, while its envelope sweeps, how
+	// they move until the end of the control period.
+	void coefficients( Block& block ) {
+		const filtering::FrequencyCoefficients& c = frequency->get_coefficients();
+		const filtering::FrequencySweep& sweep = frequency->get_sweep();
+		block.b0 = c.b0_a0;
+		block.b1 = c.b1_a0;
+		block.b2 = c.b2_a0;
+		block.a1 = c.a1_a0;
+		block.a2 = c.a2_a0;
+		block.sweeping = frequency->is_active() && sweep.active;
+		block.sweep_frames = block.sweeping ? sweep.frames : 0;
+		block.db0 = block.sweeping ? sweep.step.b0_a0 : 0;
+		block.db1 = block.sweeping ? sweep.step.b1_a0 : 0;
+		block.db2 = block.sweeping ? sweep.step.b2_a0 : 0;
+		block.da1 = block.sweeping ? sweep.step.a1_a0 : 0;
+		block.da2 = block.sweeping ? sweep.step.a2_a0 : 0;
+	}
+	void load( Block& block ) {
+		filtering::FrequencyMemory& memory = frequency->get_memory();
+		if ( frequency->is_active() ) {
+			filtering::Frequency::settle( memory, frequency->get_coefficients() );
+		}
+		block.drive_active = is_driving();
+		block.frequency_active = frequency->is_active();
+		block.drive = over_drive->get_drive();
+		block.dc = over_drive->get_dc();
+		coefficients( block );
+		block.s1 = memory.s1;
+		block.s2 = memory.s2;
+		block.x1 = memory.x1;
+		block.x2 = memory.x2;
+		block.amplitude = envelope->get_amplitude();
+		block.slope = envelope->get_slope();
+		block.curve = envelope->get_curve();
+		block.volume = gain->get_volume();
+	}
+	void store( const Block& block ) {
+		filtering::FrequencyMemory& memory = frequency->get_memory();
+		memory.s1 = block.s1;
+		memory.s2 = block.s2;
+		memory.x1 = block.x1;
+		memory.x2 = block.x2;
+		memory.following = !frequency->is_active();
+		if ( block.sweeping ) {
+			filtering::FrequencySweep& sweep = frequency->get_sweep();
+			sweep.current.b0_a0 = block.b0;
+			sweep.current.b1_a0 = block.b1;
+			sweep.current.b2_a0 = block.b2;
+			sweep.current.a1_a0 = block.a1;
+			sweep.current.a2_a0 = block.a2;
+			sweep.frames = block.sweep_frames;
+		} else if ( frequency->is_sweeping() ) {
+			frequency->pass( get_client()->get_block_size() );
+		}
+		if ( frequency->is_active() && frequency->is_tail() ) {
+			frequency->clear();
+		}
+		envelope->set_amplitude( block.amplitude );
+		envelope->set_slope( block.slope );
+	}
+public:
+	Chain( jack::Client* client, filtering::OverDrive* over_drive, filtering::Frequency* frequency,
+			envelope::Machine* envelope, filtering::Gain* gain ) :
+		filtering::Filter( client ),
+		over_drive( over_drive ), frequency( frequency ), envelope( envelope ), gain( gain ),
+		kernels( 0 ), sweeps( 0 ) {
+		select();
+	}
+	~Chain() {}
+	// Whether the kernels run the over drive, which they only do at the
+	// base rate; an oversampled one runs on its own before them.
+	bool is_driving() const {
+		return over_drive->is_active() && !over_drive->is_oversampling();
+	}
+	void select() {
+		kernels = KERNELS[ is_driving() ][ frequency->is_active() ? FILTER_MODE_STATIC : FILTER_MODE_OFF ];
+		sweeps = KERNELS[ is_driving() ][ FILTER_MODE_SWEEP ];
+	}
+	// Plans the next block. False when nothing in the chain can turn it
+	// into sound, in which case the block is already done.
+	bool begin( envelope::Plan& plan, Block& block, jack::sample_t* samples ) {
+		envelope->plan( plan );
+		if ( is_silent() && !over_drive->is_active()
+				&& ( !frequency->is_active() || frequency->is_resting() ) ) {
+			frequency->clear();
+			frequency->pass( get_client()->get_block_size() );
+			if ( envelope::SEGMENT_RAMP == plan.head ) {
+				envelope->advance( plan.frames );
+			}
+			envelope->elapse();
+			return false;
+		}
+		load( block );
+		if ( over_drive->is_active() && over_drive->is_oversampling() ) {
+			over_drive->set_silent( is_silent() );
+			over_drive->filter( samples );
+		}
+		return true;
+	}
+	void render( Block& block, const envelope::Plan& plan, jack::sample_t* samples ) {
+		jack_nframes_t buffer_size = get_client()->get_block_size();
+		if ( !block.sweeping ) {
+			kernels[ plan.head ]( block, samples, plan.frames );
+			if ( plan.frames < buffer_size ) {
+				kernels[ plan.tail ]( block, samples + plan.frames, buffer_size - plan.frames );
+			}
+			return;
+		}
+		// A sweep cuts the block at every control period as well.
+		jack_nframes_t start = 0;
+		while ( start < buffer_size ) {
+			if ( block.sweeping && 0 == block.sweep_frames ) {
+				frequency->next();
+				coefficients( block );
+			}
+			jack_nframes_t end = block.sweeping ? std::min( buffer_size, start + block.sweep_frames ) : buffer_size;
+			if ( start < plan.frames && plan.frames < end ) {
+				end = plan.frames;
+			}
+			const Kernel* table = block.sweeping ? sweeps : kernels;
+			table[ start < plan.frames ? plan.head : plan.tail ]( block, samples + start, end - start );
+			if ( block.sweeping ) {
+				block.sweep_frames -= end - start;
+			}
+			start = end;
+		}
+	}
+	void end( const Block& block ) {
+		store( block );
+		set_silent( false );
+		envelope->elapse();
+	}
+	void filter( jack::sample_t* samples ) {
+		envelope::Plan plan;
+		Block block;
+		if ( begin( plan, block, samples ) ) {
+			render( block, plan, samples );
+			end( block );
+		}
+	}
+};
+
+// Chains a bank renders at once, one per SIMD lane.
+static const size_t BANK_LANES = 4;
+
+#if defined( __SSE2__ )
+
+// A bank in registers: lane l holds the chain of the l-th voice.
+struct Lanes {
+	__m128 drive_mask;
+	__m128 drive;
+	__m128 dc;
+	__m128 frequency_mask;
+	__m128 b0;
+	__m128 b1;
+	__m128 b2;
+	__m128 a1;
+	__m128 a2;
+	__m128 s1;
+	__m128 s2;
+	__m128 x1;
+	__m128 x2;
+	__m128 keep_mask;
+	__m128 amplitude;
+	__m128 slope;
+	__m128 curve;
+	__m128 volume;
+};
+
+static inline __m128 lanes_load( Block* const* blocks, const size_t& lanes, util::floating_t Block::* field ) {
+	float values[ BANK_LANES ] = { 0, 0, 0, 0 };
+	for ( size_t l = 0; l < lanes; ++l ) {
+		values[l] = blocks[l]->*field;
+	}
+	return _mm_loadu_ps( values );
+}
+
+static inline __m128 lanes_mask( Block* const* blocks, const size_t& lanes, bool Block::* field ) {
+	float values[ BANK_LANES ] = { 0, 0, 0, 0 };
+	for ( size_t l = 0; l < lanes; ++l ) {
+		values[l] = blocks[l]->*field;
+	}
+	return _mm_cmpneq_ps( _mm_loadu_ps( values ), _mm_setzero_ps() );
+}
+
+static inline __m128 lanes_select( const __m128& mask, const __m128& a, const __m128& b ) {
+	return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+}
+
+// OverDrive::clip on every lane.
+static inline __m128 lanes_clip( const __m128& x ) {
+	const __m128 sign_mask = _mm_set1_ps( -0.f );
+	__m128 sign = _mm_and_ps( x, sign_mask );
+	__m128 outside = _mm_cmpge_ps( _mm_andnot_ps( sign_mask, x ), _mm_set1_ps( 1 ) );
+	__m128 cubic = _mm_sub_ps( x, _mm_mul_ps( _mm_mul_ps( _mm_mul_ps( x, x ), x ), _mm_set1_ps( 1. / 3. ) ) );
+	return lanes_select( outside, _mm_or_ps( _mm_set1_ps( 2. / 3. ), sign ), cubic );
+}
+
+// One sample of every lane through the whole chain, as kernel() does.
+static inline __m128 lanes_step( Lanes& l, __m128 x ) {
+	x = lanes_select( l.drive_mask, lanes_clip( _mm_add_ps( _mm_mul_ps( x, l.drive ), l.dc ) ), x );
+	l.x2 = l.x1;
+	l.x1 = x;
+	__m128 y = _mm_add_ps( _mm_mul_ps( l.b0, x ), l.s1 );
+	l.s1 = _mm_add_ps( _mm_sub_ps( _mm_mul_ps( l.b1, x ), _mm_mul_ps( l.a1, y ) ), l.s2 );
+	l.s2 = _mm_sub_ps( _mm_mul_ps( l.b2, x ), _mm_mul_ps( l.a2, y ) );
+	x = lanes_select( l.frequency_mask, y, x );
+	x = _mm_mul_ps( _mm_mul_ps( x, l.amplitude ), l.volume );
+	l.amplitude = _mm_add_ps( l.amplitude, l.slope );
+	l.slope = _mm_add_ps( l.slope, l.curve );
+	return _mm_and_ps( x, l.keep_mask );
+}
+
+typedef void (*LanesKernel)( Lanes& l, jack::sample_t* const* samples, const size_t& lanes,
+		const jack_nframes_t& start, const jack_nframes_t& end );
+
+// Frames from start to end of every lane, four at a time transposed so
+// that a register holds the same frame of each lane.
+static void lanes_run_sse2( Lanes& l, jack::sample_t* const* samples, const size_t& lanes,
+		const jack_nframes_t& start, const jack_nframes_t& end ) {
+	jack_nframes_t i = start;
+	size_t k;
+	for ( ; i + BANK_LANES <= end; i += BANK_LANES ) {
+		__m128 rows[ BANK_LANES ];
+		for ( k = 0; k < BANK_LANES; ++k ) {
+			rows[k] = k < lanes ? _mm_loadu_ps( samples[k] + i ) : _mm_setzero_ps();
+		}
+		_MM_TRANSPOSE4_PS( rows[0], rows[1], rows[2], rows[3] );
+		for ( k = 0; k < BANK_LANES; ++k ) {
+			rows[k] = lanes_step( l, rows[k] );
+		}
+		_MM_TRANSPOSE4_PS( rows[0], rows[1], rows[2], rows[3] );
+		for ( k = 0; k < lanes; ++k ) {
+			_mm_storeu_ps( samples[k] + i, rows[k] );
+		}
+	}
+	for ( ; i < end; ++i ) {
+		float values[ BANK_LANES ] = { 0, 0, 0, 0 };
+		for ( k = 0; k < lanes; ++k ) {
+			values[k] = samples[k][i];
+		}
+		_mm_storeu_ps( values, lanes_step( l, _mm_loadu_ps( values ) ) );
+		for ( k = 0; k < lanes; ++k ) {
+			samples[k][i] = values[k];
+		}
+	}
+}
+
+
+#if defined( SIMD_X86 )
+// lanes_step() with fused multiply-adds, which also shortens the feedback
+// path of the filter from one sample to the next.
+static inline SIMD_AVX2_TARGET __m128 lanes_step_fma( Lanes& l, __m128 x ) {
+	x = lanes_select( l.drive_mask, lanes_clip( _mm_fmadd_ps( x, l.drive, l.dc ) ), x );
+	l.x2 = l.x1;
+	l.x1 = x;
+	__m128 y = _mm_fmadd_ps( l.b0, x, l.s1 );
+	l.s1 = _mm_fnmadd_ps( l.a1, y, _mm_fmadd_ps( l.b1, x, l.s2 ) );
+	l.s2 = _mm_fnmadd_ps( l.a2, y, _mm_mul_ps( l.b2, x ) );
+	x = lanes_select( l.frequency_mask, y, x );
+	x = _mm_mul_ps( _mm_mul_ps( x, l.amplitude ), l.volume );
+	l.amplitude = _mm_add_ps( l.amplitude, l.slope );
+	l.slope = _mm_add_ps( l.slope, l.curve );
+	return _mm_and_ps( x, l.keep_mask );
+}
+
+static SIMD_AVX2_TARGET void lanes_run_fma( Lanes& l, jack::sample_t* const* samples, const size_t& lanes,
+		const jack_nframes_t& start, const jack_nframes_t& end ) {
+	jack_nframes_t i = start;
+	size_t k;
+	for ( ; i + BANK_LANES <= end; i += BANK_LANES ) {
+		__m128 rows[ BANK_LANES ];
+		for ( k = 0; k < BANK_LANES; ++k ) {
+			rows[k] = k < lanes ? _mm_loadu_ps( samples[k] + i ) : _mm_setzero_ps();
+		}
+		_MM_TRANSPOSE4_PS( rows[0], rows[1], rows[2], rows[3] );
+		for ( k = 0; k < BANK_LANES; ++k ) {
+			rows[k] = lanes_step_fma( l, rows[k] );
+		}
+		_MM_TRANSPOSE4_PS( rows[0], rows[1], rows[2], rows[3] );
+		for ( k = 0; k < lanes; ++k ) {
+			_mm_storeu_ps( samples[k] + i, rows[k] );
+		}
+	}
+	for ( ; i < end; ++i ) {
+		float values[ BANK_LANES ] = { 0, 0, 0, 0 };
+		for ( k = 0; k < lanes; ++k ) {
+			values[k] = samples[k][i];
+		}
+		_mm_storeu_ps( values, lanes_step_fma( l, _mm_loadu_ps( values ) ) );
+		for ( k = 0; k < lanes; ++k ) {
+			samples[k][i] = values[k];
+		}
+	}
+}
+#endif
+
+// Banks only run from the SSE2 level on, below it the chains render one by
+// one, so the SSE2 kernel stands for the scalar one.
+static inline void lanes_run( Lanes& l, jack::sample_t* const* samples, const size_t& lanes,
+		const jack_nframes_t& start, const jack_nframes_t& end ) {
+	static const simd::Kernel< LanesKernel > kernel( lanes_run_sse2, lanes_run_sse2,
+			SIMD_X86_VARIANT( lanes_run_fma ) );
+	kernel.get()( l, samples, lanes, start, end );
+}
+
+#endif
+
+// Renders up to BANK_LANES chains together, each with its own parameters,
+// filter state and envelope plan. Without SSE2 they run one after the other.
+// Chains whose filter sweeps change coefficients within the block are
+// rendered on their own; the rest share the bank.
+static inline void bank( Chain* const* chains, Block* const* blocks, const envelope::Plan* plans,
+		jack::sample_t* const* samples, const size_t& lanes, const jack_nframes_t& frames ) {
+	size_t k;
+#if defined( __SSE2__ )
+	if ( lanes > 1 && simd::Cpu::get_instance().get_level() >= simd::LEVEL_SSE2 ) {
+		Chain* steady_chains[ BANK_LANES ];
+		Block* steady_blocks[ BANK_LANES ];
+		envelope::Plan steady_plans[ BANK_LANES ];
+		jack::sample_t* steady_samples[ BANK_LANES ];
+		size_t steady = 0;
+		for ( k = 0; k < lanes; ++k ) {
+			if ( blocks[k]->sweeping ) {
+				chains[k]->render( *blocks[k], plans[k], samples[k] );
+			} else {
+				steady_chains[ steady ] = chains[k];
+				steady_blocks[ steady ] = blocks[k];
+				steady_plans[ steady ] = plans[k];
+				steady_samples[ steady ] = samples[k];
+				steady++;
+			}
+		}
+		if ( steady < lanes ) {
+			bank( steady_chains, steady_blocks, steady_plans, steady_samples, steady, frames );
+			return;
+		}
+		Lanes l;
+		float amplitude[ BANK_LANES ] = { 0, 0, 0, 0 };
+		float slope[ BANK_LANES ] = { 0, 0, 0, 0 };
+		float curve[ BANK_LANES ] = { 0, 0, 0, 0 };
+		float keep[ BANK_LANES ] = { 0, 0, 0, 0 };
+		float values[ BANK_LANES ];
+		envelope::Segment segments[ BANK_LANES ];
+		l.drive_mask = lanes_mask( blocks, lanes, &Block::drive_active );
+		l.drive = lanes_load( blocks, lanes, &Block::drive );
+		l.dc = lanes_load( blocks, lanes, &Block::dc );
+		l.frequency_mask = lanes_mask( blocks, lanes, &Block::frequency_active );
+		l.b0 = lanes_load( blocks, lanes, &Block::b0 );
+		l.b1 = lanes_load( blocks, lanes, &Block::b1 );
+		l.b2 = lanes_load( blocks, lanes, &Block::b2 );
+		l.a1 = lanes_load( blocks, lanes, &Block::a1 );
+		l.a2 = lanes_load( blocks, lanes, &Block::a2 );
+		l.s1 = lanes_load( blocks, lanes, &Block::s1 );
+		l.s2 = lanes_load( blocks, lanes, &Block::s2 );
+		l.x1 = lanes_load( blocks, lanes, &Block::x1 );
+		l.x2 = lanes_load( blocks, lanes, &Block::x2 );
+		l.volume = lanes_load( blocks, lanes, &Block::volume );
+		for ( k = 0; k < lanes; ++k ) {
+			segments[k] = plans[k].frames > 0 ? plans[k].head : plans[k].tail;
+		}
+		jack_nframes_t start = 0;
+		while ( start < frames ) {
+			// The envelope of every lane keeps its segment up to end.
+			jack_nframes_t end = frames;
+			for ( k = 0; k < lanes; ++k ) {
+				if ( plans[k].frames > start && plans[k].frames < end ) {
+					end = plans[k].frames;
+				}
+				amplitude[k] = envelope::SEGMENT_RAMP == segments[k] ? blocks[k]->amplitude :
+						( envelope::SEGMENT_FLAT == segments[k] ? 1 : 0 );
+				slope[k] = envelope::SEGMENT_RAMP == segments[k] ? blocks[k]->slope : 0;
+				curve[k] = envelope::SEGMENT_RAMP == segments[k] ? blocks[k]->curve : 0;
+				keep[k] = envelope::SEGMENT_MUTE == segments[k] ? 0 : 1;
+			}
+			l.amplitude = _mm_loadu_ps( amplitude );
+			l.slope = _mm_loadu_ps( slope );
+			l.curve = _mm_loadu_ps( curve );
+			l.keep_mask = _mm_cmpneq_ps( _mm_loadu_ps( keep ), _mm_setzero_ps() );
+			lanes_run( l, samples, lanes, start, end );
+			_mm_storeu_ps( amplitude, l.amplitude );
+			_mm_storeu_ps( slope, l.slope );
+			for ( k = 0; k < lanes; ++k ) {
+				if ( envelope::SEGMENT_RAMP == segments[k] ) {
+					blocks[k]->amplitude = amplitude[k];
+					blocks[k]->slope = slope[k];
+				}
+				if ( plans[k].frames == end ) {
+					segments[k] = plans[k].tail;
+				}
+			}
+			start = end;
+		}
+		_mm_storeu_ps( values, l.s1 );
+		for ( k = 0; k < lanes; ++k ) {
+			blocks[k]->s1 = values[k];
+		}
+		_mm_storeu_ps( values, l.s2 );
+		for ( k = 0; k < lanes; ++k ) {
+			blocks[k]->s2 = values[k];
+		}
+		_mm_storeu_ps( values, l.x1 );
+		for ( k = 0; k < lanes; ++k ) {
+			blocks[k]->x1 = values[k];
+		}
+		_mm_storeu_ps( values, l.x2 );
+		for ( k = 0; k < lanes; ++k ) {
+			blocks[k]->x2 = values[k];
+		}
+		return;
+	}
+#endif
+	for ( k = 0; k < lanes; ++k ) {
+		chains[k]->render( *blocks[k], plans[k], samples[k] );
+	}
+}
+
+static const size_t MIN_POLYPHONY = 1;
+static const size_t MAX_POLYPHONY = 8;
+static const size_t DEF_POLYPHONY = MIN_POLYPHONY;
+
+enum StealingType {
+	STEALING_TYPE_OLDEST = 0,
+	STEALING_TYPE_QUIETEST,
+	STEALING_TYPE_LOWEST_VELOCITY
+};
+
+static const StealingType STEALING_DEF_TYPE  = STEALING_TYPE_OLDEST;
+static const StealingType STEALING_LAST_TYPE = STEALING_TYPE_LOWEST_VELOCITY;
+
+static const size_t NO_OWNER = util::MAX_SOUNDS;
+
+// Everything needed to render one note of a pad. Pads only keep their
+// parameters and hand them to the voices they take from the pool.
+class Voice : public filtering::Filter {
+	filtering::WaveReader* reader;
+	filtering::TimeStretch* time_stretch;
+	filtering::Tuner* tuner;
+	filtering::OverDrive* over_drive;
+	filtering::Frequency* frequency;
+	envelope::Machine* envelope;
+	filtering::Gain* gain;
+	Chain* chain;
+	filtering::Panner panner;
+	jack::sample_t* buffer;
+	modulation::Velocity volume_modulation;
+	modulation::Velocity stretch_modulation;
+	modulation::VelocityRandom transpose_modulation;
+	modulation::VelocityRandom filter_frequency_modulation;
+	modulation::VelocityRandom panning_modulation;
+	util::floating_t transpose;
+	size_t owner;
+	size_t stamp;
+	unsigned char velocity;
+	bool busy;
+	bool pending;
+public:
+	Voice( jack::Client* client ) :
+		filtering::Filter( client ),
+		reader( new filtering::WaveReader( client ) ),
+		time_stretch( new filtering::TimeStretch( client, reader ) ),
+		tuner( new filtering::Tuner( client, time_stretch ) ),
+		over_drive( new filtering::OverDrive( client ) ),
+		frequency( new filtering::Frequency( client ) ),
+		envelope( new envelope::Machine( client ) ),
+		gain( new filtering::Gain( client ) ),
+		chain( new Chain( client, over_drive, frequency, envelope, gain ) ),
+		buffer( new jack::sample_t[ client->get_buffer_size() ] ),
+		transpose( filtering::TUNER_DEF_TRANSPOSE ), owner( NO_OWNER ), stamp( 0 ), velocity( 0 ), busy( false ), pending( false ) {
+		memset( buffer, 0, client->get_data_size() );
+		set_silent( true );
+	}
+	~Voice() {
+		delete chain;
+		delete gain;
+		delete envelope;
+		delete frequency;
+		delete over_drive;
+		delete tuner;
+		delete time_stretch;
+		delete reader;
+		delete [] buffer;
+	}
+	void acquire( const size_t& owner, const size_t& stamp ) {
+		if ( owner != this->owner ) {
+			// Filter memory of another pad would click into this one.
+			frequency->clear();
+			this->owner = owner;
+		}
+		this->stamp = stamp;
+		busy = true;
+	}
+	const size_t& get_owner() const {
+		return owner;
+	}
+	const size_t& get_stamp() const {
+		return stamp;
+	}
+	const unsigned char& get_velocity() const {
+		return velocity;
+	}
+	const bool& is_busy() const {
+		return busy;
+	}
+	util::floating_t get_level() const {
+		return envelope->get_level() * gain->get_volume();
+	}
+	void set_wave( filtering::Wave* wave ) {
+		reader->set_wave( wave );
+	}
+	void set_start_soft( const bool& start_soft ) {
+		envelope->set_start_soft( start_soft );
+	}
+	void set_decay_time( const util::floating_t& decay_time ) {
+		if ( decay_time != envelope->get_decay_time() ) {
+			envelope->set_decay_time( decay_time );
+		}
+	}
+	void set_decay_type( const envelope::DecayType& decay_type ) {
+		envelope->set_decay_type( decay_type );
+	}
+	void set_over_drive_active( const bool& over_drive_active ) {
+		if ( over_drive_active != over_drive->is_active() ) {
+			over_drive->set_active( over_drive_active );
+			chain->select();
+		}
+	}
+	void set_transpose_quality( const filtering::TunerQuality& transpose_quality ) {
+		tuner->set_quality( transpose_quality );
+	}
+	void set_over_drive_quality( const filtering::OverDriveQuality& over_drive_quality ) {
+		if ( over_drive_quality != over_drive->get_quality() ) {
+			over_drive->set_quality( over_drive_quality );
+			chain->select();
+		}
+	}
+	void set_over_drive_drive( const util::floating_t& over_drive_drive ) {
+		if ( over_drive_drive != over_drive->get_drive() ) {
+			over_drive->set_drive( over_drive_drive );
+		}
+	}
+	void set_filter_type( const filtering::FrequencyFilterType& filter_type,
+			const util::floating_t& filter_resonance, const util::floating_t& filter_frequency ) {
+		if ( filter_type != frequency->get_filter_type() ) {
+			frequency->set_filter_type( filter_type );
+			frequency->set_resonance( filter_resonance );
+			frequency->set_frequency( filter_frequency_modulation.modulate( filter_frequency ) );
+		}
+	}
+	void set_filter_resonance( const util::floating_t& filter_resonance ) {
+		if ( filter_resonance != frequency->get_resonance() ) {
+			frequency->set_resonance( filter_resonance );
+		}
+	}
+	void set_filter_active( const bool& active ) {
+		if ( active != frequency->is_active() ) {
+			frequency->set_active( active );
+			chain->select();
+		}
+	}
+	void set_filter_envelope( const util::floating_t& filter_envelope ) {
+		frequency->set_envelope( filter_envelope );
+	}
+	void set_filter_envelope_decay( const util::floating_t& filter_envelope_decay ) {
+		frequency->set_envelope_decay( filter_envelope_decay );
+	}
+	void set_tail_threshold( const util::floating_t& tail_threshold ) {
+		envelope->set_tail_threshold( tail_threshold );
+		frequency->set_tail_threshold( tail_threshold );
+	}
+	void set_stretch_type( const filtering::TimeStretchType& stretch_type ) {
+		time_stretch->set_type( stretch_type );
+	}
+	// The values below are modulated by the note that started the voice.
+	void set_volume( const util::floating_t& volume ) {
+		util::floating_t tmp = volume_modulation.modulate( volume );
+		if ( tmp != gain->get_volume() ) {
+			gain->set_volume( tmp );
+		}
+	}
+	void set_stretch( const util::floating_t& stretch ) {
+		util::floating_t tmp = stretch_modulation.modulate( stretch );
+		if ( tmp != time_stretch->get_stretch() ) {
+			time_stretch->set_stretch( tmp );
+		}
+	}
+	void set_transpose( const util::floating_t& transpose ) {
+		this->transpose = transpose_modulation.modulate( transpose );
+		tune();
+	}
+	// The tuner only makes up for what the copy being read lacks.
+	void tune() {
+		util::floating_t tmp = transpose - reader->get_pitch();
+		if ( tmp != tuner->get_transpose() ) {
+			tuner->set_transpose( tmp );
+		}
+	}
+	void set_filter_frequency( const util::floating_t& filter_frequency ) {
+		util::floating_t tmp = filter_frequency_modulation.modulate( filter_frequency );
+		if ( tmp != frequency->get_frequency() ) {
+			frequency->set_frequency( tmp );
+		}
+	}
+	void set_panning( const util::floating_t& panning ) {
+		util::floating_t tmp = panning_modulation.modulate( panning );
+		if ( tmp != panner.get_panning() ) {
+			panner.set_panning( tmp );
+		}
+	}
+	void modulate( const modulation::Velocity& volume_modulation,
+			const modulation::Velocity& stretch_modulation,
+			const modulation::VelocityRandom& transpose_modulation,
+			const modulation::VelocityRandom& filter_frequency_modulation,
+			const modulation::VelocityRandom& panning_modulation,
+			const unsigned char& velocity ) {
+		this->volume_modulation = volume_modulation;
+		this->stretch_modulation = stretch_modulation;
+		this->transpose_modulation = transpose_modulation;
+		this->filter_frequency_modulation = filter_frequency_modulation;
+		this->panning_modulation = panning_modulation;
+		this->velocity = velocity;
+	}
+	// Picks what the reader plays: a render of the wave at the stretch of
+	// the note skips the time stretch, a copy at its pitch part of the tuner.
+	void select() {
+		reader->select( transpose, time_stretch->get_stretch(), time_stretch->get_type() );
+		time_stretch->set_rendered( reader->get_stretched() != 0 );
+		tune();
+	}
+	void reset() {
+		select();
+		tuner->reset();
+	}
+	bool is_copied() const {
+		return reader->is_copied();
+	}
+	const filtering::StretchRender* get_stretched() const {
+		return reader->get_stretched();
+	}
+	void note_on() {
+		select();
+		tuner->reset();
+		frequency->trigger();
+		envelope->note_on();
+	}
+	void note_off() {
+		envelope->note_off();
+	}
+	void silence() {
+		envelope->silence();
+	}
+	// First half of a block: the wave, stretched and tuned. The chain is
+	// left pending, for filter() or a bank to run.
+	void generate( jack::sample_t* samples ) {
+		if ( tuner->is_finished() || envelope->is_finished() ) {
+			busy = false;
+			pending = false;
+			set_silent( true );
+		} else {
+			tuner->filter( samples );
+			chain->set_silent( tuner->is_silent() );
+			pending = true;
+		}
+	}
+	const bool& is_pending() const {
+		return pending;
+	}
+	Chain* get_chain() const {
+		return chain;
+	}
+	// Second half, once the chain has run.
+	void finish() {
+		pending = false;
+		set_silent( chain->is_silent() );
+	}
+	void filter( jack::sample_t* samples ) {
+		generate( samples );
+		if ( is_pending() ) {
+			chain->filter( samples );
+			finish();
+		}
+	}
+	jack::sample_t* get_buffer() const {
+		return buffer;
+	}
+	const util::floating_t& get_mix_left() const {
+		return panner.get_mix_left();
+	}
+	const util::floating_t& get_mix_right() const {
+		return panner.get_mix_right();
+	}
+};
+
+// Voices to render in a period, one job item each.
+class Batch : public threading::Job {
+	jack::Client* client;
+	Voice* voices[ util::MAX_VOICES ];
+	metering::nanoseconds_t costs[ util::MAX_VOICES ];
+	size_t count;
+	metering::Load* meter;
+	bool banks;
+protected:
+	void generate( const size_t& index ) {
+		voices[ index ]->generate( voices[ index ]->get_buffer() );
+	}
+	void bank( const size_t& index ) {
+		Chain* chains[ BANK_LANES ];
+		Block blocks[ BANK_LANES ];
+		Block* pointers[ BANK_LANES ];
+		envelope::Plan plans[ BANK_LANES ];
+		jack::sample_t* samples[ BANK_LANES ];
+		size_t lanes = 0;
+		size_t first = index * BANK_LANES;
+		size_t last = std::min( count, first + BANK_LANES );
+		size_t i;
+		for ( i = first; i < last; ++i ) {
+			Voice* voice = voices[i];
+			if ( voice->is_pending() && voice->get_chain()->begin( plans[ lanes ], blocks[ lanes ], voice->get_buffer() ) ) {
+				chains[ lanes ] = voice->get_chain();
+				pointers[ lanes ] = &blocks[ lanes ];
+				samples[ lanes ] = voice->get_buffer();
+				lanes++;
+			}
+		}
+		if ( lanes ) {
+			voicing::bank( chains, pointers, plans, samples, lanes, client->get_block_size() );
+			for ( i = 0; i < lanes; ++i ) {
+				chains[i]->end( blocks[i] );
+			}
+		}
+		for ( i = first; i < last; ++i ) {
+			if ( voices[i]->is_pending() ) {
+				voices[i]->finish();
+			}
+		}
+	}
+public:
+	Batch( jack::Client* client ) :
+		threading::Job(), client( client ), count( 0 ), meter( 0 ), banks( false ) {}
+	~Batch() {}
+	void clear() {
+		count = 0;
+	}
+	void add( Voice* voice ) {
+		assert( count < util::MAX_VOICES );
+		voices[ count++ ] = voice;
+	}
+	const size_t& get_count() const {
+		return count;
+	}
+	// Counters each voice adds its render time to, if any.
+	void set_meter( metering::Load* meter ) {
+		this->meter = meter;
+	}
+	void run( const size_t& index ) {
+		metering::nanoseconds_t start = meter ? metering::now() : 0;
+		if ( banks ) {
+			bank( index );
+		} else {
+			generate( index );
+		}
+		if ( meter ) {
+			record( index, metering::now() - start );
+		}
+	}
+	// A voice costs its source and an even share of the bank its chain
+	// ran in, added once the bank is done.
+	void record( const size_t& index, const metering::nanoseconds_t& elapsed ) {
+		if ( !banks ) {
+			costs[ index ] = elapsed;
+			return;
+		}
+		size_t first = index * BANK_LANES;
+		size_t last = std::min( count, first + BANK_LANES );
+		for ( size_t i = first; i < last; ++i ) {
+			meter->add_voice( costs[i] + elapsed / ( last - first ) );
+		}
+	}
+	// The sources one voice per item, then the chains a bank of voices
+	// per item.
+	void render( threading::Crew* crew ) {
+		banks = false;
+		crew->run( this, count );
+		banks = true;
+		crew->run( this, ( count + BANK_LANES - 1 ) / BANK_LANES );
+	}
+};
+
+// Preallocated voices shared by every pad. A pad plays at most its
+// polyphony at once and steals from itself past that; when the whole
+// pool is busy it steals from everyone.
+class Pool {
+	Voice* voices[ util::MAX_VOICES ];
+	size_t stamp;
+	util::floating_t tail_threshold;
+protected:
+	Voice* find( const size_t& owner ) const {
+		for ( size_t i = 0; i < util::MAX_VOICES; ++i ) {
+			if ( !voices[i]->is_busy() && owner == voices[i]->get_owner() ) {
+				return voices[i];
+			}
+		}
+		return 0;
+	}
+	Voice* steal( const size_t& owner, const StealingType& stealing ) const {
+		Voice* ret = 0;
+		for ( size_t i = 0; i < util::MAX_VOICES; ++i ) {
+			Voice* voice = voices[i];
+			if ( !voice->is_busy() || ( NO_OWNER != owner && owner != voice->get_owner() ) ) {
+				continue;
+			}
+			if ( !ret || is_before( voice, ret, stealing ) ) {
+				ret = voice;
+			}
+		}
+		return ret;
+	}
+	static bool is_before( const Voice* a, const Voice* b, const StealingType& stealing ) {
+		switch ( stealing ) {
+		case STEALING_TYPE_QUIETEST:
+			if ( a->get_level() != b->get_level() ) {
+				return a->get_level() < b->get_level();
+			}
+			break;
+		case STEALING_TYPE_LOWEST_VELOCITY:
+			if ( a->get_velocity() != b->get_velocity() ) {
+				return a->get_velocity() < b->get_velocity();
+			}
+			break;
+		case STEALING_TYPE_OLDEST:
+			break;
+		}
+		return a->get_stamp() < b->get_stamp();
+	}
+public:
+	Pool( jack::Client* client ) : stamp( 0 ), tail_threshold( util::DEF_TAIL_THRESHOLD ) {
+		for ( size_t i = 0; i < util::MAX_VOICES; ++i ) {
+			voices[i] = new Voice( client );
+		}
+	}
+	virtual ~Pool() {
+		for ( size_t i = 0; i < util::MAX_VOICES; ++i ) {
+			delete voices[i];
+		}
+	}
+	static StealingType controller_to_stealing_type( unsigned char value ) {
+		return (StealingType)( value / ( 128. / (util::floating_t)( STEALING_LAST_TYPE + 1 ) ) );
+	}
+	Voice* get_voice( const size_t& i ) const {
+		return voices[i];
+	}
+	// Level decaying tails of every voice are cut to zero at; never when zero.
+	void set_tail_threshold( const util::floating_t& tail_threshold ) {
+		this->tail_threshold = tail_threshold;
+		for ( size_t i = 0; i < util::MAX_VOICES; ++i ) {
+			voices[i]->set_tail_threshold( tail_threshold );
+		}
+	}
+	const util::floating_t& get_tail_threshold() const {
+		return tail_threshold;
+	}
+	size_t count( const size_t& owner ) const {
+		size_t ret = 0;
+		for ( size_t i = 0; i < util::MAX_VOICES; ++i ) {
+			if ( voices[i]->is_busy() && owner == voices[i]->get_owner() ) {
+				ret++;
+			}
+		}
+		return ret;
+	}
+	// Busy voices of owner, starting the search at i.
+	Voice* next( const size_t& owner, size_t& i ) const {
+		while ( i < util::MAX_VOICES ) {
+			Voice* voice = voices[ i++ ];
+			if ( voice->is_busy() && owner == voice->get_owner() ) {
+				return voice;
+			}
+		}
+		return 0;
+	}
+	Voice* acquire( const size_t& owner, const size_t& polyphony, const StealingType& stealing ) {
+		Voice* voice = 0;
+		if ( count( owner ) >= polyphony ) {
+			voice = steal( owner, stealing );
+		} else {
+			// Prefer a voice this pad played last, its state is already set up.
+			if ( !( voice = find( owner ) ) && !( voice = find( NO_OWNER ) ) ) {
+				for ( size_t i = 0; i < util::MAX_VOICES && !voice; ++i ) {
+					if ( !voices[i]->is_busy() ) {
+						voice = voices[i];
+					}
+				}
+			}
+			if ( !voice ) {
+				voice = steal( NO_OWNER, stealing );
+			}
+		}
+		voice->acquire( owner, ++stamp );
+		return voice;
+	}
+};
+
+} // namespace voicing
+
+#endif /* VOICING_H_ */